@@ -0,0 +1,1696 @@
+#include "bench.h"
+#include "buffer_pool.h"
+#include "device.h"
+#include "device_caps.h"
+#include "device_group.h"
+#include "error.h"
+#include "graph.h"
+#include "host_mem.h"
+#include "program_cache.h"
+#include "reduce.h"
+#include "reference.h"
+#include "specialize.h"
+#include "stream.h"
+#include "task_graph.h"
+#include "timer.h"
+#include <CL/cl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_WARMUP 3
+#define DEFAULT_ITERATIONS 20
+#define MAX_PROGRAMS 16
+#define SEARCH_PATTERN "thatwithhavefrom"
+#define SPMV_BAND 16
+#define STREAM_CHUNK_FLOATS (1 << 20)
+#define STREAM_DEPTH 3
+#define SPLIT_CHARS_PER_ITEM 64
+
+typedef struct {
+  cl_device_id device;
+  cl_context context;
+  cl_command_queue queue;
+  buffer_pool *pool;
+  device_group *group; // created by the first partitioned benchmark
+  unsigned warmup, iterations;
+} bench_env;
+
+static bench_env env;
+
+// a benchmark returns 0 if the device can't run it at this size
+typedef int (*bench_run)(size_t size, bench_result *);
+
+typedef struct {
+  const char *name;
+  const char *unit;
+  unsigned min_log2, max_log2, step_log2;
+  const char *programs[2]; // built side by side before the first benchmark runs
+  bench_run run;
+} benchmark;
+
+/* Helpers */
+
+// programs are built once per run, the sweep reuses them for every size
+static const char *program_names[MAX_PROGRAMS];
+static program_future *program_futures[MAX_PROGRAMS];
+static cl_program programs[MAX_PROGRAMS];
+static int num_programs;
+
+// starts building filename unless it's already known, returns its slot
+static int prefetch_program(const char *filename) {
+  for (int i = 0; i < num_programs; i++) {
+    if (!strcmp(program_names[i], filename)) {
+      return i;
+    }
+  }
+  check_error(num_programs == MAX_PROGRAMS, "Too many benchmark programs.");
+  program_names[num_programs] = filename;
+  program_futures[num_programs] = build_program_async(env.context, env.device, filename, NULL);
+  return num_programs++;
+}
+
+static cl_program get_program(const char *filename) {
+  int i = prefetch_program(filename);
+  if (program_futures[i]) {
+    programs[i] = program_future_get(program_futures[i]);
+    program_futures[i] = NULL;
+  }
+  return programs[i];
+}
+
+static cl_kernel create_kernel(const char *filename, const char *name) {
+  cl_int err;
+  cl_kernel kernel = clCreateKernel(get_program(filename), name, &err);
+  check_error(err, "Couldn't create a kernel.");
+  return kernel;
+}
+
+// buffers come from the pool, a sweep recycles them between sizes and benchmarks
+static cl_mem create_buffer(cl_mem_flags flags, size_t size, void *host_ptr) {
+  cl_int err;
+  cl_mem buffer = host_ptr ? buffer_pool_acquire_copy(env.pool, env.queue, flags, size, host_ptr, &err)
+                           : buffer_pool_acquire(env.pool, flags, size, &err);
+  check_error(err, "Couldn't create a buffer.");
+  return buffer;
+}
+
+static void release_buffer(cl_mem buffer) { buffer_pool_release(env.pool, buffer); }
+
+// a variant of the program with the parameters compiled in, the sweep builds one per size
+static cl_kernel create_specialized_kernel(const char *filename, const char *name, const spec_param *params, unsigned num_params) {
+  cl_program program = build_program_specialized(env.context, env.device, filename, NULL, params, num_params);
+  cl_int err;
+  cl_kernel kernel = clCreateKernel(program, name, &err);
+  check_error(err, "Couldn't create a kernel.");
+  clReleaseProgram(program);
+  return kernel;
+}
+
+static size_t pow2_floor(size_t value) {
+  size_t result = 1;
+  while (result * 2 <= value) {
+    result *= 2;
+  }
+  return result;
+}
+
+// largest power-of-two work-group size the kernel supports on this device
+static size_t kernel_local_size(cl_kernel kernel) {
+  size_t local_size;
+  cl_int err = clGetKernelWorkGroupInfo(kernel, env.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(local_size), &local_size, NULL);
+  check_error(err, "Couldn't find the maximum work-group size.");
+  return pow2_floor(local_size);
+}
+
+static cl_ulong local_mem_size(void) {
+  cl_ulong size;
+  cl_int err = clGetDeviceInfo(env.device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(size), &size, NULL);
+  check_error(err, "Couldn't determine the local memory size.");
+  return size;
+}
+
+static float random_float(void) { return (float)rand() / RAND_MAX; }
+
+/* Reduction: Ch10/reduction_complete */
+
+typedef struct {
+  cl_kernel vector_kernel, complete_kernel;
+  size_t num_floats, local_size;
+  unsigned width;       // floats per work-item, the kernel's VECTOR_WIDTH
+  command_graph *graph; // replays the recorded passes instead of enqueuing them, NULL otherwise
+  cl_mem data_buffer;
+} reduction_state;
+
+// a replay binds the data buffer afresh, as a caller with a new buffer per call would
+static double replay_iteration(command_graph *graph, cl_mem data_buffer) {
+  cl_event first, last;
+  graph_bind(graph, 0, data_buffer);
+  cl_int err = graph_replay(graph, &first, &last);
+  check_error(err, "Couldn't replay the command graph.");
+  return bench_event_ms(first, last);
+}
+
+static void report_graph(const command_graph *graph, const char *name) {
+  fprintf(stderr, "%s: %u commands replayed %s\n", name, graph_num_commands(graph),
+          graph_uses_command_buffer(graph) ? "as a command buffer" : "from the host-side list");
+}
+
+// the same passes as reduction_iteration(), recorded once
+static void reduction_record(reduction_state *s, cl_mem sum_buffer) {
+  command_graph *g = graph_create(env.queue);
+  graph_arg_slot(g, s->vector_kernel, 0, 0);
+  graph_arg(g, s->vector_kernel, 1, s->local_size * s->width * sizeof(float), NULL);
+  graph_arg_slot(g, s->complete_kernel, 0, 0);
+  graph_arg(g, s->complete_kernel, 1, s->local_size * s->width * sizeof(float), NULL);
+  graph_arg(g, s->complete_kernel, 2, sizeof(cl_mem), &sum_buffer);
+
+  size_t global_size = s->num_floats / s->width, local_size = s->local_size;
+  graph_ndrange(g, s->vector_kernel, 1, &global_size, &local_size);
+  while (global_size / local_size > local_size) {
+    global_size /= local_size;
+    graph_ndrange(g, s->vector_kernel, 1, &global_size, &local_size);
+  }
+  global_size /= local_size;
+  graph_ndrange(g, s->complete_kernel, 1, &global_size, &global_size);
+  graph_finalize(g);
+  s->graph = g;
+}
+
+static double reduction_iteration(void *arg) {
+  reduction_state *s = arg;
+  if (s->graph) {
+    return replay_iteration(s->graph, s->data_buffer);
+  }
+  size_t global_size = s->num_floats / s->width, local_size = s->local_size;
+  cl_event first, last;
+  cl_int err = clEnqueueNDRangeKernel(env.queue, s->vector_kernel, 1, NULL, &global_size, &local_size, 0, NULL, &first);
+  while (global_size / local_size > local_size) {
+    global_size /= local_size;
+    err |= clEnqueueNDRangeKernel(env.queue, s->vector_kernel, 1, NULL, &global_size, &local_size, 0, NULL, NULL);
+  }
+  // the last pass must fit into a single work-group
+  global_size /= local_size;
+  err |= clEnqueueNDRangeKernel(env.queue, s->complete_kernel, 1, NULL, &global_size, &global_size, 0, NULL, &last);
+  check_error(err, "Couldn't enqueue the reduction kernels.");
+  return bench_event_ms(first, last);
+}
+
+// width 4 is the chapter's float4 kernel, other widths build a variant with that VECTOR_WIDTH
+static int run_reduction(size_t num_floats, bench_result *r, int graphed, unsigned width) {
+  reduction_state s = {.num_floats = num_floats, .width = width};
+  if (width == 4) {
+    s.vector_kernel = create_kernel("reduction_complete.cl", "reduction_vector");
+    s.complete_kernel = create_kernel("reduction_complete.cl", "reduction_complete");
+  } else {
+    char options[32];
+    snprintf(options, sizeof(options), "-DVECTOR_WIDTH=%u", width);
+    cl_program program = build_program_with_options(env.context, env.device, "reduction_complete.cl", options);
+    cl_int err;
+    s.vector_kernel = clCreateKernel(program, "reduction_vector", &err);
+    check_error(err, "Couldn't create a kernel.");
+    s.complete_kernel = clCreateKernel(program, "reduction_complete", &err);
+    check_error(err, "Couldn't create a kernel.");
+    clReleaseProgram(program);
+  }
+  s.local_size = kernel_local_size(s.vector_kernel);
+  if (s.local_size > num_floats / width) {
+    s.local_size = num_floats / width;
+  }
+
+  // sums of ones are exact in float up to 2^24
+  float *data = malloc(num_floats * sizeof(float));
+  for (size_t i = 0; i < num_floats; i++) {
+    data[i] = 1.0f;
+  }
+  cl_mem data_buffer = create_buffer(CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, num_floats * sizeof(float), data);
+  cl_mem sum_buffer = create_buffer(CL_MEM_WRITE_ONLY, sizeof(float), NULL);
+  cl_int err = CL_SUCCESS;
+  s.data_buffer = data_buffer;
+  if (graphed) {
+    reduction_record(&s, sum_buffer);
+  } else {
+    err |= clSetKernelArg(s.vector_kernel, 0, sizeof(cl_mem), &data_buffer);
+    err |= clSetKernelArg(s.vector_kernel, 1, s.local_size * width * sizeof(float), NULL);
+    err |= clSetKernelArg(s.complete_kernel, 0, sizeof(cl_mem), &data_buffer);
+    err |= clSetKernelArg(s.complete_kernel, 1, s.local_size * width * sizeof(float), NULL);
+    err |= clSetKernelArg(s.complete_kernel, 2, sizeof(cl_mem), &sum_buffer);
+    check_error(err, "Couldn't set a kernel argument.");
+  }
+
+  // the reduction works in place, so only the first run sees the original data
+  float sum;
+  reduction_iteration(&s);
+  err = clEnqueueReadBuffer(env.queue, sum_buffer, CL_BLOCKING, 0, sizeof(float), &sum, 0, NULL, NULL);
+  check_error(err, "Couldn't read the buffer.");
+  r->valid = sum == (float)num_floats;
+
+  r->stats = bench_measure(reduction_iteration, &s, env.warmup, env.iterations);
+  r->bytes = num_floats * sizeof(float);
+  r->flops = num_floats;
+
+  if (s.graph) {
+    report_graph(s.graph, r->name);
+    graph_destroy(s.graph);
+  }
+  free(data);
+  release_buffer(sum_buffer);
+  release_buffer(data_buffer);
+  clReleaseKernel(s.vector_kernel);
+  clReleaseKernel(s.complete_kernel);
+  return 1;
+}
+
+static int bench_reduction(size_t num_floats, bench_result *r) { return run_reduction(num_floats, r, 0, 4); }
+static int bench_reduction_graph(size_t num_floats, bench_result *r) { return run_reduction(num_floats, r, 1, 4); }
+
+// the widest float vector the device prefers, float4 at least
+static int bench_reduction_wide(size_t num_floats, bench_result *r) {
+  return run_reduction(num_floats, r, 0, caps_vector_width(device_caps_get(env.device), CAPS_FLOAT, 4));
+}
+
+/* Reduction engine: Common/reduce.c, one benchmark per way of combining a work-group */
+
+typedef struct {
+  reducer *reducer;
+  cl_mem data_buffer, sum_buffer;
+  size_t num_floats;
+} reduce_state;
+
+static double reduce_iteration(void *arg) {
+  reduce_state *s = arg;
+  cl_event start, end;
+  cl_int err = reducer_enqueue(s->reducer, env.queue, s->data_buffer, s->num_floats, s->sum_buffer, &start, &end);
+  check_error(err, "Couldn't enqueue the reduction.");
+  return bench_event_ms(start, end);
+}
+
+// skipped where the device lacks the builtins, which would silently measure the tree again
+static int run_reduce(size_t num_floats, bench_result *r, reduce_op op, reduce_collective collective) {
+  reducer *red = reducer_create_collective(env.context, env.device, op, REDUCE_FLOAT, 0, collective);
+  if (reducer_collective(red) != collective) {
+    reducer_destroy(red);
+    return 0;
+  }
+
+  float *data = malloc(num_floats * sizeof(float));
+  for (size_t i = 0; i < num_floats; i++) {
+    data[i] = 1.0f;
+  }
+  reduce_state s = {red, NULL, NULL, num_floats};
+  s.data_buffer = create_buffer(CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, num_floats * sizeof(float), data);
+  s.sum_buffer = create_buffer(CL_MEM_READ_WRITE, reducer_result_size(red), NULL);
+
+  // a compensated sum leaves a pair, its first half is the sum rounded to float
+  float sum;
+  reduce_iteration(&s);
+  cl_int err = clEnqueueReadBuffer(env.queue, s.sum_buffer, CL_BLOCKING, 0, sizeof(float), &sum, 0, NULL, NULL);
+  check_error(err, "Couldn't read the buffer.");
+  r->valid = sum == (float)num_floats;
+
+  r->stats = bench_measure(reduce_iteration, &s, env.warmup, env.iterations);
+  r->bytes = num_floats * sizeof(float);
+  r->flops = num_floats;
+
+  free(data);
+  release_buffer(s.sum_buffer);
+  release_buffer(s.data_buffer);
+  reducer_destroy(red);
+  return 1;
+}
+
+static int bench_reduce_tree(size_t num_floats, bench_result *r) { return run_reduce(num_floats, r, REDUCE_SUM, REDUCE_TREE); }
+static int bench_reduce_sub_group(size_t num_floats, bench_result *r) { return run_reduce(num_floats, r, REDUCE_SUM, REDUCE_SUB_GROUP); }
+static int bench_reduce_work_group(size_t num_floats, bench_result *r) { return run_reduce(num_floats, r, REDUCE_SUM, REDUCE_WORK_GROUP); }
+
+// the compensated sum, what carrying the rounding errors along costs next to reduce_tree
+static int bench_reduce_kahan(size_t num_floats, bench_result *r) {
+  return run_reduce(num_floats, r, REDUCE_SUM_COMPENSATED, REDUCE_TREE);
+}
+
+/* Bitonic sort: Ch11/bsort */
+
+typedef struct {
+  cl_kernel init, stage_0, stage_n, merge, merge_last;
+  size_t global_size, local_size;
+  command_graph *graph;
+  cl_mem data_buffer;
+} sort_state;
+
+// the same stages as sort_iteration(), recorded once with only the changing stage arguments stored per launch
+static void sort_record(sort_state *s) {
+  command_graph *g = graph_create(env.queue);
+  cl_kernel kernels[] = {s->init, s->stage_0, s->stage_n, s->merge, s->merge_last};
+  for (int i = 0; i < 5; i++) {
+    graph_arg_slot(g, kernels[i], 0, 0);
+    graph_arg(g, kernels[i], 1, 8 * s->local_size * sizeof(float), NULL);
+  }
+  cl_int direction = 0;
+  graph_arg(g, s->merge, 3, sizeof(int), &direction);
+  graph_arg(g, s->merge_last, 2, sizeof(int), &direction);
+
+  graph_ndrange(g, s->init, 1, &s->global_size, &s->local_size);
+  cl_uint num_stages = s->global_size / s->local_size;
+  for (cl_uint high_stage = 2; high_stage < num_stages; high_stage <<= 1) {
+    graph_arg(g, s->stage_0, 2, sizeof(int), &high_stage);
+    graph_arg(g, s->stage_n, 3, sizeof(int), &high_stage);
+    for (cl_uint stage = high_stage; stage > 1; stage >>= 1) {
+      graph_arg(g, s->stage_n, 2, sizeof(int), &stage);
+      graph_ndrange(g, s->stage_n, 1, &s->global_size, &s->local_size);
+    }
+    graph_ndrange(g, s->stage_0, 1, &s->global_size, &s->local_size);
+  }
+  for (cl_int stage = num_stages; stage > 1; stage >>= 1) {
+    graph_arg(g, s->merge, 2, sizeof(int), &stage);
+    graph_ndrange(g, s->merge, 1, &s->global_size, &s->local_size);
+  }
+  graph_ndrange(g, s->merge_last, 1, &s->global_size, &s->local_size);
+  graph_finalize(g);
+  s->graph = g;
+}
+
+static double sort_iteration(void *arg) {
+  sort_state *s = arg;
+  if (s->graph) {
+    return replay_iteration(s->graph, s->data_buffer);
+  }
+  cl_event first, last;
+  cl_int err = clEnqueueNDRangeKernel(env.queue, s->init, 1, NULL, &s->global_size, &s->local_size, 0, NULL, &first);
+
+  cl_uint num_stages = s->global_size / s->local_size;
+  for (cl_uint high_stage = 2; high_stage < num_stages; high_stage <<= 1) {
+    err |= clSetKernelArg(s->stage_0, 2, sizeof(int), &high_stage);
+    err |= clSetKernelArg(s->stage_n, 3, sizeof(int), &high_stage);
+    for (cl_uint stage = high_stage; stage > 1; stage >>= 1) {
+      err |= clSetKernelArg(s->stage_n, 2, sizeof(int), &stage);
+      err |= clEnqueueNDRangeKernel(env.queue, s->stage_n, 1, NULL, &s->global_size, &s->local_size, 0, NULL, NULL);
+    }
+    err |= clEnqueueNDRangeKernel(env.queue, s->stage_0, 1, NULL, &s->global_size, &s->local_size, 0, NULL, NULL);
+  }
+
+  for (cl_int stage = num_stages; stage > 1; stage >>= 1) {
+    err |= clSetKernelArg(s->merge, 2, sizeof(int), &stage);
+    err |= clEnqueueNDRangeKernel(env.queue, s->merge, 1, NULL, &s->global_size, &s->local_size, 0, NULL, NULL);
+  }
+  err |= clEnqueueNDRangeKernel(env.queue, s->merge_last, 1, NULL, &s->global_size, &s->local_size, 0, NULL, &last);
+  check_error(err, "Couldn't enqueue the sort kernels.");
+  return bench_event_ms(first, last);
+}
+
+static int run_sort(size_t num_floats, bench_result *r, int graphed) {
+  sort_state s = {create_kernel("bsort.cl", "bsort_init"), create_kernel("bsort.cl", "bsort_stage_0"), create_kernel("bsort.cl", "bsort_stage_n"),
+                  create_kernel("bsort.cl", "bsort_merge"), create_kernel("bsort.cl", "bsort_merge_last"), num_floats / 8};
+  s.local_size = kernel_local_size(s.init);
+  if (s.local_size > s.global_size) {
+    s.local_size = s.global_size;
+  }
+
+  float *data = malloc(num_floats * sizeof(float));
+  for (size_t i = 0; i < num_floats; i++) {
+    data[i] = rand();
+  }
+  cl_mem data_buffer = create_buffer(CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, num_floats * sizeof(float), data);
+  cl_kernel kernels[] = {s.init, s.stage_0, s.stage_n, s.merge, s.merge_last};
+  cl_int err = CL_SUCCESS;
+  s.data_buffer = data_buffer;
+  if (graphed) {
+    sort_record(&s);
+  } else {
+    for (int i = 0; i < 5; i++) {
+      err |= clSetKernelArg(kernels[i], 0, sizeof(cl_mem), &data_buffer);
+      err |= clSetKernelArg(kernels[i], 1, 8 * s.local_size * sizeof(float), NULL);
+    }
+    cl_int direction = 0;
+    err |= clSetKernelArg(s.merge, 3, sizeof(int), &direction);
+    err |= clSetKernelArg(s.merge_last, 2, sizeof(int), &direction);
+    check_error(err, "Couldn't set a kernel argument.");
+  }
+
+  // the network is data-oblivious, sorting already sorted data in the timed runs costs the same
+  sort_iteration(&s);
+  err = clEnqueueReadBuffer(env.queue, data_buffer, CL_BLOCKING, 0, num_floats * sizeof(float), data, 0, NULL, NULL);
+  check_error(err, "Couldn't read the buffer.");
+  r->valid = 1;
+  for (size_t i = 1; i < num_floats && r->valid; i++) {
+    r->valid = data[i - 1] <= data[i];
+  }
+
+  r->stats = bench_measure(sort_iteration, &s, env.warmup, env.iterations);
+  // effective bandwidth, as if the keys were read and written once
+  r->bytes = 2.0 * num_floats * sizeof(float);
+
+  if (s.graph) {
+    report_graph(s.graph, r->name);
+    graph_destroy(s.graph);
+  }
+  free(data);
+  release_buffer(data_buffer);
+  for (int i = 0; i < 5; i++) {
+    clReleaseKernel(kernels[i]);
+  }
+  return 1;
+}
+
+static int bench_sort(size_t num_floats, bench_result *r) { return run_sort(num_floats, r, 0); }
+static int bench_sort_graph(size_t num_floats, bench_result *r) { return run_sort(num_floats, r, 1); }
+
+/* String search: Ch11/string_search */
+
+typedef struct {
+  cl_kernel kernel;
+  cl_mem result_buffer;
+  size_t global_size, local_size;
+} search_state;
+
+static double search_iteration(void *arg) {
+  search_state *s = arg;
+  cl_int zero[4] = {0};
+  cl_event event;
+  cl_int err = clEnqueueWriteBuffer(env.queue, s->result_buffer, CL_FALSE, 0, sizeof(zero), zero, 0, NULL, NULL);
+  err |= clEnqueueNDRangeKernel(env.queue, s->kernel, 1, NULL, &s->global_size, &s->local_size, 0, NULL, &event);
+  check_error(err, "Couldn't enqueue the search kernel.");
+  return bench_event_ms(event, event);
+}
+
+static int bench_string_search(size_t text_size, bench_result *r) {
+  search_state s = {create_kernel("string_search.cl", "string_search")};
+  s.local_size = kernel_local_size(s.kernel);
+  cl_uint compute_units;
+  cl_int err = clGetDeviceInfo(env.device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(compute_units), &compute_units, NULL);
+  check_error(err, "Couldn't obtain device information.");
+  s.global_size = compute_units * s.local_size;
+  cl_int chars_per_item = (text_size + s.global_size - 1) / s.global_size;
+
+  // words from the book's pattern mixed with filler, every work-item reads 15 characters past its range
+  static const char *words[] = {"that", "with", "have", "from", "the", "a", "castle", "k", "said", "and"};
+  size_t padded_size = chars_per_item * s.global_size + 16;
+  char *text = malloc(padded_size);
+  for (size_t i = 0; i < padded_size;) {
+    const char *word = words[rand() % 10];
+    for (; *word && i < padded_size; word++) {
+      text[i++] = *word;
+    }
+    if (i < padded_size) {
+      text[i++] = ' ';
+    }
+  }
+  cl_int expected[4] = {0};
+  for (size_t i = 0; i < chars_per_item * s.global_size; i++) {
+    for (int w = 0; w < 4; w++) {
+      expected[w] += !memcmp(text + i + 4 * w, SEARCH_PATTERN + 4 * w, 4);
+    }
+  }
+
+  cl_char16 pattern;
+  memcpy(pattern.s, SEARCH_PATTERN, 16);
+  cl_mem text_buffer = create_buffer(CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, padded_size, text);
+  s.result_buffer = create_buffer(CL_MEM_READ_WRITE, 4 * sizeof(cl_int), NULL);
+  err = clSetKernelArg(s.kernel, 0, sizeof(pattern), &pattern);
+  err |= clSetKernelArg(s.kernel, 1, sizeof(cl_mem), &text_buffer);
+  err |= clSetKernelArg(s.kernel, 2, sizeof(chars_per_item), &chars_per_item);
+  err |= clSetKernelArg(s.kernel, 3, 4 * sizeof(cl_int), NULL);
+  err |= clSetKernelArg(s.kernel, 4, sizeof(cl_mem), &s.result_buffer);
+  check_error(err, "Couldn't set a kernel argument.");
+
+  cl_int found[4];
+  search_iteration(&s);
+  err = clEnqueueReadBuffer(env.queue, s.result_buffer, CL_BLOCKING, 0, sizeof(found), found, 0, NULL, NULL);
+  check_error(err, "Couldn't read the buffer.");
+  r->valid = !memcmp(found, expected, sizeof(found));
+
+  r->stats = bench_measure(search_iteration, &s, env.warmup, env.iterations);
+  r->bytes = text_size;
+
+  free(text);
+  release_buffer(text_buffer);
+  release_buffer(s.result_buffer);
+  clReleaseKernel(s.kernel);
+  return 1;
+}
+
+/* Single-kernel benchmarks share one iteration function */
+
+typedef struct {
+  cl_kernel kernel;
+  cl_uint work_dim;
+  size_t global_size[2];
+  const size_t *local_size;
+} kernel_state;
+
+static double kernel_iteration(void *arg) {
+  kernel_state *s = arg;
+  cl_event event;
+  cl_int err = clEnqueueNDRangeKernel(env.queue, s->kernel, s->work_dim, NULL, s->global_size, s->local_size, 0, NULL, &event);
+  check_error(err, "Couldn't enqueue the kernel.");
+  return bench_event_ms(event, event);
+}
+
+/* Matrix multiplication: Ch12/matrix_mult, computes A * B^T with B already transposed */
+
+// the specialised variant compiles the matrix size in, which lets the compiler unroll the dot product loop
+static int run_gemm(size_t dim, bench_result *r, int specialized) {
+  spec_param params[] = {spec_int("MATRIX_DIM", dim)};
+  cl_kernel kernel = specialized ? create_specialized_kernel("matrix_mult.cl", "matrix_mult", params, 1)
+                                 : create_kernel("matrix_mult.cl", "matrix_mult");
+  kernel_state s = {kernel, 1, {dim}};
+  size_t elements = dim * dim;
+  float *a = malloc(elements * sizeof(float));
+  float *b = malloc(elements * sizeof(float));
+  float *c = malloc(elements * sizeof(float));
+  for (size_t i = 0; i < elements; i++) {
+    a[i] = random_float();
+    b[i] = random_float();
+  }
+  cl_mem a_buffer = create_buffer(CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, elements * sizeof(float), a);
+  cl_mem b_buffer = create_buffer(CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, elements * sizeof(float), b);
+  cl_mem c_buffer = create_buffer(CL_MEM_WRITE_ONLY, elements * sizeof(float), NULL);
+  cl_int err = clSetKernelArg(s.kernel, 0, sizeof(cl_mem), &a_buffer);
+  err |= clSetKernelArg(s.kernel, 1, sizeof(cl_mem), &b_buffer);
+  err |= clSetKernelArg(s.kernel, 2, sizeof(cl_mem), &c_buffer);
+  check_error(err, "Couldn't set a kernel argument.");
+
+  kernel_iteration(&s);
+  err = clEnqueueReadBuffer(env.queue, c_buffer, CL_BLOCKING, 0, elements * sizeof(float), c, 0, NULL, NULL);
+  check_error(err, "Couldn't read the buffer.");
+  float *expected = malloc(elements * sizeof(float));
+  ref_gemm_bt(dim, dim, dim, a, b, expected);
+  r->valid = ref_compare(c, expected, elements, 1e-4, 1e-4).mismatches == 0;
+  free(expected);
+
+  r->stats = bench_measure(kernel_iteration, &s, env.warmup, env.iterations);
+  r->bytes = 3.0 * elements * sizeof(float);
+  r->flops = 2.0 * dim * dim * dim;
+
+  free(a);
+  free(b);
+  free(c);
+  release_buffer(a_buffer);
+  release_buffer(b_buffer);
+  release_buffer(c_buffer);
+  clReleaseKernel(s.kernel);
+  return 1;
+}
+
+static int bench_gemm(size_t dim, bench_result *r) { return run_gemm(dim, r, 0); }
+static int bench_gemm_spec(size_t dim, bench_result *r) { return run_gemm(dim, r, 1); }
+
+/* In-place transpose: Ch12/transpose */
+
+static int bench_transpose(size_t dim, bench_result *r) {
+  cl_uint blocks = dim / 4;
+  kernel_state s = {create_kernel("transpose.cl", "transpose"), 1, {blocks * (blocks + 1) / 2}};
+  size_t elements = dim * dim;
+  // indices stay exact in float up to 2^24 elements
+  float *data = malloc(elements * sizeof(float));
+  for (size_t i = 0; i < elements; i++) {
+    data[i] = i;
+  }
+  cl_mem data_buffer = create_buffer(CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, elements * sizeof(float), data);
+  cl_int err = clSetKernelArg(s.kernel, 0, sizeof(cl_mem), &data_buffer);
+  err |= clSetKernelArg(s.kernel, 1, local_mem_size() - 1024, NULL);
+  err |= clSetKernelArg(s.kernel, 2, sizeof(blocks), &blocks);
+  check_error(err, "Couldn't set a kernel argument.");
+
+  kernel_iteration(&s);
+  err = clEnqueueReadBuffer(env.queue, data_buffer, CL_BLOCKING, 0, elements * sizeof(float), data, 0, NULL, NULL);
+  check_error(err, "Couldn't read the buffer.");
+  r->valid = 1;
+  for (size_t row = 0; row < dim && r->valid; row++) {
+    for (size_t col = 0; col < dim; col++) {
+      r->valid &= data[row * dim + col] == (float)(col * dim + row);
+    }
+  }
+
+  r->stats = bench_measure(kernel_iteration, &s, env.warmup, env.iterations);
+  r->bytes = 2.0 * elements * sizeof(float);
+
+  free(data);
+  release_buffer(data_buffer);
+  clReleaseKernel(s.kernel);
+  return 1;
+}
+
+/* Upload, transpose and multiply: the Ch12/matrix_mult host as a task graph */
+
+typedef struct {
+  task_graph *tasks;
+  cl_kernel transpose_kernel, mult_kernel;
+  cl_mem a_buffer, b_buffer, c_buffer;
+  float *a, *b, *c;
+  size_t dim, transpose_size;
+} dag_state;
+
+// the tasks spread over several queues, so this measures wall time rather than device time
+static double dag_iteration(void *arg) {
+  dag_state *s = arg;
+  size_t bytes = s->dim * s->dim * sizeof(float), mult_size = s->dim;
+  double start = timer_ms();
+  cl_mem mult_reads[] = {s->a_buffer, s->b_buffer};
+  task_write(s->tasks, s->b_buffer, 0, bytes, s->b);
+  task_kernel(s->tasks, s->transpose_kernel, 1, &s->transpose_size, NULL, NULL, 0, &s->b_buffer, 1);
+  task_write(s->tasks, s->a_buffer, 0, bytes, s->a);
+  task_kernel(s->tasks, s->mult_kernel, 1, &mult_size, NULL, mult_reads, 2, &s->c_buffer, 1);
+  task_read(s->tasks, s->c_buffer, 0, bytes, s->c);
+  cl_int err = task_graph_finish(s->tasks);
+  check_error(err, "Couldn't run the tasks.");
+  return timer_ms() - start;
+}
+
+// num_queues 1 runs the same tasks serialised on a single in-order queue
+static int run_dag(size_t dim, bench_result *r, unsigned num_queues) {
+  cl_uint blocks = dim / 4;
+  dag_state s = {task_graph_create(env.context, env.device, num_queues), create_kernel("transpose.cl", "transpose"),
+                 create_kernel("matrix_mult.cl", "matrix_mult")};
+  s.dim = dim;
+  s.transpose_size = blocks * (blocks + 1) / 2;
+  size_t elements = dim * dim;
+  s.a = malloc(elements * sizeof(float));
+  s.b = malloc(elements * sizeof(float));
+  s.c = malloc(elements * sizeof(float));
+  for (size_t i = 0; i < elements; i++) {
+    s.a[i] = random_float();
+    s.b[i] = random_float();
+  }
+  s.a_buffer = create_buffer(CL_MEM_READ_ONLY, elements * sizeof(float), NULL);
+  s.b_buffer = create_buffer(CL_MEM_READ_WRITE, elements * sizeof(float), NULL);
+  s.c_buffer = create_buffer(CL_MEM_WRITE_ONLY, elements * sizeof(float), NULL);
+  cl_int err = clSetKernelArg(s.transpose_kernel, 0, sizeof(cl_mem), &s.b_buffer);
+  err |= clSetKernelArg(s.transpose_kernel, 1, local_mem_size() - 1024, NULL);
+  err |= clSetKernelArg(s.transpose_kernel, 2, sizeof(blocks), &blocks);
+  err |= clSetKernelArg(s.mult_kernel, 0, sizeof(cl_mem), &s.a_buffer);
+  err |= clSetKernelArg(s.mult_kernel, 1, sizeof(cl_mem), &s.b_buffer);
+  err |= clSetKernelArg(s.mult_kernel, 2, sizeof(cl_mem), &s.c_buffer);
+  check_error(err, "Couldn't set a kernel argument.");
+  task_graph_report(s.tasks, stderr);
+
+  // B is uploaded untransposed, the product is A * B
+  dag_iteration(&s);
+  float *expected = malloc(elements * sizeof(float));
+  ref_gemm(dim, dim, dim, s.a, s.b, expected);
+  r->valid = ref_compare(s.c, expected, elements, 1e-4, 1e-4).mismatches == 0;
+  free(expected);
+
+  r->stats = bench_measure(dag_iteration, &s, env.warmup, env.iterations);
+  r->bytes = 3.0 * elements * sizeof(float);
+  r->flops = 2.0 * dim * dim * dim;
+
+  free(s.a);
+  free(s.b);
+  free(s.c);
+  release_buffer(s.a_buffer);
+  release_buffer(s.b_buffer);
+  release_buffer(s.c_buffer);
+  clReleaseKernel(s.transpose_kernel);
+  clReleaseKernel(s.mult_kernel);
+  task_graph_destroy(s.tasks);
+  return 1;
+}
+
+static int bench_dag(size_t dim, bench_result *r) { return run_dag(dim, r, 0); }
+static int bench_dag_serial(size_t dim, bench_result *r) { return run_dag(dim, r, 1); }
+
+/* Radix-2 FFT: Ch14/fft */
+
+typedef struct {
+  cl_kernel init_kernel, stage_kernel;
+  size_t global_size, local_size;
+  cl_uint num_points, points_per_group;
+  command_graph *graph;
+  cl_mem data_buffer;
+} fft_state;
+
+// the input stays a recorded value, only the transformed data is bound per replay
+static void fft_record(fft_state *s, cl_mem input_buffer, int direction) {
+  command_graph *g = graph_create(env.queue);
+  graph_arg(g, s->init_kernel, 0, sizeof(cl_mem), &input_buffer);
+  graph_arg_slot(g, s->init_kernel, 1, 0);
+  graph_arg(g, s->init_kernel, 2, s->points_per_group * 2 * sizeof(float), NULL);
+  graph_arg(g, s->init_kernel, 3, sizeof(s->points_per_group), &s->points_per_group);
+  graph_arg(g, s->init_kernel, 4, sizeof(s->num_points), &s->num_points);
+  graph_arg(g, s->init_kernel, 5, sizeof(direction), &direction);
+  graph_arg_slot(g, s->stage_kernel, 0, 0);
+  graph_arg(g, s->stage_kernel, 2, sizeof(s->points_per_group), &s->points_per_group);
+  graph_arg(g, s->stage_kernel, 3, sizeof(direction), &direction);
+
+  graph_ndrange(g, s->init_kernel, 1, &s->global_size, &s->local_size);
+  for (cl_uint stage = 2; stage <= s->num_points / s->points_per_group; stage <<= 1) {
+    graph_arg(g, s->stage_kernel, 1, sizeof(stage), &stage);
+    graph_ndrange(g, s->stage_kernel, 1, &s->global_size, &s->local_size);
+  }
+  graph_finalize(g);
+  s->graph = g;
+}
+
+static double fft_iteration(void *arg) {
+  fft_state *s = arg;
+  if (s->graph) {
+    return replay_iteration(s->graph, s->data_buffer);
+  }
+  cl_event first, last;
+  cl_int err = clEnqueueNDRangeKernel(env.queue, s->init_kernel, 1, NULL, &s->global_size, &s->local_size, 0, NULL, &first);
+  for (cl_uint stage = 2; stage <= s->num_points / s->points_per_group; stage <<= 1) {
+    err |= clSetKernelArg(s->stage_kernel, 1, sizeof(stage), &stage);
+    err |= clEnqueueNDRangeKernel(env.queue, s->stage_kernel, 1, NULL, &s->global_size, &s->local_size, 0, NULL, NULL);
+  }
+  // a marker ends the measurement whether or not stage kernels were needed
+  err |= clEnqueueMarkerWithWaitList(env.queue, 0, NULL, &last);
+  check_error(err, "Couldn't enqueue the FFT kernels.");
+  return bench_event_ms(first, last);
+}
+
+// the specialised variant compiles the sizes and the direction in, only the stage stays a runtime argument
+static int run_fft(size_t num_points, bench_result *r, int specialized, int graphed) {
+  fft_state s = {create_kernel("fft.cl", "fft_init"), create_kernel("fft.cl", "fft_stage")};
+  s.num_points = num_points;
+  s.points_per_group = caps_local_pow2(device_caps_get(env.device), 2 * sizeof(float), 2048);
+  if (s.points_per_group > num_points) {
+    s.points_per_group = num_points;
+  }
+  // every work-item transforms at least 4 points
+  s.local_size = kernel_local_size(s.init_kernel);
+  if (s.local_size > s.points_per_group / 4) {
+    s.local_size = s.points_per_group / 4;
+  }
+  s.global_size = (num_points / s.points_per_group) * s.local_size;
+  if (specialized) {
+    spec_param params[] = {spec_int("FFT_SIZE", num_points), spec_int("FFT_POINTS_PER_GROUP", s.points_per_group),
+                           spec_int("FFT_LOCAL_SIZE", s.local_size), spec_int("FFT_DIR", 1)};
+    clReleaseKernel(s.init_kernel);
+    clReleaseKernel(s.stage_kernel);
+    s.init_kernel = create_specialized_kernel("fft.cl", "fft_init", params, 4);
+    s.stage_kernel = create_specialized_kernel("fft.cl", "fft_stage", params, 4);
+  }
+
+  float *data = malloc(2 * num_points * sizeof(float));
+  for (size_t i = 0; i < 2 * num_points; i++) {
+    data[i] = random_float();
+  }
+  cl_mem input_buffer = create_buffer(CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, 2 * num_points * sizeof(float), data);
+  cl_mem data_buffer = create_buffer(CL_MEM_READ_WRITE, 2 * num_points * sizeof(float), NULL);
+  int direction = 1;
+  cl_int err = CL_SUCCESS;
+  s.data_buffer = data_buffer;
+  if (graphed) {
+    fft_record(&s, input_buffer, direction);
+  } else {
+    err |= clSetKernelArg(s.init_kernel, 0, sizeof(cl_mem), &input_buffer);
+    err |= clSetKernelArg(s.init_kernel, 1, sizeof(cl_mem), &data_buffer);
+    err |= clSetKernelArg(s.init_kernel, 2, s.points_per_group * 2 * sizeof(float), NULL);
+    err |= clSetKernelArg(s.init_kernel, 3, sizeof(s.points_per_group), &s.points_per_group);
+    err |= clSetKernelArg(s.init_kernel, 4, sizeof(s.num_points), &s.num_points);
+    err |= clSetKernelArg(s.init_kernel, 5, sizeof(direction), &direction);
+    err |= clSetKernelArg(s.stage_kernel, 0, sizeof(cl_mem), &data_buffer);
+    err |= clSetKernelArg(s.stage_kernel, 2, sizeof(s.points_per_group), &s.points_per_group);
+    err |= clSetKernelArg(s.stage_kernel, 3, sizeof(direction), &direction);
+    check_error(err, "Couldn't set a kernel argument.");
+  }
+
+  float *output = malloc(2 * num_points * sizeof(float));
+  fft_iteration(&s);
+  err = clEnqueueReadBuffer(env.queue, data_buffer, CL_BLOCKING, 0, 2 * num_points * sizeof(float), output, 0, NULL, NULL);
+  check_error(err, "Couldn't read the buffer.");
+  // every bin against the CPU reference, the error of a float FFT grows with the magnitude of the input
+  double l1_norm = 0.0;
+  double *input = malloc(2 * num_points * sizeof(double));
+  double *expected = malloc(2 * num_points * sizeof(double));
+  for (size_t i = 0; i < 2 * num_points; i++) {
+    l1_norm += fabs(data[i]);
+    input[i] = data[i];
+  }
+  ref_fft(num_points, input, expected, direction);
+  r->valid = ref_compare_double(output, expected, 2 * num_points, 1e-4 * l1_norm, 0.0).mismatches == 0;
+  free(input);
+  free(expected);
+
+  r->stats = bench_measure(fft_iteration, &s, env.warmup, env.iterations);
+  double passes = 1.0 + log2((double)num_points / s.points_per_group);
+  r->bytes = passes * 2.0 * num_points * 2 * sizeof(float);
+  r->flops = 5.0 * num_points * log2((double)num_points);
+
+  if (s.graph) {
+    report_graph(s.graph, r->name);
+    graph_destroy(s.graph);
+  }
+  free(data);
+  free(output);
+  release_buffer(input_buffer);
+  release_buffer(data_buffer);
+  clReleaseKernel(s.init_kernel);
+  clReleaseKernel(s.stage_kernel);
+  return 1;
+}
+
+static int bench_fft(size_t num_points, bench_result *r) { return run_fft(num_points, r, 0, 0); }
+static int bench_fft_spec(size_t num_points, bench_result *r) { return run_fft(num_points, r, 1, 0); }
+static int bench_fft_graph(size_t num_points, bench_result *r) { return run_fft(num_points, r, 0, 1); }
+
+/* Sparse matrix-vector product: CSR counterpart of the product inside Ch13/conj_grad */
+
+// banded matrix, like the stiffness matrices read by Ch13, with room for SPMV_BAND values per row; returns the count
+static size_t band_matrix(size_t num_rows, cl_int *row_offsets, cl_int *cols, float *values, float *x) {
+  size_t nnz = 0;
+  for (size_t row = 0; row < num_rows; row++) {
+    row_offsets[row] = nnz;
+    for (long col = (long)row - SPMV_BAND / 2; col < (long)row + SPMV_BAND / 2; col++) {
+      if (col >= 0 && col < (long)num_rows) {
+        cols[nnz] = col;
+        values[nnz++] = random_float();
+      }
+    }
+    x[row] = random_float();
+  }
+  row_offsets[num_rows] = nnz;
+  return nnz;
+}
+
+static int bench_spmv(size_t num_rows, bench_result *r) {
+  kernel_state s = {create_kernel("spmv.cl", "spmv_csr"), 1, {num_rows}};
+
+  cl_int *row_offsets = malloc((num_rows + 1) * sizeof(cl_int));
+  cl_int *cols = malloc(num_rows * SPMV_BAND * sizeof(cl_int));
+  float *values = malloc(num_rows * SPMV_BAND * sizeof(float));
+  float *x = malloc(num_rows * sizeof(float));
+  float *y = malloc(num_rows * sizeof(float));
+  size_t nnz = band_matrix(num_rows, row_offsets, cols, values, x);
+
+  cl_mem offsets_buffer = create_buffer(CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, (num_rows + 1) * sizeof(cl_int), row_offsets);
+  cl_mem cols_buffer = create_buffer(CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, nnz * sizeof(cl_int), cols);
+  cl_mem values_buffer = create_buffer(CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, nnz * sizeof(float), values);
+  cl_mem x_buffer = create_buffer(CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, num_rows * sizeof(float), x);
+  cl_mem y_buffer = create_buffer(CL_MEM_WRITE_ONLY, num_rows * sizeof(float), NULL);
+  cl_int rows_arg = num_rows;
+  cl_int err = clSetKernelArg(s.kernel, 0, sizeof(cl_mem), &offsets_buffer);
+  err |= clSetKernelArg(s.kernel, 1, sizeof(cl_mem), &cols_buffer);
+  err |= clSetKernelArg(s.kernel, 2, sizeof(cl_mem), &values_buffer);
+  err |= clSetKernelArg(s.kernel, 3, sizeof(cl_mem), &x_buffer);
+  err |= clSetKernelArg(s.kernel, 4, sizeof(cl_mem), &y_buffer);
+  err |= clSetKernelArg(s.kernel, 5, sizeof(rows_arg), &rows_arg);
+  check_error(err, "Couldn't set a kernel argument.");
+
+  kernel_iteration(&s);
+  err = clEnqueueReadBuffer(env.queue, y_buffer, CL_BLOCKING, 0, num_rows * sizeof(float), y, 0, NULL, NULL);
+  check_error(err, "Couldn't read the buffer.");
+  float *expected = malloc(num_rows * sizeof(float));
+  ref_spmv(num_rows, row_offsets, cols, values, x, expected);
+  r->valid = ref_compare(y, expected, num_rows, 1e-5, 1e-5).mismatches == 0;
+  free(expected);
+
+  r->stats = bench_measure(kernel_iteration, &s, env.warmup, env.iterations);
+  r->bytes = nnz * (sizeof(float) + sizeof(cl_int) + sizeof(float)) + num_rows * (sizeof(cl_int) + sizeof(float));
+  r->flops = 2.0 * nnz;
+
+  free(row_offsets);
+  free(cols);
+  free(values);
+  free(x);
+  free(y);
+  release_buffer(offsets_buffer);
+  release_buffer(cols_buffer);
+  release_buffer(values_buffer);
+  release_buffer(x_buffer);
+  release_buffer(y_buffer);
+  clReleaseKernel(s.kernel);
+  return 1;
+}
+
+/* Image read/write: Ch06/simple_image */
+
+static int bench_image(size_t width, bench_result *r) {
+  cl_bool image_support;
+  size_t max_width, max_height;
+  cl_int err = clGetDeviceInfo(env.device, CL_DEVICE_IMAGE_SUPPORT, sizeof(image_support), &image_support, NULL);
+  err |= clGetDeviceInfo(env.device, CL_DEVICE_IMAGE2D_MAX_WIDTH, sizeof(max_width), &max_width, NULL);
+  err |= clGetDeviceInfo(env.device, CL_DEVICE_IMAGE2D_MAX_HEIGHT, sizeof(max_height), &max_height, NULL);
+  check_error(err, "Couldn't obtain device information.");
+  if (!image_support || width > max_width || width > max_height) {
+    return 0;
+  }
+
+  kernel_state s = {create_kernel("simple_image.cl", "simple_image"), 2, {width, width}};
+  size_t pixels = width * width;
+  cl_ushort *input = malloc(pixels * sizeof(cl_ushort));
+  cl_ushort *output = malloc(pixels * sizeof(cl_ushort));
+  for (size_t i = 0; i < pixels; i++) {
+    input[i] = rand();
+  }
+
+  // the kernel uses read_imageui, so the channel has to be an unsigned integer type
+  cl_image_format format = {CL_R, CL_UNSIGNED_INT16};
+  cl_image_desc desc = {CL_MEM_OBJECT_IMAGE2D, width, width};
+  cl_mem input_image = clCreateImage(env.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &format, &desc, input, &err);
+  check_error(err, "Couldn't create input image object.");
+  cl_mem output_image = clCreateImage(env.context, CL_MEM_WRITE_ONLY, &format, &desc, NULL, &err);
+  check_error(err, "Couldn't create output image object.");
+  err = clSetKernelArg(s.kernel, 0, sizeof(cl_mem), &input_image);
+  err |= clSetKernelArg(s.kernel, 1, sizeof(cl_mem), &output_image);
+  check_error(err, "Couldn't set a kernel argument.");
+
+  kernel_iteration(&s);
+  size_t origin[3] = {0, 0, 0}, region[3] = {width, width, 1};
+  err = clEnqueueReadImage(env.queue, output_image, CL_BLOCKING, origin, region, 0, 0, output, 0, NULL, NULL);
+  check_error(err, "Couldn't read from the image object.");
+  // write_imageui saturates, so underflowing pixels end up at the maximum
+  r->valid = 1;
+  for (size_t y = 0; y < width; y++) {
+    for (size_t x = 0; x < width; x++) {
+      cl_uint value = input[y * width + x] - (cl_uint)(y * 0x4000 + x * 0x1000);
+      r->valid &= output[y * width + x] == (value > 0xffff ? 0xffff : value);
+    }
+  }
+
+  r->stats = bench_measure(kernel_iteration, &s, env.warmup, env.iterations);
+  r->bytes = 2.0 * pixels * sizeof(cl_ushort);
+
+  free(input);
+  free(output);
+  clReleaseMemObject(input_image);
+  clReleaseMemObject(output_image);
+  clReleaseKernel(s.kernel);
+  return 1;
+}
+
+/* Host transfers: copies vs. mapping a CL_MEM_USE_HOST_PTR buffer */
+
+typedef enum { TRANSFER_COPY, TRANSFER_MAP_UNALIGNED, TRANSFER_ZERO_COPY } transfer_mode;
+
+typedef struct {
+  cl_mem buffer;
+  float *host;
+  size_t size;
+} transfer_state;
+
+static double copy_iteration(void *arg) {
+  transfer_state *s = arg;
+  cl_event first, last;
+  cl_int err = clEnqueueWriteBuffer(env.queue, s->buffer, CL_FALSE, 0, s->size, s->host, 0, NULL, &first);
+  err |= clEnqueueReadBuffer(env.queue, s->buffer, CL_FALSE, 0, s->size, s->host, 0, NULL, &last);
+  check_error(err, "Couldn't copy the buffer.");
+  return bench_event_ms(first, last);
+}
+
+// the same round trip through a mapping, a zero-copy device moves nothing
+static double map_iteration(void *arg) {
+  transfer_state *s = arg;
+  cl_event first, last;
+  cl_int err;
+  float *mapped = clEnqueueMapBuffer(env.queue, s->buffer, CL_BLOCKING, CL_MAP_READ | CL_MAP_WRITE, 0, s->size, 0, NULL, &first, &err);
+  check_error(err, "Couldn't map the buffer.");
+  mapped[0] += 1.0f;
+  err = clEnqueueUnmapMemObject(env.queue, s->buffer, mapped, 0, NULL, &last);
+  check_error(err, "Couldn't unmap the buffer.");
+  return bench_event_ms(first, last);
+}
+
+static int run_transfer(size_t size, bench_result *r, transfer_mode mode) {
+  // one spare cache line, so the unaligned variant can start one float in
+  float *storage = host_alloc(env.context, size + 64);
+  transfer_state s = {NULL, mode == TRANSFER_MAP_UNALIGNED ? storage + 1 : storage, size};
+  size_t num_floats = size / sizeof(float);
+  for (size_t i = 0; i < num_floats; i++) {
+    s.host[i] = (float)i;
+  }
+
+  cl_int err;
+  if (mode == TRANSFER_COPY) {
+    s.buffer = create_buffer(CL_MEM_READ_WRITE, size, NULL);
+  } else if (mode == TRANSFER_ZERO_COPY) {
+    s.buffer = zero_copy_buffer(env.context, CL_MEM_READ_WRITE, size, s.host, &err);
+    check_error(err, "Couldn't create a buffer.");
+  } else {
+    s.buffer = clCreateBuffer(env.context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, size, s.host, &err);
+    check_error(err, "Couldn't create a buffer.");
+  }
+  bench_fn iteration = mode == TRANSFER_COPY ? copy_iteration : map_iteration;
+
+  // the data has to survive the round trip, only the first float is touched
+  iteration(&s);
+  r->valid = 1;
+  for (size_t i = 1; i < num_floats; i++) {
+    r->valid &= s.host[i] == (float)i;
+  }
+  static int reported[3];
+  if (mode != TRANSFER_COPY && !reported[mode]++) {
+    fprintf(stderr, "%s: the runtime %s the host memory\n", r->name,
+            zero_copy_is_direct(env.queue, s.buffer, s.host, size) ? "maps" : "copies");
+  }
+
+  r->stats = bench_measure(iteration, &s, env.warmup, env.iterations);
+  r->bytes = 2.0 * size;
+
+  if (mode == TRANSFER_COPY) {
+    release_buffer(s.buffer);
+  } else {
+    clReleaseMemObject(s.buffer);
+  }
+  host_free(storage);
+  return 1;
+}
+
+static int bench_copy(size_t size, bench_result *r) { return run_transfer(size, r, TRANSFER_COPY); }
+static int bench_map_unaligned(size_t size, bench_result *r) { return run_transfer(size, r, TRANSFER_MAP_UNALIGNED); }
+static int bench_zero_copy(size_t size, bench_result *r) { return run_transfer(size, r, TRANSFER_ZERO_COPY); }
+
+/* Streamed reduction: Ch10/reduction_complete over chunks that overlap upload, compute and download */
+
+typedef struct {
+  cl_kernel vector_kernel, complete_kernel;
+  size_t local_size;
+  stream_config config;
+  float *data, *partial_sums;
+  size_t num_floats;
+  double sum;
+} stream_state;
+
+static cl_int stream_reduce_chunk(void *arg, cl_command_queue queue, const stream_chunk *chunk, cl_event uploaded, cl_event *computed) {
+  stream_state *s = arg;
+  size_t global_size = chunk->size / sizeof(float) / 4, local_size = s->local_size;
+  cl_int err = clSetKernelArg(s->vector_kernel, 0, sizeof(cl_mem), &chunk->input);
+  err |= clSetKernelArg(s->complete_kernel, 0, sizeof(cl_mem), &chunk->input);
+  err |= clSetKernelArg(s->complete_kernel, 2, sizeof(cl_mem), &chunk->output);
+  err |= clEnqueueNDRangeKernel(queue, s->vector_kernel, 1, NULL, &global_size, &local_size, 1, &uploaded, NULL);
+  while (global_size / local_size > local_size) {
+    global_size /= local_size;
+    err |= clEnqueueNDRangeKernel(queue, s->vector_kernel, 1, NULL, &global_size, &local_size, 0, NULL, NULL);
+  }
+  global_size /= local_size;
+  err |= clEnqueueNDRangeKernel(queue, s->complete_kernel, 1, NULL, &global_size, &global_size, 0, NULL, computed);
+  return err;
+}
+
+static void stream_chunk_done(void *arg, const stream_chunk *chunk, const void *output) {
+  (void)chunk;
+  stream_state *s = arg;
+  s->sum += *(const float *)output;
+}
+
+// the stages overlap on the host's timeline, so this measures wall time rather than device time
+static double stream_iteration(void *arg) {
+  stream_state *s = arg;
+  s->sum = 0.0;
+  double start = timer_ms();
+  cl_int err = stream_run(env.context, env.device, &s->config, s->data, s->num_floats * sizeof(float), s->partial_sums, stream_reduce_chunk,
+                          stream_chunk_done, s);
+  check_error(err, "Couldn't stream the reduction.");
+  return timer_ms() - start;
+}
+
+static int run_stream(size_t num_floats, bench_result *r, unsigned depth) {
+  size_t chunk_floats = num_floats < STREAM_CHUNK_FLOATS ? num_floats : STREAM_CHUNK_FLOATS;
+  stream_state s = {create_kernel("reduction_complete.cl", "reduction_vector"), create_kernel("reduction_complete.cl", "reduction_complete")};
+  s.local_size = kernel_local_size(s.vector_kernel);
+  if (s.local_size > chunk_floats / 4) {
+    s.local_size = chunk_floats / 4;
+  }
+  s.config = (stream_config){chunk_floats * sizeof(float), sizeof(float), depth};
+  s.num_floats = num_floats;
+
+  // every chunk sums to its length exactly, and so does the total in double
+  s.data = malloc(num_floats * sizeof(float));
+  s.partial_sums = malloc(num_floats / chunk_floats * sizeof(float));
+  for (size_t i = 0; i < num_floats; i++) {
+    s.data[i] = 1.0f;
+  }
+  cl_int err = clSetKernelArg(s.vector_kernel, 1, s.local_size * 4 * sizeof(float), NULL);
+  err |= clSetKernelArg(s.complete_kernel, 1, s.local_size * 4 * sizeof(float), NULL);
+  check_error(err, "Couldn't set a kernel argument.");
+
+  stream_iteration(&s);
+  r->valid = s.sum == (double)num_floats;
+
+  r->stats = bench_measure(stream_iteration, &s, env.warmup, env.iterations);
+  r->bytes = num_floats * sizeof(float);
+  r->flops = num_floats;
+
+  free(s.data);
+  free(s.partial_sums);
+  clReleaseKernel(s.vector_kernel);
+  clReleaseKernel(s.complete_kernel);
+  return 1;
+}
+
+static int bench_stream(size_t num_floats, bench_result *r) { return run_stream(num_floats, r, STREAM_DEPTH); }
+static int bench_stream_serial(size_t num_floats, bench_result *r) { return run_stream(num_floats, r, 1); }
+
+/* Partitioned runs: reduction, string search and bitonic init blocks split over the device group (OCL_PARTITION) */
+
+static device_group *get_group(void) {
+  if (!env.group) {
+    env.group = device_group_create(env.device, NULL);
+    device_group_report(env.group, stderr);
+  }
+  return env.group;
+}
+
+// one kernel per member, every member needs its own program
+static cl_kernel *group_kernels(const char *filename, const char *name, size_t *local_size) {
+  device_group *g = get_group();
+  cl_kernel *kernels = malloc(g->num_members * sizeof(cl_kernel));
+  // the members compile concurrently, each one's kernel is created as its build completes
+  program_future **builds = malloc(g->num_members * sizeof(program_future *));
+  for (unsigned i = 0; i < g->num_members; i++) {
+    builds[i] = build_program_async(g->context, g->members[i].device, filename, NULL);
+  }
+  *local_size = 0;
+  for (unsigned i = 0; i < g->num_members; i++) {
+    kernels[i] = program_future_kernel(builds[i], name);
+    clReleaseProgram(program_future_get(builds[i]));
+
+    // the members share one local size, the smallest they all support
+    size_t member_size;
+    cl_int err = clGetKernelWorkGroupInfo(kernels[i], g->members[i].device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(member_size), &member_size, NULL);
+    check_error(err, "Couldn't find the maximum work-group size.");
+    if (!*local_size || pow2_floor(member_size) < *local_size) {
+      *local_size = pow2_floor(member_size);
+    }
+  }
+  free(builds);
+  return kernels;
+}
+
+// for benchmarks that give up before split_create() takes the kernels over
+static void release_group_kernels(cl_kernel *kernels) {
+  for (unsigned i = 0; i < env.group->num_members; i++) {
+    clReleaseKernel(kernels[i]);
+  }
+  free(kernels);
+}
+
+typedef struct {
+  cl_kernel *kernels;
+  cl_mem *parts, *results; // per member, results is NULL unless the kernel accumulates into it
+  size_t *offsets, *counts, *global_sizes, local_size;
+} split_state;
+
+// the members run side by side, so this measures wall time from the first enqueue to the last completion
+static double split_iteration(void *arg) {
+  split_state *s = arg;
+  device_group *g = env.group;
+  double start = timer_ms();
+  for (unsigned i = 0; i < g->num_members; i++) {
+    if (!s->global_sizes[i]) {
+      continue;
+    }
+    cl_int err = CL_SUCCESS;
+    if (s->results) {
+      cl_int zero[4] = {0};
+      err = clEnqueueWriteBuffer(g->members[i].queue, s->results[i], CL_FALSE, 0, sizeof(zero), zero, 0, NULL, NULL);
+    }
+    err |= clEnqueueNDRangeKernel(g->members[i].queue, s->kernels[i], 1, NULL, &s->global_sizes[i], &s->local_size, 0, NULL, NULL);
+    check_error(err, "Couldn't enqueue a partitioned kernel.");
+    clFlush(g->members[i].queue);
+  }
+  for (unsigned i = 0; i < g->num_members; i++) {
+    clFinish(g->members[i].queue);
+  }
+  return timer_ms() - start;
+}
+
+// splits items of item_size bytes by weight, every share starts on a sub-buffer boundary and covers whole granules
+static split_state split_create(cl_kernel *kernels, size_t local_size, cl_mem buffer, size_t total, size_t item_size, size_t granularity,
+                                size_t overlap) {
+  device_group *g = env.group;
+  size_t alignment = device_base_alignment(g->context) / item_size;
+  if (granularity < alignment) {
+    granularity = alignment;
+  }
+  split_state s = {kernels, calloc(g->num_members, sizeof(cl_mem)), NULL, malloc(g->num_members * sizeof(size_t)),
+                   malloc(g->num_members * sizeof(size_t)), calloc(g->num_members, sizeof(size_t)), local_size};
+  device_group_split(g, total, granularity, s.offsets, s.counts);
+  for (unsigned i = 0; i < g->num_members; i++) {
+    if (!s.counts[i]) {
+      continue;
+    }
+    // overlap lets a read-only share see the items just past its end
+    cl_buffer_region region = {s.offsets[i] * item_size, (s.counts[i] + overlap) * item_size};
+    cl_int err;
+    s.parts[i] = clCreateSubBuffer(buffer, 0, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+    check_error(err, "Couldn't create a sub-buffer.");
+    err = clSetKernelArg(kernels[i], 0, sizeof(cl_mem), &s.parts[i]);
+    check_error(err, "Couldn't set a kernel argument.");
+  }
+  return s;
+}
+
+static void split_release(split_state *s) {
+  for (unsigned i = 0; i < env.group->num_members; i++) {
+    if (s->parts[i]) {
+      clReleaseMemObject(s->parts[i]);
+    }
+    if (s->results) {
+      clReleaseMemObject(s->results[i]);
+    }
+    clReleaseKernel(s->kernels[i]);
+  }
+  free(s->kernels);
+  free(s->parts);
+  free(s->results);
+  free(s->offsets);
+  free(s->counts);
+  free(s->global_sizes);
+}
+
+// every member reduces its share to one float4 per work-group, the host adds them up
+static int bench_reduction_split(size_t num_floats, bench_result *r) {
+  size_t local_size;
+  cl_kernel *kernels = group_kernels("reduction_complete.cl", "reduction_vector", &local_size);
+  if (local_size > num_floats / 4) {
+    local_size = num_floats / 4;
+  }
+  float *data = malloc(num_floats * sizeof(float));
+  for (size_t i = 0; i < num_floats; i++) {
+    data[i] = 1.0f;
+  }
+  cl_int err;
+  cl_mem buffer = clCreateBuffer(env.group->context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, num_floats * sizeof(float), data, &err);
+  check_error(err, "Couldn't create a buffer.");
+
+  split_state s = split_create(kernels, local_size, buffer, num_floats, sizeof(float), 4 * local_size, 0);
+  for (unsigned i = 0; i < env.group->num_members; i++) {
+    s.global_sizes[i] = s.counts[i] / 4;
+    err = clSetKernelArg(kernels[i], 1, local_size * 4 * sizeof(float), NULL);
+    check_error(err, "Couldn't set a kernel argument.");
+  }
+
+  // the kernel works in place, only the first run sees the original data
+  split_iteration(&s);
+  double sum = 0.0;
+  for (unsigned i = 0; i < env.group->num_members; i++) {
+    size_t num_groups = s.global_sizes[i] / local_size;
+    err = clEnqueueReadBuffer(env.group->members[i].queue, buffer, CL_BLOCKING, s.offsets[i] * sizeof(float), num_groups * 4 * sizeof(float), data,
+                              0, NULL, NULL);
+    check_error(err, "Couldn't read the buffer.");
+    for (size_t j = 0; j < num_groups * 4; j++) {
+      sum += data[j];
+    }
+  }
+  r->valid = sum == (double)num_floats;
+
+  r->stats = bench_measure(split_iteration, &s, env.warmup, env.iterations);
+  r->bytes = num_floats * sizeof(float);
+  r->flops = num_floats;
+
+  split_release(&s);
+  clReleaseMemObject(buffer);
+  free(data);
+  return 1;
+}
+
+// every member searches its share of the text into its own counters, the host adds them up
+static int bench_string_search_split(size_t text_size, bench_result *r) {
+  size_t local_size;
+  cl_kernel *kernels = group_kernels("string_search.cl", "string_search", &local_size);
+  cl_int chars_per_item = SPLIT_CHARS_PER_ITEM;
+  if (text_size < chars_per_item * local_size) {
+    release_group_kernels(kernels);
+    return 0;
+  }
+
+  // work-items read 15 characters past their range, so the text and every share carry 16 more
+  char *text = malloc(text_size + 16);
+  for (size_t i = 0; i < text_size + 16; i++) {
+    text[i] = SEARCH_PATTERN[rand() % 16];
+  }
+  cl_int expected[4] = {0};
+  for (size_t i = 0; i < text_size; i++) {
+    for (int w = 0; w < 4; w++) {
+      expected[w] += !memcmp(text + i + 4 * w, SEARCH_PATTERN + 4 * w, 4);
+    }
+  }
+  cl_int err;
+  cl_mem buffer = clCreateBuffer(env.group->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, text_size + 16, text, &err);
+  check_error(err, "Couldn't create a buffer.");
+
+  split_state s = split_create(kernels, local_size, buffer, text_size, 1, chars_per_item * local_size, 16);
+  s.results = calloc(env.group->num_members, sizeof(cl_mem));
+  cl_char16 pattern;
+  memcpy(pattern.s, SEARCH_PATTERN, 16);
+  for (unsigned i = 0; i < env.group->num_members; i++) {
+    s.global_sizes[i] = s.counts[i] / chars_per_item;
+    s.results[i] = clCreateBuffer(env.group->context, CL_MEM_READ_WRITE, 4 * sizeof(cl_int), NULL, &err);
+    check_error(err, "Couldn't create a buffer.");
+    // the text is argument 1, split_create() set argument 0
+    err = clSetKernelArg(kernels[i], 0, sizeof(pattern), &pattern);
+    err |= clSetKernelArg(kernels[i], 1, sizeof(cl_mem), &s.parts[i]);
+    err |= clSetKernelArg(kernels[i], 2, sizeof(chars_per_item), &chars_per_item);
+    err |= clSetKernelArg(kernels[i], 3, 4 * sizeof(cl_int), NULL);
+    err |= clSetKernelArg(kernels[i], 4, sizeof(cl_mem), &s.results[i]);
+    check_error(err, "Couldn't set a kernel argument.");
+  }
+
+  split_iteration(&s);
+  cl_int found[4] = {0};
+  for (unsigned i = 0; i < env.group->num_members; i++) {
+    cl_int part[4];
+    err = clEnqueueReadBuffer(env.group->members[i].queue, s.results[i], CL_BLOCKING, 0, sizeof(part), part, 0, NULL, NULL);
+    check_error(err, "Couldn't read the buffer.");
+    for (int w = 0; w < 4 && s.counts[i]; w++) {
+      found[w] += part[w];
+    }
+  }
+  r->valid = !memcmp(found, expected, sizeof(found));
+
+  r->stats = bench_measure(split_iteration, &s, env.warmup, env.iterations);
+  r->bytes = text_size;
+
+  split_release(&s);
+  clReleaseMemObject(buffer);
+  free(text);
+  return 1;
+}
+
+// every member sorts its blocks of 8 x local size floats, whole pairs of blocks keep the alternating directions intact
+static int bench_sort_init_split(size_t num_floats, bench_result *r) {
+  size_t local_size;
+  cl_kernel *kernels = group_kernels("bsort.cl", "bsort_init", &local_size);
+  if (local_size > num_floats / 16) {
+    local_size = num_floats / 16;
+  }
+  size_t block = 8 * local_size;
+  float *data = malloc(num_floats * sizeof(float));
+  for (size_t i = 0; i < num_floats; i++) {
+    data[i] = rand();
+  }
+  cl_int err;
+  cl_mem buffer = clCreateBuffer(env.group->context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, num_floats * sizeof(float), data, &err);
+  check_error(err, "Couldn't create a buffer.");
+
+  split_state s = split_create(kernels, local_size, buffer, num_floats, sizeof(float), 2 * block, 0);
+  for (unsigned i = 0; i < env.group->num_members; i++) {
+    s.global_sizes[i] = s.counts[i] / 8;
+    err = clSetKernelArg(kernels[i], 1, block * sizeof(float), NULL);
+    check_error(err, "Couldn't set a kernel argument.");
+  }
+
+  // even blocks end up ascending, odd blocks descending
+  split_iteration(&s);
+  err = clEnqueueReadBuffer(env.group->members[0].queue, buffer, CL_BLOCKING, 0, num_floats * sizeof(float), data, 0, NULL, NULL);
+  check_error(err, "Couldn't read the buffer.");
+  r->valid = 1;
+  for (size_t i = 1; i < num_floats && r->valid; i++) {
+    if (i % block) {
+      r->valid = (i / block) % 2 ? data[i - 1] >= data[i] : data[i - 1] <= data[i];
+    }
+  }
+
+  r->stats = bench_measure(split_iteration, &s, env.warmup, env.iterations);
+  r->bytes = 2.0 * num_floats * sizeof(float);
+
+  split_release(&s);
+  clReleaseMemObject(buffer);
+  free(data);
+  return 1;
+}
+
+/* CPU baselines: the reference implementations the device results are checked against, timed on the host */
+
+typedef enum { CPU_GEMM, CPU_FFT, CPU_REDUCTION, CPU_SORT, CPU_SPMV } cpu_kernel;
+
+typedef struct {
+  cpu_kernel kernel;
+  size_t size;
+  float *a, *b, *c;
+  double *in, *out;
+  cl_int *row_offsets, *cols;
+  double sum;
+} cpu_state;
+
+static double cpu_iteration(void *arg) {
+  cpu_state *s = arg;
+  double start = timer_ms();
+  switch (s->kernel) {
+  case CPU_GEMM:
+    ref_gemm(s->size, s->size, s->size, s->a, s->b, s->c);
+    break;
+  case CPU_FFT:
+    ref_fft(s->size, s->in, s->out, 1);
+    break;
+  case CPU_REDUCTION:
+    s->sum = ref_sum(s->a, s->size);
+    break;
+  case CPU_SORT:
+    // the sort works in place, so every iteration starts from a copy of the input
+    memcpy(s->c, s->a, s->size * sizeof(float));
+    ref_sort(s->c, s->size);
+    break;
+  case CPU_SPMV:
+    ref_spmv(s->size, s->row_offsets, s->cols, s->b, s->a, s->c);
+    break;
+  }
+  return timer_ms() - start;
+}
+
+static int run_cpu(size_t size, bench_result *r, cpu_kernel kernel) {
+  cpu_state s = {kernel, size};
+  size_t elements = kernel == CPU_GEMM ? size * size : size;
+  s.a = malloc(elements * sizeof(float));
+  s.b = malloc((kernel == CPU_SPMV ? size * SPMV_BAND : elements) * sizeof(float));
+  s.c = malloc(elements * sizeof(float));
+  for (size_t i = 0; i < elements; i++) {
+    s.a[i] = kernel == CPU_REDUCTION ? 1.0f : random_float();
+    s.b[i] = random_float();
+  }
+  size_t nnz = 0;
+  if (kernel == CPU_FFT) {
+    s.in = malloc(2 * size * sizeof(double));
+    s.out = malloc(2 * size * sizeof(double));
+    for (size_t i = 0; i < 2 * size; i++) {
+      s.in[i] = random_float();
+    }
+  } else if (kernel == CPU_SPMV) {
+    s.row_offsets = malloc((size + 1) * sizeof(cl_int));
+    s.cols = malloc(size * SPMV_BAND * sizeof(cl_int));
+    nnz = band_matrix(size, s.row_offsets, s.cols, s.b, s.a);
+  }
+
+  cpu_iteration(&s);
+  r->valid = 1;
+  if (kernel == CPU_REDUCTION) {
+    r->valid = s.sum == (double)size;
+  } else if (kernel == CPU_SORT) {
+    for (size_t i = 1; i < size && r->valid; i++) {
+      r->valid = s.c[i - 1] <= s.c[i];
+    }
+  }
+
+  r->stats = bench_measure(cpu_iteration, &s, env.warmup, env.iterations);
+  switch (kernel) {
+  case CPU_GEMM:
+    r->bytes = 3.0 * elements * sizeof(float);
+    r->flops = 2.0 * size * size * size;
+    break;
+  case CPU_FFT:
+    r->bytes = 2.0 * size * 2 * sizeof(double);
+    r->flops = 5.0 * size * log2((double)size);
+    break;
+  case CPU_REDUCTION:
+    r->bytes = size * sizeof(float);
+    r->flops = size;
+    break;
+  case CPU_SORT:
+    r->bytes = 2.0 * size * sizeof(float);
+    break;
+  case CPU_SPMV:
+    r->bytes = nnz * (sizeof(float) + sizeof(cl_int) + sizeof(float)) + size * (sizeof(cl_int) + sizeof(float));
+    r->flops = 2.0 * nnz;
+    break;
+  }
+
+  free(s.a);
+  free(s.b);
+  free(s.c);
+  free(s.in);
+  free(s.out);
+  free(s.row_offsets);
+  free(s.cols);
+  return 1;
+}
+
+static int bench_cpu_gemm(size_t dim, bench_result *r) { return run_cpu(dim, r, CPU_GEMM); }
+static int bench_cpu_fft(size_t num_points, bench_result *r) { return run_cpu(num_points, r, CPU_FFT); }
+static int bench_cpu_reduction(size_t num_floats, bench_result *r) { return run_cpu(num_floats, r, CPU_REDUCTION); }
+static int bench_cpu_sort(size_t num_floats, bench_result *r) { return run_cpu(num_floats, r, CPU_SORT); }
+static int bench_cpu_spmv(size_t num_rows, bench_result *r) { return run_cpu(num_rows, r, CPU_SPMV); }
+
+/* Driver */
+
+// clang-format off
+static benchmark benchmarks[] = {
+  {"reduction",         "floats",     16, 24, 2, {"reduction_complete.cl"},            bench_reduction},
+  {"reduction_graph",   "floats",     16, 24, 2, {"reduction_complete.cl"},            bench_reduction_graph},
+  {"reduction_wide",    "floats",     16, 24, 2, {NULL},                               bench_reduction_wide},
+  {"reduce_tree",       "floats",     16, 24, 2, {NULL},                               bench_reduce_tree},
+  {"reduce_sub_group",  "floats",     16, 24, 2, {NULL},                               bench_reduce_sub_group},
+  {"reduce_work_group", "floats",     16, 24, 2, {NULL},                               bench_reduce_work_group},
+  {"reduce_kahan",      "floats",     16, 24, 2, {NULL},                               bench_reduce_kahan},
+  {"sort",              "floats",     12, 22, 2, {"bsort.cl"},                         bench_sort},
+  {"sort_graph",        "floats",     12, 22, 2, {"bsort.cl"},                         bench_sort_graph},
+  {"string_search",     "bytes",      16, 26, 2, {"string_search.cl"},                 bench_string_search},
+  {"gemm",              "matrix dim",  7, 11, 1, {"matrix_mult.cl"},                   bench_gemm},
+  {"gemm_spec",         "matrix dim",  7, 11, 1, {NULL},                               bench_gemm_spec},
+  {"transpose",         "matrix dim",  8, 12, 1, {"transpose.cl"},                     bench_transpose},
+  {"dag",               "matrix dim",  7, 11, 1, {"transpose.cl", "matrix_mult.cl"},   bench_dag},
+  {"dag_serial",        "matrix dim",  7, 11, 1, {"transpose.cl", "matrix_mult.cl"},   bench_dag_serial},
+  {"fft",               "points",     10, 20, 2, {"fft.cl"},                           bench_fft},
+  {"fft_spec",          "points",     10, 20, 2, {"fft.cl"},                           bench_fft_spec},
+  {"fft_graph",         "points",     10, 20, 2, {"fft.cl"},                           bench_fft_graph},
+  {"spmv",              "rows",       12, 20, 2, {"spmv.cl"},                          bench_spmv},
+  {"image",             "width",       8, 13, 1, {"simple_image.cl"},                  bench_image},
+  {"copy",              "bytes",      16, 26, 2, {NULL},                               bench_copy},
+  {"map_unaligned",     "bytes",      16, 26, 2, {NULL},                               bench_map_unaligned},
+  {"zero_copy",         "bytes",      16, 26, 2, {NULL},                               bench_zero_copy},
+  {"stream",            "floats",     20, 26, 2, {"reduction_complete.cl"},            bench_stream},
+  {"stream_serial",     "floats",     20, 26, 2, {"reduction_complete.cl"},            bench_stream_serial},
+  {"reduction_split",   "floats",     16, 24, 2, {NULL},                               bench_reduction_split},
+  {"search_split",      "bytes",      16, 26, 2, {NULL},                               bench_string_search_split},
+  {"sort_init_split",   "floats",     12, 22, 2, {NULL},                               bench_sort_init_split},
+  {"cpu_gemm",          "matrix dim",  7, 11, 1, {NULL},                               bench_cpu_gemm},
+  {"cpu_fft",           "points",     10, 20, 2, {NULL},                               bench_cpu_fft},
+  {"cpu_reduction",     "floats",     16, 24, 2, {NULL},                               bench_cpu_reduction},
+  {"cpu_sort",          "floats",     12, 22, 2, {NULL},                               bench_cpu_sort},
+  {"cpu_spmv",          "rows",       12, 20, 2, {NULL},                               bench_cpu_spmv},
+};
+// clang-format on
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static void usage(const char *program) {
+  fprintf(stderr, "Usage: %s [--warmup N] [--iterations N] [--only NAME[,NAME...]] [--sweep NAME=MIN:MAX[:STEP]] [--json FILE]\n", program);
+  fprintf(stderr, "Sizes are powers of two, e.g. --sweep reduction=20:26 runs 2^20 to 2^26 floats. Benchmarks:\n");
+  for (size_t i = 0; i < NUM_BENCHMARKS; i++) {
+    const benchmark *b = &benchmarks[i];
+    fprintf(stderr, "  %-17s %-10s 2^%u..2^%u step %u\n", b->name, b->unit, b->min_log2, b->max_log2, b->step_log2);
+  }
+  exit(EXIT_FAILURE);
+}
+
+static benchmark *find_benchmark(const char *name, size_t length) {
+  for (size_t i = 0; i < NUM_BENCHMARKS; i++) {
+    if (strlen(benchmarks[i].name) == length && !strncmp(benchmarks[i].name, name, length)) {
+      return &benchmarks[i];
+    }
+  }
+  return NULL;
+}
+
+static int selected(const benchmark *b, const char *only) {
+  if (!only) {
+    return 1;
+  }
+  size_t length = strlen(b->name);
+  for (const char *p = only; *p;) {
+    const char *end = strchr(p, ',');
+    size_t n = end ? (size_t)(end - p) : strlen(p);
+    if (n == length && !strncmp(p, b->name, n)) {
+      return 1;
+    }
+    p += end ? n + 1 : n;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  env.warmup = DEFAULT_WARMUP;
+  env.iterations = DEFAULT_ITERATIONS;
+  const char *only = NULL, *json_path = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+    }
+    const char *value = argv[++i];
+    if (!strcmp(argv[i - 1], "--warmup")) {
+      env.warmup = atoi(value);
+    } else if (!strcmp(argv[i - 1], "--iterations")) {
+      env.iterations = atoi(value);
+    } else if (!strcmp(argv[i - 1], "--only")) {
+      only = value;
+    } else if (!strcmp(argv[i - 1], "--json")) {
+      json_path = value;
+    } else if (!strcmp(argv[i - 1], "--sweep")) {
+      const char *equals = strchr(value, '=');
+      benchmark *b = equals ? find_benchmark(value, equals - value) : NULL;
+      unsigned min_log2, max_log2, step_log2 = 1;
+      if (!b || sscanf(equals + 1, "%u:%u:%u", &min_log2, &max_log2, &step_log2) < 2 || min_log2 > max_log2 || !step_log2) {
+        usage(argv[0]);
+      }
+      b->min_log2 = min_log2;
+      b->max_log2 = max_log2;
+      b->step_log2 = step_log2;
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  cl_int err;
+  env.device = create_device();
+  env.context = clCreateContext(NULL, 1, &env.device, NULL, NULL, &err);
+  check_error(err, "Couldn't create a context.");
+  cl_queue_properties properties[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+  env.queue = clCreateCommandQueueWithProperties(env.context, env.device, properties, &err);
+  check_error(err, "Couldn't create a command queue.");
+  env.pool = buffer_pool_create(env.context);
+
+  FILE *json = NULL;
+  if (json_path) {
+    json = strcmp(json_path, "-") ? fopen(json_path, "w") : stdout;
+    if (!json) {
+      perror("Couldn't open the JSON file");
+      exit(EXIT_FAILURE);
+    }
+    bench_json_begin(json, env.device, env.warmup, env.iterations);
+  }
+  // with JSON on stdout the table goes to stderr
+  FILE *table = json == stdout ? stderr : stdout;
+  bench_print_header(table);
+
+  // every program the selected benchmarks need compiles while the first ones run
+  for (size_t i = 0; i < NUM_BENCHMARKS; i++) {
+    const benchmark *b = &benchmarks[i];
+    if (!selected(b, only)) {
+      continue;
+    }
+    for (size_t j = 0; j < 2 && b->programs[j]; j++) {
+      prefetch_program(b->programs[j]);
+    }
+  }
+
+  srand(1);
+  int all_valid = 1;
+  for (size_t i = 0; i < NUM_BENCHMARKS; i++) {
+    const benchmark *b = &benchmarks[i];
+    if (!selected(b, only)) {
+      continue;
+    }
+    for (unsigned log2_size = b->min_log2; log2_size <= b->max_log2; log2_size += b->step_log2) {
+      bench_result result = {b->name, b->unit, (size_t)1 << log2_size};
+      if (!b->run(result.size, &result)) {
+        fprintf(table, "%-14s %10zu %-10s not supported on this device\n", b->name, result.size, b->unit);
+        continue;
+      }
+      bench_print_result(table, &result);
+      if (json) {
+        bench_json_result(json, &result);
+      }
+      all_valid &= result.valid;
+    }
+  }
+
+  if (json) {
+    bench_json_end(json);
+    if (json != stdout) {
+      fclose(json);
+    }
+  }
+  program_cache_report(stderr);
+  spec_report(stderr);
+  buffer_pool_report(env.pool, stderr);
+
+  buffer_pool_destroy(env.pool);
+  spec_release_all();
+  if (env.group) {
+    device_group_destroy(env.group);
+  }
+  clReleaseCommandQueue(env.queue);
+  clReleaseContext(env.context);
+  return all_valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,60 @@
+#include "device_caps.h"
+#include "error.h"
+#include <CL/cl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Capability profile of every device on every installed platform, as one JSON array on stdout or in the file given
+// with --json. Each profile is also persisted to the program cache directory the way device_caps_get() does it, so a
+// machine's devices can be compared with the profiles other machines left behind.
+
+static void usage(const char *program) {
+  fprintf(stderr, "Usage: %s [--json <file>]\n", program);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  FILE *out = stdout;
+  if (argc == 3 && !strcmp(argv[1], "--json")) {
+    out = fopen(argv[2], "w");
+    if (!out) {
+      perror("Couldn't open the JSON file");
+      exit(1);
+    }
+  } else if (argc != 1) {
+    usage(argv[0]);
+  }
+
+  cl_uint num_platforms;
+  cl_int err = clGetPlatformIDs(0, NULL, &num_platforms);
+  check_error(err || !num_platforms, "Couldn't identify a platform.");
+  cl_platform_id *platforms = malloc(num_platforms * sizeof(cl_platform_id));
+  clGetPlatformIDs(num_platforms, platforms, NULL);
+
+  unsigned count = 0;
+  fprintf(out, "[");
+  for (cl_uint p = 0; p < num_platforms; p++) {
+    cl_uint num_devices;
+    if (clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, 0, NULL, &num_devices) || !num_devices) {
+      continue;
+    }
+    cl_device_id *devices = malloc(num_devices * sizeof(cl_device_id));
+    clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, num_devices, devices, NULL);
+    for (cl_uint d = 0; d < num_devices; d++) {
+      const device_caps *caps = device_caps_get(devices[d]);
+      fprintf(out, "%s\n", count++ ? "," : "");
+      device_caps_write_json(caps, out, "  ");
+      fprintf(stderr, "%u:%u %s: %s, float%u, %llu KiB local memory\n", p, d, caps->name, caps_real_type(caps, 1),
+              caps_vector_width(caps, CAPS_FLOAT, 1), (unsigned long long)caps->local_mem / 1024);
+    }
+    free(devices);
+  }
+  fprintf(out, "\n]\n");
+
+  if (out != stdout) {
+    fclose(out);
+  }
+  free(platforms);
+  return 0;
+}
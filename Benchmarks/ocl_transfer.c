@@ -0,0 +1,376 @@
+#include "bench.h"
+#include "device.h"
+#include "error.h"
+#include "host_mem.h"
+#include "timer.h"
+#include <CL/cl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Transfer bandwidth per path, buffer kind and host memory kind over a range of sizes, on the device create_device()
+// picks; run it once per OCL_DEVICE for a curve per device. Every iteration is timed on the host from the first
+// enqueue until the data is usable on the other side, so the map paths include their memcpy and the small sizes show
+// the latency of each path.
+
+#define DEFAULT_WARMUP 2
+#define DEFAULT_ITERATIONS 10
+#define DEFAULT_MIN_LOG2 12
+#define DEFAULT_MAX_LOG2 30
+#define DEFAULT_STEP_LOG2 2
+#define MAX_SIZES 64
+// the rect paths move the left half of every row of this many bytes
+#define RECT_ROW_BYTES 4096
+
+typedef enum { PATH_WRITE, PATH_READ, PATH_MAP_WRITE, PATH_MAP_READ, PATH_COPY, PATH_RECT_WRITE, PATH_RECT_READ, NUM_PATHS } transfer_path;
+typedef enum { BUFFER_DEVICE, BUFFER_ALLOC_HOST_PTR, BUFFER_USE_HOST_PTR, BUFFER_COPY_HOST_PTR, NUM_BUFFER_KINDS } buffer_kind;
+typedef enum { HOST_PAGEABLE, HOST_PINNED, NUM_HOST_KINDS } host_kind;
+
+static const char *path_names[NUM_PATHS] = {"write", "read", "map_write", "map_read", "copy", "rect_write", "rect_read"};
+static const char *buffer_names[NUM_BUFFER_KINDS] = {"device", "alloc_host", "use_host", "copy_host"};
+static const char *host_names[NUM_HOST_KINDS] = {"pageable", "pinned"};
+static const cl_mem_flags buffer_flags[NUM_BUFFER_KINDS] = {0, CL_MEM_ALLOC_HOST_PTR, CL_MEM_USE_HOST_PTR, CL_MEM_COPY_HOST_PTR};
+
+typedef struct {
+  transfer_path path;
+  buffer_kind buffer;
+  host_kind host;
+  char name[48];
+} transfer_config;
+
+typedef struct {
+  cl_device_id device;
+  cl_context context;
+  cl_command_queue queue;
+  cl_ulong max_alloc;
+  unsigned warmup, iterations;
+} transfer_env;
+
+static transfer_env env;
+
+typedef struct {
+  transfer_path path;
+  cl_mem buffer, target; // target is the destination of a copy
+  unsigned char *host;   // source of a write, destination of a read
+  size_t size;
+} transfer_state;
+
+static int reads_to_host(transfer_path path) { return path == PATH_READ || path == PATH_MAP_READ || path == PATH_RECT_READ; }
+
+static int is_rect(transfer_path path) { return path == PATH_RECT_WRITE || path == PATH_RECT_READ; }
+
+// the memory of the other side matters to the paths that hand the runtime a host pointer
+static int uses_host_kind(transfer_path path) { return path == PATH_WRITE || path == PATH_READ || is_rect(path); }
+
+static double transfer_bytes(transfer_path path, size_t size) {
+  if (path == PATH_COPY) {
+    return 2.0 * size;
+  }
+  return is_rect(path) ? size / 2.0 : (double)size;
+}
+
+static unsigned char pattern(size_t i) { return (unsigned char)(i * 31 + 7); }
+
+static int transferred(transfer_path path, size_t i) { return !is_rect(path) || i % RECT_ROW_BYTES < RECT_ROW_BYTES / 2; }
+
+static cl_int map_copy(const transfer_state *s, cl_map_flags flags) {
+  cl_int err;
+  void *mapped = clEnqueueMapBuffer(env.queue, s->buffer, CL_BLOCKING, flags, 0, s->size, 0, NULL, NULL, &err);
+  if (err) {
+    return err;
+  }
+  if (flags == CL_MAP_READ) {
+    memcpy(s->host, mapped, s->size);
+  } else {
+    memcpy(mapped, s->host, s->size);
+  }
+  return zero_copy_unmap(env.queue, s->buffer, mapped);
+}
+
+static double transfer_iteration(void *arg) {
+  transfer_state *s = arg;
+  size_t origin[] = {0, 0, 0}, region[] = {RECT_ROW_BYTES / 2, s->size / RECT_ROW_BYTES, 1};
+  double start = timer_ms();
+  cl_int err;
+  if (s->path == PATH_WRITE) {
+    err = clEnqueueWriteBuffer(env.queue, s->buffer, CL_BLOCKING, 0, s->size, s->host, 0, NULL, NULL);
+  } else if (s->path == PATH_READ) {
+    err = clEnqueueReadBuffer(env.queue, s->buffer, CL_BLOCKING, 0, s->size, s->host, 0, NULL, NULL);
+  } else if (s->path == PATH_MAP_WRITE) {
+    err = map_copy(s, CL_MAP_WRITE_INVALIDATE_REGION);
+  } else if (s->path == PATH_MAP_READ) {
+    err = map_copy(s, CL_MAP_READ);
+  } else if (s->path == PATH_COPY) {
+    err = clEnqueueCopyBuffer(env.queue, s->buffer, s->target, 0, 0, s->size, 0, NULL, NULL);
+    err |= clFinish(env.queue);
+  } else if (s->path == PATH_RECT_WRITE) {
+    err = clEnqueueWriteBufferRect(env.queue, s->buffer, CL_BLOCKING, origin, origin, region, RECT_ROW_BYTES, 0, RECT_ROW_BYTES, 0, s->host, 0,
+                                   NULL, NULL);
+  } else {
+    err = clEnqueueReadBufferRect(env.queue, s->buffer, CL_BLOCKING, origin, origin, region, RECT_ROW_BYTES, 0, RECT_ROW_BYTES, 0, s->host, 0,
+                                  NULL, NULL);
+  }
+  check_error(err, "Couldn't transfer the buffer.");
+  return timer_ms() - start;
+}
+
+// USE_HOST_PTR buffers get memory of their own, aligned so that the runtime may use it in place
+static cl_mem create_buffer(buffer_kind kind, size_t size, const void *zeros, void **backing) {
+  void *host_ptr = NULL;
+  *backing = NULL;
+  if (kind == BUFFER_USE_HOST_PTR) {
+    host_ptr = *backing = host_alloc(env.context, size);
+    memset(host_ptr, 0, size);
+  } else if (kind == BUFFER_COPY_HOST_PTR) {
+    host_ptr = (void *)zeros;
+  }
+  cl_int err;
+  cl_mem buffer = clCreateBuffer(env.context, CL_MEM_READ_WRITE | buffer_flags[kind], size, host_ptr, &err);
+  check_error(err, "Couldn't create a buffer.");
+  return buffer;
+}
+
+// returns 0 if the device can't run the configuration at this size
+static int run_transfer(const transfer_config *c, size_t size, bench_result *r) {
+  if (size > env.max_alloc || (is_rect(c->path) && size < RECT_ROW_BYTES)) {
+    return 0;
+  }
+  transfer_state s = {c->path, NULL, NULL, NULL, size};
+  pinned_mem pinned = {NULL, NULL};
+  cl_int err;
+  if (c->host == HOST_PINNED) {
+    pinned = pinned_alloc(env.context, env.queue, size, &err);
+    if (err) {
+      return 0;
+    }
+    s.host = pinned.ptr;
+  } else {
+    s.host = malloc(size);
+    check_error(!s.host, "Couldn't allocate host memory.");
+  }
+
+  unsigned char *zeros = c->buffer == BUFFER_COPY_HOST_PTR ? calloc(size, 1) : NULL;
+  void *backing, *target_backing = NULL;
+  s.buffer = create_buffer(c->buffer, size, zeros, &backing);
+  if (c->path == PATH_COPY) {
+    s.target = create_buffer(c->buffer, size, zeros, &target_backing);
+  }
+  free(zeros);
+
+  // reads and copies start from a buffer holding the pattern, writes from host memory holding it
+  for (size_t i = 0; i < size; i++) {
+    s.host[i] = pattern(i);
+  }
+  if (reads_to_host(c->path) || c->path == PATH_COPY) {
+    err = clEnqueueWriteBuffer(env.queue, s.buffer, CL_BLOCKING, 0, size, s.host, 0, NULL, NULL);
+    check_error(err, "Couldn't initialise the buffer.");
+    memset(s.host, 0, size);
+  }
+
+  transfer_iteration(&s);
+  if (!reads_to_host(c->path)) {
+    memset(s.host, 0, size);
+    err = clEnqueueReadBuffer(env.queue, c->path == PATH_COPY ? s.target : s.buffer, CL_BLOCKING, 0, size, s.host, 0, NULL, NULL);
+    check_error(err, "Couldn't read the buffer.");
+  }
+  r->valid = 1;
+  for (size_t i = 0; i < size && r->valid; i++) {
+    r->valid = !transferred(c->path, i) || s.host[i] == pattern(i);
+  }
+
+  // the iterations return host time, so min, median and p95 are host times too
+  r->stats = bench_measure(transfer_iteration, &s, env.warmup, env.iterations);
+  r->bytes = transfer_bytes(c->path, size);
+
+  clReleaseMemObject(s.buffer);
+  if (s.target) {
+    clReleaseMemObject(s.target);
+  }
+  host_free(backing);
+  host_free(target_backing);
+  if (c->host == HOST_PINNED) {
+    pinned_free(env.queue, &pinned);
+  } else {
+    free(s.host);
+  }
+  return 1;
+}
+
+static int selected(const char *name, const char *list) {
+  if (!list) {
+    return 1;
+  }
+  size_t length = strlen(name);
+  for (const char *p = list; *p;) {
+    const char *end = strchr(p, ',');
+    size_t n = end ? (size_t)(end - p) : strlen(p);
+    if (n == length && !strncmp(p, name, n)) {
+      return 1;
+    }
+    p += end ? n + 1 : n;
+  }
+  return 0;
+}
+
+static unsigned list_configs(transfer_config *configs, const char *paths, const char *buffers, const char *hosts) {
+  unsigned n = 0;
+  for (int p = 0; p < NUM_PATHS; p++) {
+    for (int b = 0; b < NUM_BUFFER_KINDS; b++) {
+      for (int h = 0; h < NUM_HOST_KINDS; h++) {
+        if (!selected(path_names[p], paths) || !selected(buffer_names[b], buffers) || (h && !uses_host_kind(p)) ||
+            (uses_host_kind(p) && !selected(host_names[h], hosts))) {
+          continue;
+        }
+        transfer_config *c = &configs[n++];
+        c->path = p;
+        c->buffer = b;
+        c->host = h;
+        if (uses_host_kind(p)) {
+          snprintf(c->name, sizeof(c->name), "%s/%s/%s", path_names[p], buffer_names[b], host_names[h]);
+        } else {
+          snprintf(c->name, sizeof(c->name), "%s/%s", path_names[p], buffer_names[b]);
+        }
+      }
+    }
+  }
+  return n;
+}
+
+// one row per configuration, one column per size
+static void print_curves(FILE *out, const transfer_config *configs, unsigned num_configs, const size_t *sizes, unsigned num_sizes,
+                         const double *gbps) {
+  fprintf(out, "\nBandwidth in GB/s\n%-32s", "path/buffer/host");
+  for (unsigned j = 0; j < num_sizes; j++) {
+    if (sizes[j] >= 1 << 20) {
+      fprintf(out, " %7zuM", sizes[j] >> 20);
+    } else {
+      fprintf(out, " %7zuK", sizes[j] >> 10);
+    }
+  }
+  fprintf(out, "\n");
+  for (unsigned i = 0; i < num_configs; i++) {
+    fprintf(out, "%-32s", configs[i].name);
+    for (unsigned j = 0; j < num_sizes; j++) {
+      double value = gbps[i * num_sizes + j];
+      if (value < 0) {
+        fprintf(out, " %8s", "-");
+      } else {
+        fprintf(out, " %8.2f", value);
+      }
+    }
+    fprintf(out, "\n");
+  }
+}
+
+static void usage(const char *program) {
+  fprintf(stderr, "Usage: %s [--warmup N] [--iterations N] [--sizes MIN:MAX[:STEP]] [--paths P,...] [--buffers B,...] [--host H,...] [--json FILE]\n",
+          program);
+  fprintf(stderr, "Sizes are powers of two in bytes, by default 2^%u..2^%u step %u.\n", DEFAULT_MIN_LOG2, DEFAULT_MAX_LOG2, DEFAULT_STEP_LOG2);
+  fprintf(stderr, "  paths:  ");
+  for (int i = 0; i < NUM_PATHS; i++) {
+    fprintf(stderr, "%s ", path_names[i]);
+  }
+  fprintf(stderr, "\n  buffers: ");
+  for (int i = 0; i < NUM_BUFFER_KINDS; i++) {
+    fprintf(stderr, "%s ", buffer_names[i]);
+  }
+  fprintf(stderr, "\n  host:   pageable pinned (write, read and the rect paths only)\n");
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  env.warmup = DEFAULT_WARMUP;
+  env.iterations = DEFAULT_ITERATIONS;
+  unsigned min_log2 = DEFAULT_MIN_LOG2, max_log2 = DEFAULT_MAX_LOG2, step_log2 = DEFAULT_STEP_LOG2;
+  const char *paths = NULL, *buffers = NULL, *hosts = NULL, *json_path = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+    }
+    const char *value = argv[++i];
+    if (!strcmp(argv[i - 1], "--warmup")) {
+      env.warmup = atoi(value);
+    } else if (!strcmp(argv[i - 1], "--iterations")) {
+      env.iterations = atoi(value);
+    } else if (!strcmp(argv[i - 1], "--paths")) {
+      paths = value;
+    } else if (!strcmp(argv[i - 1], "--buffers")) {
+      buffers = value;
+    } else if (!strcmp(argv[i - 1], "--host")) {
+      hosts = value;
+    } else if (!strcmp(argv[i - 1], "--json")) {
+      json_path = value;
+    } else if (!strcmp(argv[i - 1], "--sizes")) {
+      if (sscanf(value, "%u:%u:%u", &min_log2, &max_log2, &step_log2) < 2 || min_log2 > max_log2 || !step_log2 || max_log2 > 40) {
+        usage(argv[0]);
+      }
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  transfer_config configs[NUM_PATHS * NUM_BUFFER_KINDS * NUM_HOST_KINDS];
+  unsigned num_configs = list_configs(configs, paths, buffers, hosts);
+  size_t sizes[MAX_SIZES];
+  unsigned num_sizes = 0;
+  for (unsigned log2_size = min_log2; log2_size <= max_log2 && num_sizes < MAX_SIZES; log2_size += step_log2) {
+    sizes[num_sizes++] = (size_t)1 << log2_size;
+  }
+  if (!num_configs) {
+    usage(argv[0]);
+  }
+
+  cl_int err;
+  env.device = create_device();
+  env.context = clCreateContext(NULL, 1, &env.device, NULL, NULL, &err);
+  check_error(err, "Couldn't create a context.");
+  env.queue = clCreateCommandQueueWithProperties(env.context, env.device, NULL, &err);
+  check_error(err, "Couldn't create a command queue.");
+  err = clGetDeviceInfo(env.device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(env.max_alloc), &env.max_alloc, NULL);
+  check_error(err, "Couldn't determine the maximum allocation size.");
+
+  FILE *json = NULL;
+  if (json_path) {
+    json = strcmp(json_path, "-") ? fopen(json_path, "w") : stdout;
+    if (!json) {
+      perror("Couldn't open the JSON file");
+      exit(EXIT_FAILURE);
+    }
+    bench_json_begin(json, env.device, env.warmup, env.iterations);
+  }
+  // with JSON on stdout the tables go to stderr
+  FILE *table = json == stdout ? stderr : stdout;
+  bench_print_header(table);
+
+  double *gbps = malloc(num_configs * num_sizes * sizeof(double));
+  int all_valid = 1;
+  for (unsigned i = 0; i < num_configs; i++) {
+    for (unsigned j = 0; j < num_sizes; j++) {
+      bench_result result = {configs[i].name, "bytes", sizes[j]};
+      gbps[i * num_sizes + j] = -1.0;
+      if (!run_transfer(&configs[i], sizes[j], &result)) {
+        fprintf(table, "%-14s %10zu %-10s not supported on this device\n", result.name, result.size, result.unit);
+        continue;
+      }
+      gbps[i * num_sizes + j] = bench_gbps(&result);
+      bench_print_result(table, &result);
+      if (json) {
+        bench_json_result(json, &result);
+      }
+      all_valid &= result.valid;
+    }
+  }
+  print_curves(table, configs, num_configs, sizes, num_sizes, gbps);
+
+  if (json) {
+    bench_json_end(json);
+    if (json != stdout) {
+      fclose(json);
+    }
+  }
+  free(gbps);
+  clReleaseCommandQueue(env.queue);
+  clReleaseContext(env.context);
+  return all_valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,18 @@
+kernel void spmv_csr(global int*   row_offsets,
+                     global int*   cols,
+                     global float* values,
+                     global float* x,
+                     global float* y,
+                            int    num_rows) {
+
+   int row = get_global_id(0);
+   if(row >= num_rows)
+      return;
+
+   /* Dot product of one compressed row with the input vector */
+   float sum = 0.0f;
+   for(int i = row_offsets[row]; i < row_offsets[row+1]; i++) {
+      sum += values[i] * x[cols[i]];
+   }
+   y[row] = sum;
+}
@@ -1,11 +1,11 @@
 #include "aux.h"
+#include "device.h"
 #include <CL/cl.h>
 
 int main(void) {
 
   // set up OpenCL
-  cl_platform_id platform = getFirstPlatform();
-  cl_device_id device = getFirstGPUDevice(platform);
+  cl_device_id device = create_device();
   cl_context context = createContext(device);
   cl_program program = createProgram(context, device);
   cl_kernel kernel = createKernel(program);
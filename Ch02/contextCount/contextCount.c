@@ -1,12 +1,12 @@
 #include "aux.h"
+#include "device.h"
 #include <CL/cl.h>
 #include <stdio.h>
 
 int main(void) {
 
   // set up OpenCL
-  cl_platform_id platform = getFirstPlatform();
-  cl_device_id device = getFirstGPUDevice(platform);
+  cl_device_id device = create_device();
   cl_context context = createContext(device);
 
   printf("Initial reference count: %u\n", getReferenceCount(context)); // 1
@@ -1,22 +1,72 @@
 #include "aux.h"
+#include "device.h"
+#include "error.h"
+#include "kernel_registry.h"
+#include <pthread.h>
 #include <stdio.h>
 
+typedef struct {
+  kernel_registry *registry;
+  const char *name;
+  registry_kernel *kernel;
+} lookup;
+
+// another thread asks for the same name and must get a kernel object of its own
+void *lookup_kernel(void *arg) {
+  lookup *l = arg;
+  l->kernel = kernel_registry_get(l->registry, l->name);
+  return NULL;
+}
+
 int main(void) {
 
   // set up OpenCL
-  cl_platform_id platform = getFirstPlatform();
-  cl_device_id device = getFirstGPUDevice(platform);
+  cl_device_id device = create_device();
   cl_context context = createContext(device);
   cl_program program = createProgram(context, device);
-  cl_uint numKernels;
-  cl_kernel *kernels = createAllKernels(program, &numKernels);
 
-  printf("Number of kernels: %d.\n", numKernels);
+  // index the program's kernels by name, only the one looked up gets created
+  kernel_registry *registry = kernel_registry_create();
+  printf("Number of kernels: %u.\n", kernel_registry_add(registry, program));
   char *kernelName = "mult";
-  int index = findNamedKernel(kernels, numKernels, kernelName);
-  if (index < 0)
+  registry_kernel *kernel = kernel_registry_get(registry, kernelName);
+  if (!kernel) {
     printf("Kernel %s not found.\n", kernelName);
-  else
-    printf("Found kernel \"%s\" at index %d.\n", kernelName, index);
-  releaseResources(context, device, program, kernels, numKernels);
+    kernel_registry_destroy(registry);
+    releaseResources(context, device, program);
+    return 1;
+  }
+  printf("Found kernel \"%s\", it takes %u arguments.\n", kernelName, registry_kernel_num_args(kernel));
+
+  // setting an argument to the bytes it already has is skipped, a new value goes through
+  cl_int err;
+  cl_mem buffers[2];
+  for (int i = 0; i < 2; i++) {
+    buffers[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float), NULL, &err);
+    check_error(err, "Couldn't create a buffer.");
+  }
+  err = registry_set_arg(kernel, 0, sizeof(cl_mem), &buffers[0]);
+  err |= registry_set_arg(kernel, 0, sizeof(cl_mem), &buffers[0]);
+  check_error(err, "Couldn't set a kernel argument.");
+  kernel_registry_stats before = kernel_registry_get_stats(registry);
+  err = registry_set_arg(kernel, 0, sizeof(cl_mem), &buffers[1]);
+  check_error(err, "Couldn't set a kernel argument.");
+  kernel_registry_stats after = kernel_registry_get_stats(registry);
+  int cached = before.args_set == 1 && before.args_skipped == 1 && after.args_set == 2 && after.args_skipped == 1;
+  printf("Argument cache: %s\n", cached ? "Check passed." : "Check failed.");
+
+  pthread_t thread;
+  lookup other = {registry, kernelName, NULL};
+  pthread_create(&thread, NULL, lookup_kernel, &other);
+  pthread_join(thread, NULL);
+  int per_thread = other.kernel && registry_kernel_handle(other.kernel) != registry_kernel_handle(kernel) &&
+                   kernel_registry_get(registry, kernelName) == kernel;
+  printf("Per-thread kernels: %s\n", per_thread ? "Check passed." : "Check failed.");
+  kernel_registry_report(registry, stdout);
+
+  kernel_registry_destroy(registry);
+  for (int i = 0; i < 2; i++) {
+    clReleaseMemObject(buffers[i]);
+  }
+  releaseResources(context, device, program);
 }
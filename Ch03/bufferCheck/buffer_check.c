@@ -1,3 +1,5 @@
+#include "device.h"
+#include "error.h"
 #include <CL/cl.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -5,49 +7,23 @@
 
 cl_int err;
 
-void handleError(char *message) {
-  if (err) {
-    fprintf(stderr, "%s\n", message);
-    exit(EXIT_FAILURE);
-  }
-}
-
-/* Find a GPU or CPU associated with the first available platform */
-cl_device_id create_device() {
-
-  /* Identify a platform */
-  cl_platform_id platform;
-  err = clGetPlatformIDs(1, &platform, NULL);
-  handleError("Couldn't find any platforms");
-
-  /* Access a device */
-  cl_device_id device;
-  err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
-  if (err == CL_DEVICE_NOT_FOUND) {
-    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &device, NULL);
-  }
-  handleError("Couldn't find any devices");
-
-  return device;
-}
-
 int main(void) {
 
   /* Create device and context */
   cl_device_id device = create_device();
   cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
-  handleError("Couldn't create a context");
+  check_error(err, "Couldn't create a context");
 
   /* Create a buffer to hold 100 floating-point values */
   float main_data[100];
   cl_mem main_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(main_data), main_data, &err);
-  handleError("Couldn't create a buffer");
+  check_error(err, "Couldn't create a buffer");
 
   cl_buffer_region region;
   region.origin = 0x100;
   region.size = 20 * sizeof(float);
   cl_mem sub_buffer = clCreateSubBuffer(main_buffer, CL_MEM_READ_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
-  handleError("Couldn't create a sub-buffer");
+  check_error(err, "Couldn't create a sub-buffer");
 
   /* Obtain size information about the buffers */
   size_t main_buffer_size;
@@ -1,33 +1,20 @@
+#include "device.h"
+#include "error.h"
 #include <CL/cl.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 cl_int err;
 
-void handleError(char *message) {
-  if (err) {
-    fprintf(stderr, "%s\n", message);
-    exit(EXIT_FAILURE);
-  }
-}
-
 int main(void) {
 
-  cl_platform_id platform;
-  err = clGetPlatformIDs(1, &platform, NULL);
-  handleError("Couldn't find any platforms");
-
-  cl_device_id device;
-  err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
-  if (err == CL_DEVICE_NOT_FOUND) {
-    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &device, NULL);
-  }
-  handleError("Couldn't access any devices");
+  /* Pick the best device of all platforms */
+  cl_device_id device = create_device();
 
   /* Check float-processing features */
   cl_device_fp_config flag;
   err = clGetDeviceInfo(device, CL_DEVICE_SINGLE_FP_CONFIG, sizeof(flag), &flag, NULL);
-  handleError("Couldn't read floating-point properties");
+  check_error(err, "Couldn't read floating-point properties");
 
   printf("Float Processing Features:\n");
   if (flag & CL_FP_INF_NAN)
@@ -1,3 +1,5 @@
+#include "device.h"
+#include "error.h"
 #include <CL/cl.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -5,32 +7,15 @@
 
 cl_int err;
 
-void handleError(char *message) {
-  if (err) {
-    fprintf(stderr, "%s\n", message);
-    exit(EXIT_FAILURE);
-  }
-}
-
 int main(void) {
 
-  /* Identify a platform */
-  cl_platform_id platform;
-  err = clGetPlatformIDs(1, &platform, NULL);
-  handleError("Couldn't find any platforms.");
-
-  /* Access a device */
-  cl_device_id device;
-  err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
-  if (err == CL_DEVICE_NOT_FOUND) {
-    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &device, NULL);
-  }
-  handleError("Couldn't access any devices.");
+  /* Pick the best device of all platforms */
+  cl_device_id device = create_device();
 
   /* Obtain the device data */
   cl_uint vector_width;
   err = clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_CHAR, sizeof(vector_width), &vector_width, NULL);
-  handleError("Couldn't read device properties.");
+  check_error(err, "Couldn't read device properties.");
 
   printf("Preferred vector width in chars: %u\n", vector_width);
   // clang-format off
@@ -1,3 +1,6 @@
+#include "device.h"
+#include "error.h"
+#include "program_cache.h"
 #include <CL/cl.h>
 #include <png.h>
 #include <stdlib.h>
@@ -11,61 +14,6 @@
 
 cl_int err;
 
-void handleError(char *message) {
-  if (err) {
-    fprintf(stderr, "%s\n", message);
-    exit(EXIT_FAILURE);
-  }
-}
-
-cl_device_id create_device() {
-  cl_platform_id platform;
-  err = clGetPlatformIDs(1, &platform, NULL);
-  handleError("Couldn't identify a platform");
-
-  cl_device_id device;
-  err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
-  if (err == CL_DEVICE_NOT_FOUND) {
-    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &device, NULL);
-  }
-  handleError("Couldn't access any devices");
-
-  return device;
-}
-
-cl_program build_program(cl_context ctx, cl_device_id dev, const char *filename) {
-  FILE *program_handle = fopen(filename, "r");
-  if (program_handle == NULL) {
-    perror("Couldn't find the program file");
-    exit(EXIT_FAILURE);
-  }
-  fseek(program_handle, 0, SEEK_END);
-  size_t program_size = ftell(program_handle);
-  rewind(program_handle);
-  char *program_buffer = (char *)malloc(program_size);
-  fread(program_buffer, sizeof(char), program_size, program_handle);
-  fclose(program_handle);
-
-  cl_program program = clCreateProgramWithSource(ctx, 1, (const char **)&program_buffer, &program_size, &err);
-  handleError("Couldn't create the program");
-  free(program_buffer);
-
-  char arg[20];
-  sprintf(arg, "-DSCALE=%u", SCALE_FACTOR);
-  err = clBuildProgram(program, 0, NULL, arg, NULL, NULL);
-  if (err) {
-    size_t log_size;
-    clGetProgramBuildInfo(program, dev, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-    char *program_log = (char *)malloc(log_size);
-    clGetProgramBuildInfo(program, dev, CL_PROGRAM_BUILD_LOG, log_size + 1, program_log, NULL);
-    printf("%s\n", program_log);
-    free(program_log);
-    exit(EXIT_FAILURE);
-  }
-
-  return program;
-}
-
 void read_image_data(const char *filename, png_bytep *input, png_bytep *output, size_t *width, size_t *height) {
   FILE *png_input;
   if ((png_input = fopen(filename, "rb")) == NULL) {
@@ -116,13 +64,18 @@ int main(int argc, char **argv) {
   png_bytep input_pixels;
   png_bytep output_pixels;
   size_t width, height;
+
+  cl_device_id device = create_device();
+  cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
+  check_error(err, "Couldn't create a context.");
+  // the kernel compiles while the host decodes the PNG
+  program_future *build = build_program_async(context, device, PROGRAM_FILE, NULL);
+
   read_image_data(INPUT_FILE, &input_pixels, &output_pixels, &width, &height);
 
   // clang-format off
-  cl_device_id device  = create_device();
-  cl_context   context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);                                                              handleError("Couldn't create a context.");
-  cl_program   program = build_program(context, device, PROGRAM_FILE);
-  cl_kernel    kernel  = clCreateKernel(program, KERNEL_FUNC, &err);                                                                       handleError("Couldn't create a kernel.");
+  cl_program   program = program_future_get(build);
+  cl_kernel    kernel  = clCreateKernel(program, KERNEL_FUNC, &err);                                                                       check_error(err, "Couldn't create a kernel.");
 
   cl_image_format png_format;
   png_format.image_channel_order     = CL_LUMINANCE;
@@ -132,21 +85,21 @@ int main(int argc, char **argv) {
   imageDesc.image_type   = CL_MEM_OBJECT_IMAGE2D;
   imageDesc.image_width  = width;
   imageDesc.image_height = height;
-  cl_mem input_image = clCreateImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &png_format, &imageDesc, input_pixels, &err);       handleError("Couldn't create input image object.");
+  cl_mem input_image = clCreateImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &png_format, &imageDesc, input_pixels, &err);       check_error(err, "Couldn't create input image object.");
 
   imageDesc.image_width  = SCALE_FACTOR * width;
   imageDesc.image_height = SCALE_FACTOR * height;
-  cl_mem output_image = clCreateImage(context, CL_MEM_WRITE_ONLY, &png_format, &imageDesc, NULL, &err);                                    handleError("Couldn't create output image object.");
+  cl_mem output_image = clCreateImage(context, CL_MEM_WRITE_ONLY, &png_format, &imageDesc, NULL, &err);                                    check_error(err, "Couldn't create output image object.");
 
-  err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input_image);                                                                          handleError("Couldn't set a kernel argument.");
-  err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output_image);                                                                         handleError("Couldn't set a kernel argument.");
+  err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input_image);                                                                          check_error(err, "Couldn't set a kernel argument.");
+  err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output_image);                                                                         check_error(err, "Couldn't set a kernel argument.");
 
-  cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, NULL, &err);                                                handleError("Couldn't create a command queue.");
+  cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, NULL, &err);                                                check_error(err, "Couldn't create a command queue.");
 
   size_t global_size[2];
   global_size[0] = width;
   global_size[1] = height;
-  err = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_size, NULL, 0, NULL, NULL);                                                  handleError("Couldn't enqueue the kernel.");
+  err = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_size, NULL, 0, NULL, NULL);                                                  check_error(err, "Couldn't enqueue the kernel.");
 
   size_t origin[3];
   origin[0] = 0;
@@ -156,7 +109,7 @@ int main(int argc, char **argv) {
   region[0] = SCALE_FACTOR * width;
   region[1] = SCALE_FACTOR * height;
   region[2] = 1;
-  err = clEnqueueReadImage(queue, output_image, CL_BLOCKING, origin, region, 0, 0, output_pixels, 0, NULL, NULL);                          handleError("Couldn't read from the image object.");
+  err = clEnqueueReadImage(queue, output_image, CL_BLOCKING, origin, region, 0, 0, output_pixels, 0, NULL, NULL);                          check_error(err, "Couldn't read from the image object.");
   // clang-format on
 
   write_image_data(OUTPUT_FILE, output_pixels, SCALE_FACTOR * width, SCALE_FACTOR * height);
@@ -1,39 +1,19 @@
-#define _CRT_SECURE_NO_WARNINGS
-#define __CL_ENABLE_EXCEPTIONS
-#define __NO_STD_STRING
-
+#include "ocl.hpp"
 #include <iostream>
 
-#ifdef MAC
-#include <OpenCL/cl.hpp>
-#else
-#include <CL/cl.hpp>
-#endif
-
-using namespace std;
-
 int main(void) {
-   
-   vector<cl::Platform> platforms;
-   vector<cl::Device> platformDevices, ctxDevices;
-   cl::string device_name;
-   cl_uint i;
-   try {
-      // Access all devices in first platform
-      cl::Platform::get(&platforms);
-      platforms[0].getDevices(CL_DEVICE_TYPE_ALL, &platformDevices);
-      
-      // Create context and access device names
-      cl::Context context(platformDevices);
-      ctxDevices = context.getInfo<CL_CONTEXT_DEVICES>();
-      for(i=0; i<ctxDevices.size(); i++) {
-         device_name = ctxDevices[i].getInfo<CL_DEVICE_NAME>();
-         cout << "Device: " << device_name.c_str() << endl;
-      }
-   }
-   catch(cl::Error e) {
-      cout << e.what() << ": Error code " << e.err() << endl;
-   }
+  try {
+    // Access all devices of the chosen device's platform
+    std::vector<cl_device_id> platformDevices = ocl::platform_devices(create_device(), CL_DEVICE_TYPE_ALL);
+
+    // Create context and access device names
+    ocl::context context(platformDevices);
+    for (cl_device_id device : context.devices()) {
+      std::cout << "Device: " << ocl::device_name(device) << std::endl;
+    }
+  } catch (const ocl::error &e) {
+    std::cout << e.what() << ": Error code " << e.code() << std::endl;
+  }
 
-   return 0;
+  return 0;
 }
@@ -1,125 +1,240 @@
+#include "bench.h"
+#include "device.h"
+#include "device_caps.h"
+#include "error.h"
+#include "host_mem.h"
+#include "program_cache.h"
+#include "reduce.h"
+#include "trace.h"
+#include "tune.h"
 #include <CL/cl.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #define PROGRAM_FILE "reduction_complete.cl"
 #define ARRAY_SIZE 1048576
 #define KERNEL_1 "reduction_vector"
 #define KERNEL_2 "reduction_complete"
+#define MAX_CANDIDATES 16
+#define ODD_SIZE (ARRAY_SIZE - 37) // a count no vector width or local size divides
+#define BENCH_WARMUP 2
+#define BENCH_ITERATIONS 10
 
 cl_int err;
 
-void handleError(char *message) {
+typedef struct {
+  cl_command_queue queue;
+  cl_kernel vector_kernel;
+  cl_kernel complete_kernel;
+  cl_mem data_buffer;
+  cl_mem sum_buffer;
+  unsigned width; // floats per work-item
+} reduction;
+
+// enqueues every pass of the reduction, the events mark the first and the last kernel; returns the first error, after
+// which no event is handed out
+cl_int enqueue_reduction(const reduction *r, size_t local_size, int verbose, cl_event *start_event, cl_event *end_event) {
+  // vector kernel
+  cl_int err = clSetKernelArg(r->vector_kernel, 0, sizeof(cl_mem), &r->data_buffer);
+  err |= clSetKernelArg(r->vector_kernel, 1, local_size * r->width * sizeof(float), NULL);
+  // complete kernel
+  err |= clSetKernelArg(r->complete_kernel, 0, sizeof(cl_mem), &r->data_buffer);
+  err |= clSetKernelArg(r->complete_kernel, 1, local_size * r->width * sizeof(float), NULL);
+  err |= clSetKernelArg(r->complete_kernel, 2, sizeof(cl_mem), &r->sum_buffer);
   if (err) {
-    fprintf(stderr, "%s\n", message);
-    exit(EXIT_FAILURE);
+    return err;
   }
-}
 
-cl_device_id create_device() {
-  cl_platform_id platform;
-  err = clGetPlatformIDs(1, &platform, NULL);
-  handleError("Couldn't identify a platform");
+  size_t global_size = ARRAY_SIZE / r->width;
+  cl_event start = NULL;
+  err = clEnqueueNDRangeKernel(r->queue, r->vector_kernel, 1, NULL, &global_size, &local_size, 0, NULL, start_event ? &start : NULL);
+  if (verbose) {
+    printf("Global size = %zu\n", global_size);
+  }
+
+  // perform successive stages of the reduction
+  while (!err && global_size / local_size > local_size) {
+    global_size = global_size / local_size;
+    if (verbose) {
+      printf("Global size = %zu\n", global_size);
+    }
+    err = clEnqueueNDRangeKernel(r->queue, r->vector_kernel, 1, NULL, &global_size, &local_size, 0, NULL, NULL);
+  }
 
-  cl_device_id device;
-  err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
-  if (err == CL_DEVICE_NOT_FOUND) {
-    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &device, NULL);
+  // the last pass has to fit into a single work-group
+  if (!err) {
+    global_size = global_size / local_size;
+    if (verbose) {
+      printf("Global size = %zu\n", global_size);
+    }
+    err = clEnqueueNDRangeKernel(r->queue, r->complete_kernel, 1, NULL, &global_size, &global_size, 0, NULL, end_event);
   }
-  handleError("Couldn't access any devices");
 
-  return device;
+  if (err && start) {
+    clReleaseEvent(start);
+  } else if (start) {
+    *start_event = start;
+  }
+  return err;
 }
 
-cl_program build_program(cl_context ctx, cl_device_id dev, const char *filename) {
-  FILE *program_handle = fopen(filename, "r");
-  if (program_handle == NULL) {
-    perror("Couldn't find the program file");
-    exit(EXIT_FAILURE);
+// tuning runs on a scratch buffer, the timing doesn't depend on the data; a local size whose tiles don't fit local
+// memory or that the kernels can't launch with is rejected
+double time_reduction(void *state, tune_config config) {
+  const reduction *r = state;
+  if (config.local_size > ARRAY_SIZE / r->width) {
+    return -1.0;
   }
-  fseek(program_handle, 0, SEEK_END);
-  size_t program_size = ftell(program_handle);
-  rewind(program_handle);
-  char *program_buffer = (char *)malloc(program_size);
-  fread(program_buffer, sizeof(char), program_size, program_handle);
-  fclose(program_handle);
+  cl_event start_event, end_event;
+  if (enqueue_reduction(state, config.local_size, 0, &start_event, &end_event)) {
+    clFinish(r->queue);
+    return -1.0;
+  }
+  return bench_event_ms(start_event, end_event);
+}
 
-  cl_program program = clCreateProgramWithSource(ctx, 1, (const char **)&program_buffer, &program_size, &err);
-  handleError("Couldn't create the program");
-  free(program_buffer);
+typedef struct {
+  reduction *fixed;
+  size_t local_size;
+  reducer *engine;
+  cl_mem input;
+  cl_mem result;
+} throughput_run;
 
-  err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-  if (err) {
-    size_t log_size;
-    clGetProgramBuildInfo(program, dev, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-    char *program_log = (char *)malloc(log_size);
-    clGetProgramBuildInfo(program, dev, CL_PROGRAM_BUILD_LOG, log_size, program_log, NULL);
-    printf("%s\n", program_log);
-    free(program_log);
-    exit(EXIT_FAILURE);
+double bench_fixed(void *state) {
+  const throughput_run *run = state;
+  tune_config config = {run->local_size, 0};
+  return time_reduction(run->fixed, config);
+}
+
+double bench_engine(void *state) {
+  const throughput_run *run = state;
+  cl_event start_event, end_event;
+  err = reducer_enqueue(run->engine, run->fixed->queue, run->input, ARRAY_SIZE, run->result, &start_event, &end_event);
+  check_error(err, "Couldn't enqueue the reduction.");
+  return bench_event_ms(start_event, end_event);
+}
+
+typedef struct {
+  reduce_op op;
+  double expected;
+  cl_ulong index; // expected from argmin and argmax
+} statistic;
+
+// runs the statistic over the first ODD_SIZE floats of input, 0, 1, 2...
+void check_statistic(cl_context context, cl_device_id device, cl_command_queue queue, cl_mem input, statistic stat) {
+  reducer *reducer = reducer_create(context, device, stat.op, REDUCE_FLOAT, 0);
+  reduce_result result = reducer_run(reducer, queue, input, ODD_SIZE);
+  // and/or produce an int
+  double value = stat.op == REDUCE_AND || stat.op == REDUCE_OR ? result.value.i : result.value.f;
+  int is_arg = stat.op == REDUCE_ARGMIN || stat.op == REDUCE_ARGMAX;
+  int passed = value == stat.expected && (!is_arg || result.index == stat.index);
+  printf("Engine %-7s = %.0f: %s\n", reduce_op_name(stat.op), value, passed ? "Check passed." : "Check failed.");
+  reducer_destroy(reducer);
+}
+
+void print_throughput(const char *name, bench_stats stats) {
+  printf("%-10s median %8.3f ms, %6.2f GB/s\n", name, stats.median_ms, ARRAY_SIZE * sizeof(float) / (stats.median_ms * 1e6));
+}
+
+typedef struct {
+  const char *name;
+  reduce_op op;
+  reduce_type type;
+  double tolerance; // relative error the check accepts
+} accuracy_variant;
+
+// the sum of the full array in every variant: its relative error and what the accuracy costs in time
+void compare_accuracy(cl_context context, cl_device_id device, throughput_run run, cl_mem double_input, accuracy_variant variant) {
+  reducer *reducer = reducer_create(context, device, variant.op, variant.type, 0);
+  if (!reducer) {
+    printf("%-12s skipped, the device has no fp64\n", variant.name);
+    return;
   }
+  run.engine = reducer;
+  if (variant.type == REDUCE_DOUBLE) {
+    run.input = double_input;
+  }
+  // a pair or a double doesn't fit the float the other runs write to
+  run.result = clCreateBuffer(context, CL_MEM_READ_WRITE, reducer_result_size(reducer), NULL, &err);
+  check_error(err, "Couldn't create a buffer.");
+  reduce_result result = reducer_run(reducer, run.fixed->queue, run.input, ARRAY_SIZE);
+  double sum = variant.op == REDUCE_SUM_COMPENSATED ? result.compensated : variant.type == REDUCE_DOUBLE ? result.value.d : result.value.f;
+  double expected = ARRAY_SIZE / 2.0 * (ARRAY_SIZE - 1.0);
+  double error = fabs(sum - expected) / expected;
 
-  return program;
+  bench_stats stats = bench_measure(bench_engine, &run, BENCH_WARMUP, BENCH_ITERATIONS);
+  size_t bytes = ARRAY_SIZE * (variant.type == REDUCE_DOUBLE ? sizeof(cl_double) : sizeof(cl_float));
+  printf("%-12s relative error %.2e, median %8.3f ms, %6.2f GB/s: %s\n", variant.name, error, stats.median_ms,
+         bytes / (stats.median_ms * 1e6), error > variant.tolerance ? "Check failed." : "Check passed.");
+  clReleaseMemObject(run.result);
+  reducer_destroy(reducer);
 }
 
 int main(void) {
 
-  // initialize data
-  float data[ARRAY_SIZE];
+  // clang-format off
+  cl_device_id device = create_device();
+  size_t max_local_size;
+  err = clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_local_size), &max_local_size, NULL);                    check_error(err, "Couldn't obtain device information.");
+
+  cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);                                                       check_error(err, "Couldn't create a context.");
+  // clang-format on
+
+  // as wide a vector as the device prefers for floats, float4 at least
+  const device_caps *caps = device_caps_get(device);
+  reduction r;
+  r.width = caps_vector_width(caps, CAPS_FLOAT, 4);
+
+  // both kernels keep a vector per work-item in local memory, a wider vector leaves room for fewer work-items
+  size_t local_limit = caps_local_pow2(caps, r.width * sizeof(float), 0);
+  if (max_local_size > local_limit) {
+    max_local_size = local_limit;
+  }
+  char options[32];
+  snprintf(options, sizeof(options), "-DVECTOR_WIDTH=%u", r.width);
+  cl_program program = build_program_with_options(context, device, PROGRAM_FILE, options);
+  printf("Vector width = %u\n", r.width);
+
+  // initialize data, aligned so that the buffer can use it in place
+  float *data = host_alloc(context, ARRAY_SIZE * sizeof(float));
   for (int i = 0; i < ARRAY_SIZE; i++) {
     data[i] = 1.0f * i;
   }
 
   // clang-format off
-  cl_device_id device = create_device();
-  size_t local_size;
-  err = clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(local_size), &local_size, NULL);                            handleError("Couldn't obtain device information.");
-
-  cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);                                                       handleError("Couldn't create a context.");
-  cl_program program = build_program(context, device, PROGRAM_FILE);
-
-  cl_mem data_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, ARRAY_SIZE * sizeof(float), data, &err);  handleError("Couldn't create a buffer.");
-  cl_mem sum_buffer  = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float), NULL, &err);                                     handleError("Couldn't create a buffer.");
+  r.data_buffer = zero_copy_buffer(context, CL_MEM_READ_WRITE, ARRAY_SIZE * sizeof(float), data, &err);                           check_error(err, "Couldn't create a buffer.");
+  r.sum_buffer  = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float), NULL, &err);                                          check_error(err, "Couldn't create a buffer.");
 
   cl_queue_properties properties[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
-  cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, properties, &err);                                 handleError("Couldn't create a command queue.");
+  r.queue = clCreateCommandQueueWithProperties(context, device, properties, &err);                                                check_error(err, "Couldn't create a command queue.");
 
-  cl_kernel vector_kernel   = clCreateKernel(program, KERNEL_1, &err);                                                            handleError("Couldn't create a kernel.");
-  cl_kernel complete_kernel = clCreateKernel(program, KERNEL_2, &err);                                                            handleError("Couldn't create a kernel.");
+  r.vector_kernel   = clCreateKernel(program, KERNEL_1, &err);                                                                    check_error(err, "Couldn't create a kernel.");
+  r.complete_kernel = clCreateKernel(program, KERNEL_2, &err);                                                                    check_error(err, "Couldn't create a kernel.");
 
-  // vector kernel
-  err  = clSetKernelArg(vector_kernel,   0, sizeof(cl_mem), &data_buffer);
-  err |= clSetKernelArg(vector_kernel,   1, local_size * 4 * sizeof(float), NULL);                                                handleError("Couldn't set kernel arguements.");
-  // complete kernel
-  err  = clSetKernelArg(complete_kernel, 0, sizeof(cl_mem), &data_buffer);
-  err |= clSetKernelArg(complete_kernel, 1, local_size * 4 * sizeof(float), NULL);
-  err |= clSetKernelArg(complete_kernel, 2, sizeof(cl_mem), &sum_buffer);                                                         handleError("Couldn't set kernel arguement.");
+  // pick the local size, OCL_TUNE=1 times the candidates instead of taking the device maximum
+  reduction scratch = r;
+  scratch.data_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, ARRAY_SIZE * sizeof(float), NULL, &err);                       check_error(err, "Couldn't create a buffer.");
+  tune_config candidates[MAX_CANDIDATES];
+  unsigned num_candidates = tune_local_sizes(r.vector_kernel, device, max_local_size, candidates, MAX_CANDIDATES);
+  tune_config fallback = {max_local_size, 0};
+  size_t local_size = tune_select(device, KERNEL_1, ARRAY_SIZE, fallback, candidates, num_candidates, time_reduction, &scratch).local_size;
+  clReleaseMemObject(scratch.data_buffer);
+  printf("Local size = %zu\n", local_size);
 
-  size_t global_size = ARRAY_SIZE / 4;
   cl_event start_event, end_event;
-  err = clEnqueueNDRangeKernel(queue, vector_kernel, 1, NULL, &global_size, &local_size, 0, NULL, &start_event);                  handleError("Couldn't enqueue the kernel.");
-  printf("Global size = %zu\n", global_size);
-
-  // perform successive stages of the reduction
-  while (global_size / local_size > local_size) {
-    global_size = global_size / local_size;
-    printf("Global size = %zu\n", global_size);
-    err = clEnqueueNDRangeKernel(queue, vector_kernel, 1, NULL, &global_size, &local_size, 0, NULL, NULL);                        handleError("Couldn't enqueue the kernel.");
-  }
-
-  global_size = global_size / local_size;
-  printf("Global size = %zu\n", global_size);
-  err = clEnqueueNDRangeKernel(queue, complete_kernel, 1, NULL, &global_size, NULL, 0, NULL, &end_event);                         handleError("Couldn't enqueue the kernel.");
-  clFinish(queue);
+  err = enqueue_reduction(&r, local_size, 1, &start_event, &end_event);                                                           check_error(err, "Couldn't enqueue the reduction.");
+  clFinish(r.queue);
 
   cl_ulong time_start, time_end;
-  err = clGetEventProfilingInfo(start_event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);                  handleError("Couldn't get profiling information.");
-  err = clGetEventProfilingInfo(end_event,   CL_PROFILING_COMMAND_END,   sizeof(time_end),   &time_end,   NULL);                  handleError("Couldn't get profiling information.");
+  err = clGetEventProfilingInfo(start_event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);                  check_error(err, "Couldn't get profiling information.");
+  err = clGetEventProfilingInfo(end_event,   CL_PROFILING_COMMAND_END,   sizeof(time_end),   &time_end,   NULL);                  check_error(err, "Couldn't get profiling information.");
   cl_ulong time_total = time_end - time_start;
 
   // read results
   float sum;
-  err = clEnqueueReadBuffer(queue, sum_buffer, CL_BLOCKING, 0, sizeof(float), &sum, 0, NULL, NULL);                               handleError("Couldn't read the buffer.");
+  err = clEnqueueReadBuffer(r.queue, r.sum_buffer, CL_BLOCKING, 0, sizeof(float), &sum, 0, NULL, NULL);                           check_error(err, "Couldn't read the buffer.");
   // clang-format on
 
   // check results
@@ -131,13 +246,88 @@ int main(void) {
   }
   printf("Total time = %lu\n", time_total);
 
+  // the reusable engine takes any count and leaves its input alone, the fixed passes above overwrote data;
+  // it runs one launch per level or, in single-pass mode, a single launch
+  reducer *engine = reducer_create(context, device, REDUCE_SUM, REDUCE_FLOAT, local_size);
+  float *values = malloc(ARRAY_SIZE * sizeof(float));
+  for (int i = 0; i < ARRAY_SIZE; i++) {
+    values[i] = 1.0f * i;
+  }
+  // clang-format off
+  cl_mem input = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, ARRAY_SIZE * sizeof(float), values, &err);        check_error(err, "Couldn't create a buffer.");
+  // clang-format on
+  size_t counts[] = {ARRAY_SIZE, ODD_SIZE};
+  for (int mode = REDUCE_MULTI_PASS; mode <= REDUCE_SINGLE_PASS; mode++) {
+    reducer_set_mode(engine, mode);
+    for (int i = 0; i < 2; i++) {
+      float engine_sum = reducer_run(engine, r.queue, input, counts[i]).value.f;
+      double expected = counts[i] / 2.0 * (counts[i] - 1.0);
+      printf("Engine, %zu floats in %u pass(es): %s\n", counts[i], reducer_passes(engine, counts[i]),
+             fabs(engine_sum - expected) > 0.01 * expected ? "Check failed." : "Check passed.");
+    }
+  }
+
+  // the other statistics come from the same kernels, built for their operation
+  statistic statistics[] = {
+      {REDUCE_MIN, 0.0, 0},
+      {REDUCE_MAX, ODD_SIZE - 1, 0},
+      {REDUCE_ARGMIN, 0.0, 0},
+      {REDUCE_ARGMAX, ODD_SIZE - 1, ODD_SIZE - 1},
+      {REDUCE_AND, 0.0, 0}, // the first element is 0
+      {REDUCE_OR, 1.0, 0},
+  };
+  for (int i = 0; i < sizeof(statistics) / sizeof(statistics[0]); i++) {
+    check_statistic(context, device, r.queue, input, statistics[i]);
+  }
+
+  // throughput of both versions on the full array, the fixed one on a scratch buffer again
+  throughput_run run = {&scratch, local_size, engine, input, r.sum_buffer};
+  scratch.data_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, ARRAY_SIZE * sizeof(float), NULL, &err);
+  check_error(err, "Couldn't create a buffer.");
+  print_throughput("Fixed", bench_measure(bench_fixed, &run, BENCH_WARMUP, BENCH_ITERATIONS));
+  reducer_set_mode(engine, REDUCE_MULTI_PASS);
+  print_throughput("Multi-pass", bench_measure(bench_engine, &run, BENCH_WARMUP, BENCH_ITERATIONS));
+  reducer_set_mode(engine, REDUCE_SINGLE_PASS);
+  print_throughput("Single", bench_measure(bench_engine, &run, BENCH_WARMUP, BENCH_ITERATIONS));
+  clReleaseMemObject(scratch.data_buffer);
+
+  // a float sum of a million elements rounds away digits, hence the 1% tolerance of the checks above; the compensated
+  // sum carries the rounding errors along and should come close to the double one
+  cl_mem double_input = NULL;
+  if (caps->fp64) {
+    double *double_values = malloc(ARRAY_SIZE * sizeof(double));
+    for (int i = 0; i < ARRAY_SIZE; i++) {
+      double_values[i] = i;
+    }
+    // clang-format off
+    double_input = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, ARRAY_SIZE * sizeof(double), double_values, &err); check_error(err, "Couldn't create a buffer.");
+    // clang-format on
+    free(double_values);
+  }
+  accuracy_variant variants[] = {
+      {"Float", REDUCE_SUM, REDUCE_FLOAT, 0.01},
+      {"Compensated", REDUCE_SUM_COMPENSATED, REDUCE_FLOAT, 1e-9},
+      {"Double", REDUCE_SUM, REDUCE_DOUBLE, 1e-12},
+  };
+  for (int i = 0; i < sizeof(variants) / sizeof(variants[0]); i++) {
+    compare_accuracy(context, device, run, double_input, variants[i]);
+  }
+  if (double_input) {
+    clReleaseMemObject(double_input);
+  }
+  program_cache_report(stderr);
+
   clReleaseEvent(start_event);
   clReleaseEvent(end_event);
-  clReleaseMemObject(sum_buffer);
-  clReleaseMemObject(data_buffer);
-  clReleaseKernel(vector_kernel);
-  clReleaseKernel(complete_kernel);
-  clReleaseCommandQueue(queue);
+  reducer_destroy(engine);
+  clReleaseMemObject(input);
+  free(values);
+  clReleaseMemObject(r.sum_buffer);
+  clReleaseMemObject(r.data_buffer);
+  host_free(data);
+  clReleaseKernel(r.vector_kernel);
+  clReleaseKernel(r.complete_kernel);
+  clReleaseCommandQueue(r.queue);
   clReleaseProgram(program);
   clReleaseContext(context);
 }
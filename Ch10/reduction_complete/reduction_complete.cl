@@ -1,5 +1,13 @@
-kernel void reduction_vector(global float4* data,
-                             local  float4* partial_sums) {
+// VECTOR_WIDTH floats per work-item, 2, 4, 8 or 16; the host picks it from the device capabilities
+#ifndef VECTOR_WIDTH
+#define VECTOR_WIDTH 4
+#endif
+#define VECTOR_TYPE(width) VECTOR_TYPE_(width)
+#define VECTOR_TYPE_(width) float##width
+typedef VECTOR_TYPE(VECTOR_WIDTH) floatN;
+
+kernel void reduction_vector(global floatN* data,
+                             local  floatN* partial_sums) {
 
    int lid        = get_local_id(0);
    int group_size = get_local_size(0);
@@ -19,8 +27,8 @@ kernel void reduction_vector(global float4* data,
    }
 }
 
-kernel void reduction_complete(global float4* data,
-                               local  float4* partial_sums,
+kernel void reduction_complete(global floatN* data,
+                               local  floatN* partial_sums,
                                global float*  sum) {
 
    int lid        = get_local_id(0);
@@ -37,6 +45,12 @@ kernel void reduction_complete(global float4* data,
    }
 
    if(lid == 0) {
-      *sum = partial_sums[0].s0 + partial_sums[0].s1 + partial_sums[0].s2 + partial_sums[0].s3;
+      floatN total = partial_sums[0];
+      float *components = (float*)&total;
+      float result = 0.0f;
+      for(int i = 0; i < VECTOR_WIDTH; i++) {
+         result += components[i];
+      }
+      *sum = result;
    }
 }
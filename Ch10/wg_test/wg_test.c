@@ -1,79 +1,103 @@
+#include "bench.h"
+#include "device.h"
+#include "error.h"
+#include "program_cache.h"
+#include "tune.h"
 #include <CL/cl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define PROGRAM_FILE "blank.cl"
 #define KERNEL_FUNC "blank"
+#define MAX_CANDIDATES 16
+#define MAX_ARGS 32
 
 cl_int err;
 
-void handleError(char *message) {
-  if (err) {
-    fprintf(stderr, "%s\n", message);
+typedef struct {
+  cl_command_queue queue;
+  cl_kernel kernel;
+  size_t global_size;
+  cl_uint num_args;
+  cl_kernel_arg_address_qualifier qualifiers[MAX_ARGS];
+} tune_target;
+
+// Gives every argument of an arbitrary kernel a value: a float4 per work-item for global and constant pointers, an int
+// or float set to the global size for scalars. Local pointers are sized per candidate in time_kernel().
+cl_mem *set_dummy_args(cl_context context, tune_target *t) {
+  // clang-format off
+  err = clGetKernelInfo(t->kernel, CL_KERNEL_NUM_ARGS, sizeof(t->num_args), &t->num_args, NULL);                      check_error(err, "Couldn't obtain kernel information.");
+  if (t->num_args > MAX_ARGS) {
+    fprintf(stderr, "Kernels with more than %d arguments can't be tuned.\n", MAX_ARGS);
     exit(EXIT_FAILURE);
   }
-}
-
-cl_device_id create_device() {
-  cl_platform_id platform;
-  err = clGetPlatformIDs(1, &platform, NULL);
-  handleError("Couldn't identify a platform");
-
-  cl_device_id device;
-  err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
-  if (err == CL_DEVICE_NOT_FOUND) {
-    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &device, NULL);
+  cl_mem *buffers = calloc(t->num_args, sizeof(cl_mem));
+  for (cl_uint i = 0; i < t->num_args; i++) {
+    char type_name[64];
+    err  = clGetKernelArgInfo(t->kernel, i, CL_KERNEL_ARG_ADDRESS_QUALIFIER, sizeof(t->qualifiers[i]), &t->qualifiers[i], NULL);
+    err |= clGetKernelArgInfo(t->kernel, i, CL_KERNEL_ARG_TYPE_NAME, sizeof(type_name), type_name, NULL);             check_error(err, "Couldn't obtain kernel argument information.");
+
+    if (t->qualifiers[i] == CL_KERNEL_ARG_ADDRESS_GLOBAL || t->qualifiers[i] == CL_KERNEL_ARG_ADDRESS_CONSTANT) {
+      buffers[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, t->global_size * 4 * sizeof(float), NULL, &err);        check_error(err, "Couldn't create a buffer.");
+      err = clSetKernelArg(t->kernel, i, sizeof(cl_mem), &buffers[i]);
+    } else if (t->qualifiers[i] == CL_KERNEL_ARG_ADDRESS_LOCAL) {
+      continue;
+    } else if (!strcmp(type_name, "int") || !strcmp(type_name, "uint")) {
+      cl_uint value = t->global_size;
+      err = clSetKernelArg(t->kernel, i, sizeof(value), &value);
+    } else if (!strcmp(type_name, "float")) {
+      float value = t->global_size;
+      err = clSetKernelArg(t->kernel, i, sizeof(value), &value);
+    } else {
+      fprintf(stderr, "Can't tune kernels with %s arguments.\n", type_name);
+      exit(EXIT_FAILURE);
+    }
+    check_error(err, "Couldn't set a kernel argument.");
   }
-  handleError("Couldn't access any devices");
-
-  return device;
+  // clang-format on
+  return buffers;
 }
 
-cl_program build_program(cl_context ctx, cl_device_id dev, const char *filename) {
-  FILE *program_handle = fopen(filename, "r");
-  if (program_handle == NULL) {
-    perror("Couldn't find the program file");
-    exit(EXIT_FAILURE);
+// a local size whose local buffers don't fit or that the device won't launch is rejected, not fatal
+double time_kernel(void *state, tune_config config) {
+  tune_target *t = state;
+  if (t->global_size % config.local_size) {
+    return -1.0;
   }
-  fseek(program_handle, 0, SEEK_END);
-  size_t program_size = ftell(program_handle);
-  rewind(program_handle);
-  char *program_buffer = (char *)malloc(program_size);
-  fread(program_buffer, sizeof(char), program_size, program_handle);
-  fclose(program_handle);
-
-  cl_program program = clCreateProgramWithSource(ctx, 1, (const char **)&program_buffer, &program_size, &err);
-  handleError("Couldn't create the program");
-  free(program_buffer);
-
-  err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-  if (err) {
-    size_t log_size;
-    clGetProgramBuildInfo(program, dev, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-    char *program_log = (char *)malloc(log_size);
-    clGetProgramBuildInfo(program, dev, CL_PROGRAM_BUILD_LOG, log_size, program_log, NULL);
-    printf("%s\n", program_log);
-    free(program_log);
-    exit(EXIT_FAILURE);
+  for (cl_uint i = 0; i < t->num_args; i++) {
+    if (t->qualifiers[i] == CL_KERNEL_ARG_ADDRESS_LOCAL) {
+      if (clSetKernelArg(t->kernel, i, config.local_size * 4 * sizeof(float), NULL)) {
+        return -1.0;
+      }
+    }
   }
-
-  return program;
+  cl_event event;
+  if (clEnqueueNDRangeKernel(t->queue, t->kernel, 1, NULL, &t->global_size, &config.local_size, 0, NULL, &event)) {
+    return -1.0;
+  }
+  return bench_event_ms(event, event);
 }
 
 int main(int argc, char **argv) {
 
   // clang-format off
   char *program_name, *kernel_func;
+  size_t global_size = 0;
   switch (argc) {
   case 1:
     program_name = PROGRAM_FILE;
     kernel_func  = KERNEL_FUNC;
     break;
   case 3:
+  case 4:
     program_name = argv[1];
     kernel_func  = argv[2];
+    global_size  = argc == 4 ? strtoul(argv[3], NULL, 0) : 0;
     break;
   default:
-    printf("Usage: wg_test <program_file> <kernel_func>\n");
+    printf("Usage: wg_test <program_file> <kernel_func> [<global_size>]\n");
+    printf("With a global size, every candidate local size is timed and the fastest is stored in the tuning database.\n");
     exit(EXIT_FAILURE);
     break;
   }
@@ -82,13 +106,14 @@ int main(int argc, char **argv) {
 
   char device_name[48];
   cl_ulong local_mem;
-  err  = clGetDeviceInfo(device, CL_DEVICE_NAME,           sizeof(device_name), device_name, NULL);                   handleError("Couldn't obtain device information.");
-  err |= clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local_mem), &local_mem, NULL);                      handleError("Couldn't obtain device information.");
+  err  = clGetDeviceInfo(device, CL_DEVICE_NAME,           sizeof(device_name), device_name, NULL);                   check_error(err, "Couldn't obtain device information.");
+  err |= clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local_mem), &local_mem, NULL);                      check_error(err, "Couldn't obtain device information.");
 
-  cl_context       context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);                                     handleError("Couldn't create a context.");
-  cl_program       program = build_program(context, device, program_name);
-  cl_command_queue queue   = clCreateCommandQueueWithProperties(context, device, NULL, &err);                         handleError("Couldn't create a command queue.");
-  cl_kernel        kernel  = clCreateKernel(program, kernel_func, &err);                                              handleError("Couldn't create the kernel.");
+  cl_context       context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);                                     check_error(err, "Couldn't create a context.");
+  cl_program       program = build_program_with_options(context, device, program_name, global_size ? "-cl-kernel-arg-info" : NULL);
+  cl_queue_properties properties[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+  cl_command_queue queue   = clCreateCommandQueueWithProperties(context, device, properties, &err);                   check_error(err, "Couldn't create a command queue.");
+  cl_kernel        kernel  = clCreateKernel(program, kernel_func, &err);                                              check_error(err, "Couldn't create the kernel.");
 
   size_t wg_size, wg_multiple;
   cl_ulong local_usage, private_usage;
@@ -96,11 +121,29 @@ int main(int argc, char **argv) {
   err |= clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(wg_multiple),   &wg_multiple,   NULL);
   err |= clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_LOCAL_MEM_SIZE,                     sizeof(local_usage),   &local_usage,   NULL);
   err |= clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_PRIVATE_MEM_SIZE,                   sizeof(private_usage), &private_usage, NULL);
-  handleError("Couldn't obtain kernel work-group size information");
+  check_error(err, "Couldn't obtain kernel work-group size information");
 
   printf("\"%s\" kernel on %s:\n  maximum work-group size: %zu\n  work-group multiple: %zu\n", kernel_func, device_name, wg_size, wg_multiple);
   printf("  local usage: %zu\n  local memory: %zu\n  private memory: %zu\n",    local_usage, local_mem,   private_usage);
 
+  if (global_size) {
+    tune_target target = {queue, kernel, global_size};
+    cl_mem *buffers = set_dummy_args(context, &target);
+    tune_config candidates[MAX_CANDIDATES], best;
+    unsigned num_candidates = tune_local_sizes(kernel, device, global_size, candidates, MAX_CANDIDATES);
+    if (tune_search(device, kernel_func, global_size, candidates, num_candidates, time_kernel, &target, &best)) {
+      printf("  tuned local size for %zu work-items: %zu\n", global_size, best.local_size);
+    } else {
+      printf("  no local size divides %zu work-items\n", global_size);
+    }
+    for (cl_uint i = 0; i < target.num_args; i++) {
+      if (buffers[i]) {
+        clReleaseMemObject(buffers[i]);
+      }
+    }
+    free(buffers);
+  }
+
   clReleaseKernel(kernel);
   clReleaseCommandQueue(queue);
   clReleaseProgram(program);
@@ -1,6 +1,13 @@
+#include "bench.h"
+#include "device.h"
+#include "error.h"
+#include "program_cache.h"
+#include "trace.h"
+#include "tune.h"
 #include <CL/cl.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 
 #define PROGRAM_FILE "bsort.cl"
@@ -12,59 +19,100 @@
 /* Ascending: 0, Descending: -1 */
 #define DIRECTION 0
 #define NUM_FLOATS 1048576
+#define MAX_CANDIDATES 16
 
 cl_int err;
 
-void handleError(char *message) {
+typedef struct {
+  cl_command_queue queue;
+  cl_kernel init;
+  cl_kernel stage_0;
+  cl_kernel stage_n;
+  cl_kernel merge;
+  cl_kernel merge_last;
+  cl_mem data_buffer;
+} sorter;
+
+// enqueues the whole bitonic network, the events mark the first and the last kernel; returns the first error, after
+// which no event is handed out
+cl_int enqueue_sort(const sorter *s, size_t local_size, cl_int direction, cl_event *start_event, cl_event *end_event) {
+  /* Create kernel argument */
+  cl_int err;
+  err = clSetKernelArg(s->init, 0, sizeof(cl_mem), &s->data_buffer);
+  err |= clSetKernelArg(s->stage_0, 0, sizeof(cl_mem), &s->data_buffer);
+  err |= clSetKernelArg(s->stage_n, 0, sizeof(cl_mem), &s->data_buffer);
+  err |= clSetKernelArg(s->merge, 0, sizeof(cl_mem), &s->data_buffer);
+  err |= clSetKernelArg(s->merge_last, 0, sizeof(cl_mem), &s->data_buffer);
+
+  /* Create kernel argument */
+  err |= clSetKernelArg(s->init, 1, 8 * local_size * sizeof(float), NULL);
+  err |= clSetKernelArg(s->stage_0, 1, 8 * local_size * sizeof(float), NULL);
+  err |= clSetKernelArg(s->stage_n, 1, 8 * local_size * sizeof(float), NULL);
+  err |= clSetKernelArg(s->merge, 1, 8 * local_size * sizeof(float), NULL);
+  err |= clSetKernelArg(s->merge_last, 1, 8 * local_size * sizeof(float), NULL);
   if (err) {
-    fprintf(stderr, "%s\n", message);
-    exit(EXIT_FAILURE);
+    return err;
   }
-}
 
-cl_device_id create_device() {
-  cl_platform_id platform;
-  err = clGetPlatformIDs(1, &platform, NULL);
-  handleError("Couldn't identify a platform");
+  /* Enqueue initial sorting kernel */
+  size_t global_size = NUM_FLOATS / 8;
+  cl_event start = NULL;
+  err = clEnqueueNDRangeKernel(s->queue, s->init, 1, NULL, &global_size, &local_size, 0, NULL, start_event ? &start : NULL);
 
-  cl_device_id device;
-  err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
-  if (err == CL_DEVICE_NOT_FOUND) {
-    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &device, NULL);
+  /* Execute further stages */
+  cl_uint num_stages = global_size / local_size;
+  for (cl_uint high_stage = 2; high_stage < num_stages && !err; high_stage <<= 1) {
+    err = clSetKernelArg(s->stage_0, 2, sizeof(int), &high_stage);
+    err |= clSetKernelArg(s->stage_n, 3, sizeof(int), &high_stage);
+
+    for (cl_uint stage = high_stage; stage > 1 && !err; stage >>= 1) {
+      err = clSetKernelArg(s->stage_n, 2, sizeof(int), &stage);
+      if (!err) {
+        err = clEnqueueNDRangeKernel(s->queue, s->stage_n, 1, NULL, &global_size, &local_size, 0, NULL, NULL);
+      }
+    }
+    if (!err) {
+      err = clEnqueueNDRangeKernel(s->queue, s->stage_0, 1, NULL, &global_size, &local_size, 0, NULL, NULL);
+    }
   }
-  handleError("Couldn't access any devices");
 
-  return device;
+  /* Set the sort direction */
+  if (!err) {
+    err = clSetKernelArg(s->merge, 3, sizeof(int), &direction);
+    err |= clSetKernelArg(s->merge_last, 2, sizeof(int), &direction);
+  }
+
+  /* Perform the bitonic merge */
+  for (cl_int stage = num_stages; stage > 1 && !err; stage >>= 1) {
+    err = clSetKernelArg(s->merge, 2, sizeof(int), &stage);
+    if (!err) {
+      err = clEnqueueNDRangeKernel(s->queue, s->merge, 1, NULL, &global_size, &local_size, 0, NULL, NULL);
+    }
+  }
+  if (!err) {
+    err = clEnqueueNDRangeKernel(s->queue, s->merge_last, 1, NULL, &global_size, &local_size, 0, NULL, end_event);
+  }
+
+  if (err && start) {
+    clReleaseEvent(start);
+  } else if (start) {
+    *start_event = start;
+  }
+  return err;
 }
 
-cl_program build_program(cl_context ctx, cl_device_id device, const char *filename) {
-  FILE *program_handle = fopen(filename, "r");
-  if (program_handle == NULL) {
-    perror("Couldn't find the program file");
-    exit(EXIT_FAILURE);
+// the network doesn't depend on the data, tuning sorts a scratch buffer; a local size some stage can't launch with
+// or whose tiles don't fit local memory is rejected
+double time_sort(void *state, tune_config config) {
+  if (config.local_size > NUM_FLOATS / 8) {
+    return -1.0;
   }
-  fseek(program_handle, 0, SEEK_END);
-  size_t program_size = ftell(program_handle);
-  rewind(program_handle);
-  char *program_buffer = (char *)malloc(program_size);
-  fread(program_buffer, sizeof(char), program_size, program_handle);
-  fclose(program_handle);
-
-  cl_program program = clCreateProgramWithSource(ctx, 1, (const char **)&program_buffer, &program_size, &err);
-  handleError("Couldn't create the program");
-  free(program_buffer);
-
-  err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-  if (err) {
-    size_t log_size;
-    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-    char *program_log = (char *)malloc(log_size);
-    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, program_log, NULL);
-    printf("%s\n", program_log);
-    free(program_log);
-    exit(EXIT_FAILURE);
+  cl_event start_event, end_event;
+  if (enqueue_sort(state, config.local_size, DIRECTION, &start_event, &end_event)) {
+    clFinish(((const sorter *)state)->queue);
+    return -1.0;
   }
-  return program;
+  return bench_event_ms(start_event, end_event);
 }
 
 int main(void) {
@@ -78,75 +126,52 @@ int main(void) {
 
   // clang-format off
   cl_device_id device  = create_device();
-  cl_context   context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);                                                           handleError("Couldn't create a context.");
+  cl_context   context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);                                                           check_error(err, "Couldn't create a context.");
 
   cl_program program = build_program(context, device, PROGRAM_FILE);
 
   /* Create kernels */
-  cl_kernel kernel_init       = clCreateKernel(program, BSORT_INIT, &err);                                                              handleError("Couldn't create the initial kernel.");
-  cl_kernel kernel_stage_0    = clCreateKernel(program, BSORT_STAGE_0, &err);                                                           handleError("Couldn't create the stage 0 kernel.");
-  cl_kernel kernel_stage_n    = clCreateKernel(program, BSORT_STAGE_N, &err);                                                           handleError("Couldn't create the stage n kernel.");
-  cl_kernel kernel_merge      = clCreateKernel(program, BSORT_MERGE, &err);                                                             handleError("Couldn't create the merge kernel.");
-  cl_kernel kernel_merge_last = clCreateKernel(program, BSORT_MERGE_LAST, &err);                                                        handleError("Couldn't create the merge last kernel.");
-
-  /* Determine maximum work-group size */
-  size_t local_size;
-  err = clGetKernelWorkGroupInfo(kernel_init, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(local_size), &local_size, NULL);                handleError("Couldn't find the maximum work-group size.");
-  local_size = (int)pow(2, trunc(log2(local_size)));
+  sorter s;
+  s.init       = clCreateKernel(program, BSORT_INIT, &err);                                                                             check_error(err, "Couldn't create the initial kernel.");
+  s.stage_0    = clCreateKernel(program, BSORT_STAGE_0, &err);                                                                          check_error(err, "Couldn't create the stage 0 kernel.");
+  s.stage_n    = clCreateKernel(program, BSORT_STAGE_N, &err);                                                                          check_error(err, "Couldn't create the stage n kernel.");
+  s.merge      = clCreateKernel(program, BSORT_MERGE, &err);                                                                            check_error(err, "Couldn't create the merge kernel.");
+  s.merge_last = clCreateKernel(program, BSORT_MERGE_LAST, &err);                                                                       check_error(err, "Couldn't create the merge last kernel.");
 
   /* Create buffer */
-  cl_mem data_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(data), data, &err);                     handleError("Couldn't create a buffer.");
-
-  /* Create kernel argument */
-  err  = clSetKernelArg(kernel_init, 0, sizeof(cl_mem), &data_buffer);
-  err |= clSetKernelArg(kernel_stage_0, 0, sizeof(cl_mem), &data_buffer);
-  err |= clSetKernelArg(kernel_stage_n, 0, sizeof(cl_mem), &data_buffer);
-  err |= clSetKernelArg(kernel_merge, 0, sizeof(cl_mem), &data_buffer);
-  err |= clSetKernelArg(kernel_merge_last, 0, sizeof(cl_mem), &data_buffer);                                                            handleError("Couldn't set a kernel argument.");
-
-  /* Create kernel argument */
-  err  = clSetKernelArg(kernel_init, 1, 8 * local_size * sizeof(float), NULL);
-  err |= clSetKernelArg(kernel_stage_0, 1, 8 * local_size * sizeof(float), NULL);
-  err |= clSetKernelArg(kernel_stage_n, 1, 8 * local_size * sizeof(float), NULL);
-  err |= clSetKernelArg(kernel_merge, 1, 8 * local_size * sizeof(float), NULL);                                                         handleError("Couldn't set a kernel argument.");
-  err |= clSetKernelArg(kernel_merge_last, 1, 8 * local_size * sizeof(float), NULL);
+  s.data_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(data), data, &err);                          check_error(err, "Couldn't create a buffer.");
 
-  cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, NULL, &err);                                             handleError("Couldn't create a command queue.");
+  /* Profiling lets the tuner time the candidate local sizes */
+  cl_queue_properties properties[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+  s.queue = clCreateCommandQueueWithProperties(context, device, properties, &err);                                                      check_error(err, "Couldn't create a command queue.");
 
-  /* Enqueue initial sorting kernel */
+  /* Determine the work-group size, the largest power of two unless OCL_TUNE=1 finds a faster one */
   size_t global_size = NUM_FLOATS / 8;
+  size_t local_size = global_size, kernel_max;
+  // every stage launches with the same local size, so the smallest limit of the five applies
+  cl_kernel kernels[] = {s.init, s.stage_0, s.stage_n, s.merge, s.merge_last};
+  for (int i = 0; i < 5; i++) {
+    err = clGetKernelWorkGroupInfo(kernels[i], device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(kernel_max), &kernel_max, NULL);               check_error(err, "Couldn't find the maximum work-group size.");
+    if (kernel_max < local_size) {
+      local_size = kernel_max;
+    }
+  }
+  local_size = (int)pow(2, trunc(log2(local_size)));
   if (global_size < local_size) {
     local_size = global_size;
   }
-  err = clEnqueueNDRangeKernel(queue, kernel_init, 1, NULL, &global_size, &local_size, 0, NULL, NULL);                                  handleError("Couldn't enqueue the kernel.");
-
-  /* Execute further stages */
-  cl_uint num_stages = global_size / local_size;
-  for (cl_uint high_stage = 2; high_stage < num_stages; high_stage <<= 1) {
-    err = clSetKernelArg(kernel_stage_0, 2, sizeof(int), &high_stage);
-    err |= clSetKernelArg(kernel_stage_n, 3, sizeof(int), &high_stage);                                                                 handleError("Couldn't set a kernel argument.");
-
-    for (cl_uint stage = high_stage; stage > 1; stage >>= 1) {
-      err = clSetKernelArg(kernel_stage_n, 2, sizeof(int), &stage);                                                                     handleError("Couldn't set a kernel argument.");
-      err = clEnqueueNDRangeKernel(queue, kernel_stage_n, 1, NULL, &global_size, &local_size, 0, NULL, NULL);                           handleError("Couldn't enqueue the kernel.");
-    }
-    err = clEnqueueNDRangeKernel(queue, kernel_stage_0, 1, NULL, &global_size, &local_size, 0, NULL, NULL);                             handleError("Couldn't enqueue the kernel.");
-  }
+  sorter scratch = s;
+  scratch.data_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(data), NULL, &err);                                           check_error(err, "Couldn't create a buffer.");
+  tune_config candidates[MAX_CANDIDATES], fallback = {local_size, 0};
+  unsigned num_candidates = tune_local_sizes(s.init, device, local_size, candidates, MAX_CANDIDATES);
+  local_size = tune_select(device, BSORT_INIT, NUM_FLOATS, fallback, candidates, num_candidates, time_sort, &scratch).local_size;
+  clReleaseMemObject(scratch.data_buffer);
 
-  /* Set the sort direction */
   cl_int direction = DIRECTION;
-  err = clSetKernelArg(kernel_merge, 3, sizeof(int), &direction);
-  err |= clSetKernelArg(kernel_merge_last, 2, sizeof(int), &direction);                                                                 handleError("Couldn't set a kernel argument.");
-
-  /* Perform the bitonic merge */
-  for (cl_int stage = num_stages; stage > 1; stage >>= 1) {
-    err = clSetKernelArg(kernel_merge, 2, sizeof(int), &stage);                                                                         handleError("Couldn't set a kernel argument.");
-    err = clEnqueueNDRangeKernel(queue, kernel_merge, 1, NULL, &global_size, &local_size, 0, NULL, NULL);                               handleError("Couldn't enqueue the kernel.");
-  }
-  err = clEnqueueNDRangeKernel(queue, kernel_merge_last, 1, NULL, &global_size, &local_size, 0, NULL, NULL);                            handleError("Couldn't enqueue the kernel.");
+  err = enqueue_sort(&s, local_size, direction, NULL, NULL);                                                                            check_error(err, "Couldn't enqueue the sort.");
 
   /* Read the result */
-  err = clEnqueueReadBuffer(queue, data_buffer, CL_BLOCKING, 0, sizeof(data), &data, 0, NULL, NULL);                                    handleError("Couldn't read the buffer");
+  err = clEnqueueReadBuffer(s.queue, s.data_buffer, CL_BLOCKING, 0, sizeof(data), &data, 0, NULL, NULL);                                check_error(err, "Couldn't read the buffer");
   // clang-format on
 
   cl_int check = CL_TRUE;
@@ -179,14 +204,15 @@ int main(void) {
   } else {
     printf("Bitonic sort FAILED.\n");
   }
-
-  clReleaseMemObject(data_buffer);
-  clReleaseKernel(kernel_init);
-  clReleaseKernel(kernel_stage_0);
-  clReleaseKernel(kernel_stage_n);
-  clReleaseKernel(kernel_merge);
-  clReleaseKernel(kernel_merge_last);
-  clReleaseCommandQueue(queue);
+  program_cache_report(stderr);
+
+  clReleaseMemObject(s.data_buffer);
+  clReleaseKernel(s.init);
+  clReleaseKernel(s.stage_0);
+  clReleaseKernel(s.stage_n);
+  clReleaseKernel(s.merge);
+  clReleaseKernel(s.merge_last);
+  clReleaseCommandQueue(s.queue);
   clReleaseProgram(program);
   clReleaseContext(context);
 }
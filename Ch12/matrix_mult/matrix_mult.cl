@@ -4,7 +4,12 @@ kernel void matrix_mult(global float4 *a_mat,
 
    float sum;
 
+   /* A host-specialised build fixes the matrix size */
+#ifdef MATRIX_DIM
+   int num_rows        = MATRIX_DIM;
+#else
    int num_rows        = get_global_size(0);
+#endif
    int vectors_per_row = num_rows/4;
    int start           = get_global_id(0) * vectors_per_row;
    a_mat += start;
@@ -1,22 +1,21 @@
+#include "device.h"
+#include "error.h"
 #include "mmio.h"
+#include "program_cache.h"
+#include "reference.h"
 #include <CL/cl.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 
 #define PROGRAM_FILE "conj_grad.cl"
 #define KERNEL_FUNC "conj_grad"
 #define MM_FILE "bcsstk05.mtx"
 
-/* Rearrange data to be sorted by row instead of by column */
 cl_int err;
 
-void handleError(char *message) {
-  if (err) {
-    fprintf(stderr, "%s\n", message);
-    exit(EXIT_FAILURE);
-  }
-}
-
+/* Rearrange data to be sorted by row instead of by column */
 void sort(int num, int *rows, int *cols, float *values) {
   int index = 0;
   for (int i = 0; i < num; i++) {
@@ -55,39 +54,61 @@ FILE *openMatrixFile(char *matrix_file) {
   return mm_handle;
 }
 
-cl_program build_program(cl_context ctx, cl_device_id device, const char *filename) {
-  FILE *program_handle = fopen(filename, "r");
-  if (program_handle == NULL) {
-    perror("Couldn't find the program file");
-    exit(EXIT_FAILURE);
+/* The kernel's iteration on the CPU, in double apart from the product itself */
+int reference_conj_grad(int num_rows, int num_values, const int *rows, const int *cols, const float *values, const float *b_vec,
+                        double *r_length) {
+  int *row_offsets = calloc(num_rows + 1, sizeof(int));
+  for (int i = 0; i < num_values; i++) {
+    row_offsets[rows[i] + 1]++;
   }
-  fseek(program_handle, 0, SEEK_END);
-  size_t program_size = ftell(program_handle);
-  rewind(program_handle);
-  char *program_buffer = (char *)malloc(program_size);
-  fread(program_buffer, sizeof(char), program_size, program_handle);
-  fclose(program_handle);
-
-  cl_program program = clCreateProgramWithSource(ctx, 1, (const char **)&program_buffer, &program_size, &err);
-  handleError("Couldn't create the program");
-  free(program_buffer);
-
-  err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-  if (err) {
-    size_t log_size;
-    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-    char *program_log = (char *)malloc(log_size);
-    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, program_log, NULL);
-    printf("%s\n", program_log);
-    free(program_log);
-    exit(EXIT_FAILURE);
+  for (int i = 0; i < num_rows; i++) {
+    row_offsets[i + 1] += row_offsets[i];
   }
-  return program;
+  double *r = malloc(num_rows * sizeof(double));
+  float *p = malloc(num_rows * sizeof(float));
+  float *A_times_p = malloc(num_rows * sizeof(float));
+  double old_r_dot_r = 0.0;
+  for (int i = 0; i < num_rows; i++) {
+    r[i] = p[i] = b_vec[i];
+    old_r_dot_r += r[i] * r[i];
+  }
+  *r_length = sqrt(old_r_dot_r);
+
+  int iteration = 0;
+  while (iteration < 1000 && *r_length >= 0.01) {
+    ref_spmv(num_rows, row_offsets, cols, values, p, A_times_p);
+    double Ap_dot_p = 0.0;
+    for (int i = 0; i < num_rows; i++) {
+      Ap_dot_p += (double)A_times_p[i] * p[i];
+    }
+    double alpha = old_r_dot_r / Ap_dot_p, new_r_dot_r = 0.0;
+    for (int i = 0; i < num_rows; i++) {
+      r[i] -= alpha * A_times_p[i];
+      new_r_dot_r += r[i] * r[i];
+    }
+    for (int i = 0; i < num_rows; i++) {
+      p[i] = r[i] + (new_r_dot_r / old_r_dot_r) * p[i];
+    }
+    old_r_dot_r = new_r_dot_r;
+    *r_length = sqrt(new_r_dot_r);
+    iteration++;
+  }
+  free(row_offsets);
+  free(r);
+  free(p);
+  free(A_times_p);
+  return iteration;
 }
 
 int main() {
   double value_double;
 
+  cl_device_id device = create_device();
+  cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
+  check_error(err, "Couldn't create a context.");
+  // the kernel compiles while the host parses the Matrix Market file
+  program_future *build = build_program_async(context, device, PROGRAM_FILE, NULL);
+
   /* Read sparse file */
   FILE *mm_handle = openMatrixFile(MM_FILE);
   MM_typecode code;
@@ -127,21 +148,14 @@ int main() {
   }
 
   // clang-format off
-  cl_platform_id platform;
-  err = clGetPlatformIDs(1, &platform, NULL);                                                                                          handleError("Couldn't identify a platform.");
-
-  cl_device_id device;
-  err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);                                                                handleError("Couldn't access any devices.");
-
-  cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);                                                            handleError("Couldn't create a context.");
-  cl_program program = build_program(context, device, PROGRAM_FILE);
-  cl_kernel  kernel  = clCreateKernel(program, KERNEL_FUNC, &err);                                                                     handleError("Couldn't create a kernel.");
+  cl_program program = program_future_get(build);
+  cl_kernel  kernel  = clCreateKernel(program, KERNEL_FUNC, &err);                                                                     check_error(err, "Couldn't create a kernel.");
 
-  cl_mem rows_buffer   = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, num_values * sizeof(int), rows, &err);                                                                            handleError("Couldn't create rows buffer.");
-  cl_mem cols_buffer   = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, num_values * sizeof(int), cols, &err);                                                                            handleError("Couldn't create cols buffer.");
-  cl_mem values_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, num_values * sizeof(float), values, &err);                                                                            handleError("Couldn't create values buffer.");
-  cl_mem b_buffer      = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, num_values * sizeof(float), b_vec, &err);                                                                            handleError("Couldn't create b buffer.");
-  cl_mem result_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, 2 * sizeof(float), NULL, NULL);                                    handleError("Couldn't create result buffer.");
+  cl_mem rows_buffer   = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, num_values * sizeof(int), rows, &err);                                                                            check_error(err, "Couldn't create rows buffer.");
+  cl_mem cols_buffer   = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, num_values * sizeof(int), cols, &err);                                                                            check_error(err, "Couldn't create cols buffer.");
+  cl_mem values_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, num_values * sizeof(float), values, &err);                                                                            check_error(err, "Couldn't create values buffer.");
+  cl_mem b_buffer      = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, num_values * sizeof(float), b_vec, &err);                                                                            check_error(err, "Couldn't create b buffer.");
+  cl_mem result_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, 2 * sizeof(float), NULL, NULL);                                    check_error(err, "Couldn't create result buffer.");
 
   /* Create kernel argument */
   err  = clSetKernelArg(kernel, 0, sizeof(num_rows), &num_rows);
@@ -154,20 +168,24 @@ int main() {
   err |= clSetKernelArg(kernel, 7, sizeof(cl_mem), &cols_buffer);
   err |= clSetKernelArg(kernel, 8, sizeof(cl_mem), &values_buffer);
   err |= clSetKernelArg(kernel, 9, sizeof(cl_mem), &b_buffer);
-  err |= clSetKernelArg(kernel, 10, sizeof(cl_mem), &result_buffer);                                                                   handleError("Couldn't set a kernel argument.");
+  err |= clSetKernelArg(kernel, 10, sizeof(cl_mem), &result_buffer);                                                                   check_error(err, "Couldn't set a kernel argument.");
 
-  cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, NULL, &err);                                            handleError("Couldn't create a command queue.");
+  cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, NULL, &err);                                            check_error(err, "Couldn't create a command queue.");
 
   size_t global_size = num_rows;
   size_t local_size  = num_rows;
-  err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global_size, &local_size, 0, NULL, NULL);                                      handleError("Couldn't enqueue the kernel.");
+  err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global_size, &local_size, 0, NULL, NULL);                                      check_error(err, "Couldn't enqueue the kernel.");
 
   /* Read the results */
   float result[2];
-  err = clEnqueueReadBuffer(queue, result_buffer, CL_BLOCKING, 0, 2 * sizeof(float), result, 0, NULL, NULL);                           handleError("Couldn't read the buffer");
+  err = clEnqueueReadBuffer(queue, result_buffer, CL_BLOCKING, 0, 2 * sizeof(float), result, 0, NULL, NULL);                           check_error(err, "Couldn't read the buffer");
   // clang-format on
 
   printf("After %d iterations, the residual length is %f.\n", (int)result[0], result[1]);
+  double reference_length;
+  int reference_iterations = reference_conj_grad(num_rows, num_values, rows, cols, values, b_vec, &reference_length);
+  printf("The CPU reference takes %d iterations, its residual length is %f.\n", reference_iterations, reference_length);
+  program_cache_report(stderr);
 
   free(b_vec);
   free(rows);
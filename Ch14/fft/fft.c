@@ -1,4 +1,12 @@
-#include "fft_check.c"
+#include "bench.h"
+#include "device.h"
+#include "device_caps.h"
+#include "error.h"
+#include "host_mem.h"
+#include "program_cache.h"
+#include "reference.h"
+#include "trace.h"
+#include "tune.h"
 #include <CL/cl.h>
 #include <math.h>
 #include <stdio.h>
@@ -14,65 +22,101 @@
 #define NUM_POINTS 8192
 /* 1 - forward FFT, -1 - inverse FFT */
 #define DIRECTION 1
+#define MAX_CANDIDATES 32
 
 cl_int err;
 
-void handleError(char *message) {
+typedef struct {
+  cl_command_queue queue;
+  cl_kernel init_kernel;
+  cl_kernel stage_kernel;
+  cl_kernel scale_kernel;
+  cl_mem input_buffer;
+  cl_mem data_buffer;
+} fft_plan;
+
+// enqueues the whole transform, each work-group keeps points_per_group points in local memory; returns the first
+// error, after which no event is handed out
+cl_int enqueue_fft(const fft_plan *plan, size_t local_size, unsigned points_per_group, int direction, cl_event *start_event,
+                   cl_event *end_event) {
+  unsigned num_points = NUM_POINTS;
+
+  /* Set kernel arguments */
+  cl_int err = clSetKernelArg(plan->init_kernel, 0, sizeof(cl_mem), &plan->input_buffer);
+  err |= clSetKernelArg(plan->init_kernel, 1, sizeof(cl_mem), &plan->data_buffer);
+  err |= clSetKernelArg(plan->init_kernel, 2, points_per_group * 2 * sizeof(float), NULL);
+  err |= clSetKernelArg(plan->init_kernel, 3, sizeof(points_per_group), &points_per_group);
+  err |= clSetKernelArg(plan->init_kernel, 4, sizeof(num_points), &num_points);
+  err |= clSetKernelArg(plan->init_kernel, 5, sizeof(direction), &direction);
   if (err) {
-    fprintf(stderr, "%s\n", message);
-    exit(EXIT_FAILURE);
+    return err;
   }
-}
 
-cl_device_id create_device() {
-  cl_platform_id platform;
-  err = clGetPlatformIDs(1, &platform, NULL);
-  handleError("Couldn't identify a platform");
+  /* Enqueue initial kernel */
+  size_t global_size = (num_points / points_per_group) * local_size;
+  cl_event start = NULL;
+  err = clEnqueueNDRangeKernel(plan->queue, plan->init_kernel, 1, NULL, &global_size, &local_size, 0, NULL, start_event ? &start : NULL);
 
-  cl_device_id device;
-  err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
-  if (err == CL_DEVICE_NOT_FOUND) {
-    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &device, NULL);
+  /* Enqueue further stages of the FFT */
+  if (!err && num_points > points_per_group) {
+    err = clSetKernelArg(plan->stage_kernel, 0, sizeof(cl_mem), &plan->data_buffer);
+    err |= clSetKernelArg(plan->stage_kernel, 2, sizeof(points_per_group), &points_per_group);
+    err |= clSetKernelArg(plan->stage_kernel, 3, sizeof(direction), &direction);
+
+    for (unsigned stage = 2; stage <= num_points / points_per_group && !err; stage <<= 1) {
+      err = clSetKernelArg(plan->stage_kernel, 1, sizeof(stage), &stage);
+      if (!err) {
+        err = clEnqueueNDRangeKernel(plan->queue, plan->stage_kernel, 1, NULL, &global_size, &local_size, 0, NULL, NULL);
+      }
+    }
   }
-  handleError("Couldn't access any devices");
 
-  return device;
+  /* Scale values if performing the inverse FFT */
+  if (!err && direction < 0) {
+    err = clSetKernelArg(plan->scale_kernel, 0, sizeof(cl_mem), &plan->data_buffer);
+    err |= clSetKernelArg(plan->scale_kernel, 1, sizeof(points_per_group), &points_per_group);
+    err |= clSetKernelArg(plan->scale_kernel, 2, sizeof(num_points), &num_points);
+    if (!err) {
+      err = clEnqueueNDRangeKernel(plan->queue, plan->scale_kernel, 1, NULL, &global_size, &local_size, 0, NULL, NULL);
+    }
+  }
+
+  /* The marker completes after the last kernel, however many stages ran */
+  if (!err && end_event) {
+    err = clEnqueueMarkerWithWaitList(plan->queue, 0, NULL, end_event);
+  }
+
+  if (err && start) {
+    clReleaseEvent(start);
+  } else if (start) {
+    *start_event = start;
+  }
+  return err;
 }
 
-cl_program build_program(cl_context ctx, cl_device_id device, const char *filename) {
-  FILE *program_handle = fopen(filename, "r");
-  if (program_handle == NULL) {
-    perror("Couldn't find the program file");
-    exit(EXIT_FAILURE);
+// every work-item needs at least 4 points, the tuner trades local memory per group against the number of groups; a
+// configuration the device refuses to launch is rejected
+double time_fft(void *state, tune_config config) {
+  if (config.local_size * 4 > config.param) {
+    return -1.0;
   }
-  fseek(program_handle, 0, SEEK_END);
-  size_t program_size = ftell(program_handle);
-  rewind(program_handle);
-  char *program_buffer = (char *)malloc(program_size);
-  fread(program_buffer, sizeof(char), program_size, program_handle);
-  fclose(program_handle);
-
-  cl_program program = clCreateProgramWithSource(ctx, 1, (const char **)&program_buffer, &program_size, &err);
-  handleError("Couldn't create the program");
-  free(program_buffer);
-
-  err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-  if (err) {
-    size_t log_size;
-    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-    char *program_log = (char *)malloc(log_size);
-    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, program_log, NULL);
-    printf("%s\n", program_log);
-    free(program_log);
-    exit(EXIT_FAILURE);
+  cl_event start_event, end_event;
+  if (enqueue_fft(state, config.local_size, config.param, DIRECTION, &start_event, &end_event)) {
+    clFinish(((const fft_plan *)state)->queue);
+    return -1.0;
   }
-  return program;
+  return bench_event_ms(start_event, end_event);
 }
 
 int main(void) {
 
-  /* initialize data */
-  float data[NUM_POINTS * 2];
+  // clang-format off
+  cl_device_id device = create_device();
+  cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);                                                           check_error(err, "Couldn't create a context.");
+  // clang-format on
+
+  /* initialize data, aligned so that the input buffer can use it in place */
+  float *data = host_alloc(context, 2 * NUM_POINTS * sizeof(float));
   double check_input[NUM_POINTS][2];
   srand(time(NULL));
   for (int i = 0; i < NUM_POINTS; i++) {
@@ -83,87 +127,63 @@ int main(void) {
   }
 
   // clang-format off
-  cl_device_id device = create_device();
-  cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);                                                            handleError("Couldn't create a context.");
   cl_program program = build_program(context, device, PROGRAM_FILE);
-  cl_kernel init_kernel = clCreateKernel(program, INIT_FUNC, &err);                                                                    handleError("Couldn't create the initial kernel.");
-  cl_kernel stage_kernel = clCreateKernel(program, STAGE_FUNC, &err);                                                                  handleError("Couldn't create the stage kernel.");
-  cl_kernel scale_kernel = clCreateKernel(program, SCALE_FUNC, &err);                                                                  handleError("Couldn't create the scale kernel.");
-  cl_mem input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, 2 * NUM_POINTS * sizeof(float), data, &err);   handleError("Couldn't create a buffer.");
-  cl_mem data_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, 2 * NUM_POINTS * sizeof(float), NULL, &err);                         handleError("Couldn't create a buffer.");
+  fft_plan plan;
+  plan.init_kernel = clCreateKernel(program, INIT_FUNC, &err);                                                                        check_error(err, "Couldn't create the initial kernel.");
+  plan.stage_kernel = clCreateKernel(program, STAGE_FUNC, &err);                                                                      check_error(err, "Couldn't create the stage kernel.");
+  plan.scale_kernel = clCreateKernel(program, SCALE_FUNC, &err);                                                                      check_error(err, "Couldn't create the scale kernel.");
+  plan.input_buffer = zero_copy_buffer(context, CL_MEM_READ_ONLY, 2 * NUM_POINTS * sizeof(float), data, &err);                        check_error(err, "Couldn't create a buffer.");
+  plan.data_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, 2 * NUM_POINTS * sizeof(float), NULL, &err);                          check_error(err, "Couldn't create a buffer.");
 
   /* Determine maximum work-group size */
   size_t local_size;
-  err = clGetKernelWorkGroupInfo(init_kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(local_size), &local_size, NULL);               handleError("Couldn't find the maximum work-group size.");
+  err = clGetKernelWorkGroupInfo(plan.init_kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(local_size), &local_size, NULL);         check_error(err, "Couldn't find the maximum work-group size.");
   local_size = (int)pow(2, trunc(log2(local_size)));
 
-  /* Determine local memory size */
-  cl_ulong local_mem_size;
-  err = clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local_mem_size), &local_mem_size, NULL);                              handleError("Couldn't determine the local memory size.");
-  local_mem_size -= 2 * 1024;
-
-  /* initialize kernel arguments */
-  int direction = DIRECTION;
+  /* The bit reversal and the stage kernel need a power of two points per group, 2 KiB of local memory stay free */
   unsigned num_points = NUM_POINTS;
-  unsigned points_per_group = local_mem_size / (2 * sizeof(float));
+  unsigned points_per_group = caps_local_pow2(device_caps_get(device), 2 * sizeof(float), 2 * 1024);
   if (points_per_group > num_points) {
     points_per_group = num_points;
   }
-
-  /* Set kernel arguments */
-  err  = clSetKernelArg(init_kernel, 0, sizeof(cl_mem), &input_buffer);
-  err |= clSetKernelArg(init_kernel, 1, sizeof(cl_mem), &data_buffer);
-  err |= clSetKernelArg(init_kernel, 2, local_mem_size, NULL);
-  err |= clSetKernelArg(init_kernel, 3, sizeof(points_per_group), &points_per_group);
-  err |= clSetKernelArg(init_kernel, 4, sizeof(num_points), &num_points);
-  err |= clSetKernelArg(init_kernel, 5, sizeof(direction), &direction);                                                                handleError("Couldn't set a kernel argument.");
+  if (local_size * 4 > points_per_group) {
+    local_size = points_per_group / 4;
+  }
 
   /* Create a command queue */
   cl_queue_properties properties[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
-  cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, properties, &err);                                      handleError("Couldn't create a command queue.");
-
-  /* Enqueue initial kernel */
-  size_t global_size = (num_points / points_per_group) * local_size;
-  err = clEnqueueNDRangeKernel(queue, init_kernel, 1, NULL, &global_size, &local_size, 0, NULL, NULL);                                 handleError("Couldn't enqueue the initial kernel.");
-
-  /* Enqueue further stages of the FFT */
-  if (num_points > points_per_group) {
-    err = clSetKernelArg(stage_kernel, 0, sizeof(cl_mem), &data_buffer);
-    err |= clSetKernelArg(stage_kernel, 2, sizeof(points_per_group), &points_per_group);
-    err |= clSetKernelArg(stage_kernel, 3, sizeof(direction), &direction);                                                             handleError("Couldn't set a kernel argument.");
-
-    for (unsigned stage = 2; stage <= num_points / points_per_group; stage <<= 1) {
-      err = clSetKernelArg(stage_kernel, 1, sizeof(stage), &stage);
-      handleError("Couldn't set a kernel argument.");
-      err = clEnqueueNDRangeKernel(queue, stage_kernel, 1, NULL, &global_size, &local_size, 0, NULL, NULL);                            handleError("Couldn't enqueue the stage kernel");
+  plan.queue = clCreateCommandQueueWithProperties(context, device, properties, &err);                                                 check_error(err, "Couldn't create a command queue.");
+
+  /* OCL_TUNE=1 times smaller local-memory partitions and work-groups too, the input buffer isn't modified */
+  tune_config candidates[MAX_CANDIDATES], fallback = {local_size, points_per_group};
+  unsigned num_candidates = 0;
+  for (unsigned group = points_per_group; group >= 4 && group * 4 >= points_per_group; group /= 2) {
+    unsigned n = tune_local_sizes(plan.init_kernel, device, group / 4, candidates + num_candidates, MAX_CANDIDATES - num_candidates);
+    for (unsigned i = 0; i < n; i++) {
+      candidates[num_candidates++].param = group;
     }
   }
+  tune_config config = tune_select(device, INIT_FUNC, NUM_POINTS, fallback, candidates, num_candidates, time_fft, &plan);
+  local_size = config.local_size;
+  points_per_group = config.param;
 
-  /* Scale values if performing the inverse FFT */
-  if (direction < 0) {
-    err = clSetKernelArg(scale_kernel, 0, sizeof(cl_mem), &data_buffer);
-    err |= clSetKernelArg(scale_kernel, 1, sizeof(points_per_group), &points_per_group);
-    err |= clSetKernelArg(scale_kernel, 2, sizeof(num_points), &num_points);                                                           handleError("Couldn't set a kernel argument.");
-    err = clEnqueueNDRangeKernel(queue, scale_kernel, 1, NULL, &global_size, &local_size, 0, NULL, NULL);                              handleError("Couldn't enqueue the scale kernel");
-  }
+  int direction = DIRECTION;
+  err = enqueue_fft(&plan, local_size, points_per_group, direction, NULL, NULL);                                                      check_error(err, "Couldn't enqueue the FFT.");
 
-  /* Read the results */
-  err = clEnqueueReadBuffer(queue, data_buffer, CL_TRUE, 0, 2 * NUM_POINTS * sizeof(float), data, 0, NULL, NULL);                      handleError("Couldn't read the buffer.");
+  /* Map the results, a CPU device hands out its own memory instead of copying it */
+  float *output = zero_copy_map(plan.queue, plan.data_buffer, CL_MAP_READ, 2 * NUM_POINTS * sizeof(float), &err);                    check_error(err, "Couldn't map the buffer.");
   // clang-format on
 
   /* Compute accurate values */
   double check_output[NUM_POINTS][2];
-  if (direction > 0) {
-    fft(NUM_POINTS, check_input, check_output);
-  } else {
-    ifft(NUM_POINTS, check_output, check_input);
-  }
+  ref_fft(NUM_POINTS, &check_input[0][0], &check_output[0][0], direction);
 
   double error = 0.0;
   for (int i = 0; i < NUM_POINTS; i++) {
-    error += fabs(check_output[i][0] - data[2 * i]) / fmax(fabs(check_output[i][0]), 0.0001);
-    error += fabs(check_output[i][1] - data[2 * i + 1]) / fmax(fabs(check_output[i][1]), 0.0001);
+    error += fabs(check_output[i][0] - output[2 * i]) / fmax(fabs(check_output[i][0]), 0.0001);
+    error += fabs(check_output[i][1] - output[2 * i + 1]) / fmax(fabs(check_output[i][1]), 0.0001);
   }
+  zero_copy_unmap(plan.queue, plan.data_buffer, output);
   error = error / (NUM_POINTS * 2);
 
   printf("%u-point ", num_points);
@@ -173,13 +193,15 @@ int main(void) {
     printf("IFFT ");
   }
   printf("completed with %f average relative error.\n", error);
-
-  clReleaseMemObject(input_buffer);
-  clReleaseMemObject(data_buffer);
-  clReleaseKernel(init_kernel);
-  clReleaseKernel(stage_kernel);
-  clReleaseKernel(scale_kernel);
-  clReleaseCommandQueue(queue);
+  program_cache_report(stderr);
+
+  clReleaseMemObject(plan.input_buffer);
+  clReleaseMemObject(plan.data_buffer);
+  host_free(data);
+  clReleaseKernel(plan.init_kernel);
+  clReleaseKernel(plan.stage_kernel);
+  clReleaseKernel(plan.scale_kernel);
+  clReleaseCommandQueue(plan.queue);
   clReleaseProgram(program);
   clReleaseContext(context);
 }
@@ -15,7 +15,21 @@ kernel void fft_init(global float2* in_data, global float2* out_data,
    uint points_per_item, g_addr, l_addr, i, fft_index, stage, N2;
    float2 x1, x2, x3, x4, sum12, diff12, sum34, diff34;
 
+   /* A host-specialised build fixes the sizes and the direction */
+#ifdef FFT_SIZE
+   size = FFT_SIZE;
+#endif
+#ifdef FFT_POINTS_PER_GROUP
+   points_per_group = FFT_POINTS_PER_GROUP;
+#endif
+#ifdef FFT_DIR
+   dir = FFT_DIR;
+#endif
+#ifdef FFT_LOCAL_SIZE
+   points_per_item = points_per_group/FFT_LOCAL_SIZE;
+#else
    points_per_item = points_per_group/get_local_size(0);
+#endif
    l_addr = get_local_id(0) * points_per_item;
    g_addr = get_group_id(0) * points_per_group + l_addr;
 
@@ -112,7 +126,17 @@ kernel void fft_stage(global float2* g_data, uint stage, uint points_per_group,
    float c, s;
    float2 input1, input2, w;
 
+#ifdef FFT_POINTS_PER_GROUP
+   points_per_group = FFT_POINTS_PER_GROUP;
+#endif
+#ifdef FFT_DIR
+   dir = FFT_DIR;
+#endif
+#ifdef FFT_LOCAL_SIZE
+   points_per_item = points_per_group/FFT_LOCAL_SIZE;
+#else
    points_per_item = points_per_group/get_local_size(0);
+#endif
    addr = (get_group_id(0) + (get_group_id(0)/stage)*stage) * (points_per_group/2) +
             get_local_id(0) * (points_per_item/2);
    N = points_per_group*(stage/2);
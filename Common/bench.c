@@ -0,0 +1,111 @@
+#include "bench.h"
+#include "error.h"
+#include "timer.h"
+#include <math.h>
+#include <stdlib.h>
+
+static int json_results;
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// nearest-rank percentile of a sorted array
+static double percentile(const double *sorted, unsigned n, double p) {
+  unsigned rank = (unsigned)ceil(p * n);
+  return sorted[rank ? rank - 1 : 0];
+}
+
+static double median(const double *sorted, unsigned n) {
+  return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0;
+}
+
+bench_stats bench_measure(bench_fn run, void *state, unsigned warmup, unsigned iterations) {
+  if (!iterations) {
+    iterations = 1;
+  }
+  for (unsigned i = 0; i < warmup; i++) {
+    run(state);
+  }
+
+  double *device_ms = malloc(iterations * sizeof(double));
+  double *host_ms = malloc(iterations * sizeof(double));
+  for (unsigned i = 0; i < iterations; i++) {
+    double start = timer_ms();
+    device_ms[i] = run(state);
+    host_ms[i] = timer_ms() - start;
+  }
+  qsort(device_ms, iterations, sizeof(double), compare_doubles);
+  qsort(host_ms, iterations, sizeof(double), compare_doubles);
+
+  bench_stats stats = {iterations, device_ms[0], median(device_ms, iterations), percentile(device_ms, iterations, 0.95),
+                       median(host_ms, iterations)};
+  free(device_ms);
+  free(host_ms);
+  return stats;
+}
+
+double bench_event_ms(cl_event first, cl_event last) {
+  cl_ulong start, end;
+  cl_int err = clWaitForEvents(1, &last);
+  err |= clGetEventProfilingInfo(first, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+  err |= clGetEventProfilingInfo(last, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+  check_error(err, "Couldn't get profiling information.");
+  clReleaseEvent(first);
+  if (last != first) {
+    clReleaseEvent(last);
+  }
+  return (end - start) / 1e6;
+}
+
+double bench_gbps(const bench_result *r) { return r->bytes && r->stats.median_ms > 0 ? r->bytes / (r->stats.median_ms * 1e6) : 0.0; }
+
+double bench_gflops(const bench_result *r) { return r->flops && r->stats.median_ms > 0 ? r->flops / (r->stats.median_ms * 1e6) : 0.0; }
+
+void bench_print_header(FILE *out) {
+  fprintf(out, "%-14s %10s %-10s %10s %10s %10s %10s %9s %9s  %s\n", "benchmark", "size", "unit", "min ms", "median ms", "p95 ms", "host ms",
+          "GB/s", "GFLOP/s", "check");
+}
+
+void bench_print_result(FILE *out, const bench_result *r) {
+  fprintf(out, "%-14s %10zu %-10s %10.4f %10.4f %10.4f %10.4f %9.2f %9.2f  %s\n", r->name, r->size, r->unit, r->stats.min_ms,
+          r->stats.median_ms, r->stats.p95_ms, r->stats.host_ms, bench_gbps(r), bench_gflops(r), r->valid ? "PASS" : "FAIL");
+}
+
+static void json_device_string(FILE *out, const char *key, cl_device_id device, cl_device_info param) {
+  char value[256] = "";
+  clGetDeviceInfo(device, param, sizeof(value), value, NULL);
+  fprintf(out, "  \"%s\": \"", key);
+  for (const char *c = value; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      fputc('\\', out);
+    }
+    fputc((unsigned char)*c < ' ' ? ' ' : *c, out);
+  }
+  fprintf(out, "\",\n");
+}
+
+void bench_json_begin(FILE *out, cl_device_id device, unsigned warmup, unsigned iterations) {
+  fprintf(out, "{\n");
+  json_device_string(out, "device", device, CL_DEVICE_NAME);
+  json_device_string(out, "vendor", device, CL_DEVICE_VENDOR);
+  json_device_string(out, "driver", device, CL_DRIVER_VERSION);
+  fprintf(out, "  \"warmup\": %u,\n  \"iterations\": %u,\n  \"results\": [", warmup, iterations);
+  json_results = 0;
+}
+
+void bench_json_result(FILE *out, const bench_result *r) {
+  fprintf(out, "%s\n    {\"benchmark\": \"%s\", \"size\": %zu, \"unit\": \"%s\", ", json_results++ ? "," : "", r->name, r->size, r->unit);
+  fprintf(out, "\"device_ms\": {\"min\": %.6f, \"median\": %.6f, \"p95\": %.6f}, \"host_ms\": {\"median\": %.6f}, ", r->stats.min_ms,
+          r->stats.median_ms, r->stats.p95_ms, r->stats.host_ms);
+  if (r->bytes) {
+    fprintf(out, "\"gbps\": %.4f, ", bench_gbps(r));
+  }
+  if (r->flops) {
+    fprintf(out, "\"gflops\": %.4f, ", bench_gflops(r));
+  }
+  fprintf(out, "\"valid\": %s}", r->valid ? "true" : "false");
+}
+
+void bench_json_end(FILE *out) { fprintf(out, "\n  ]\n}\n"); }
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <stdio.h>
+
+// Repeats a benchmark iteration and reports robust statistics instead of a single timing.
+//
+// An iteration enqueues its commands, waits for them and returns the device time taken from its profiling events
+// (bench_event_ms() does the bookkeeping). bench_measure() discards the warm-up iterations, then records device time
+// and host wall time for each timed iteration and reduces them to min/median/p95. Results can be printed as a table
+// and written as JSON for regression tracking; bandwidth and throughput are derived from the median device time.
+
+typedef struct {
+  unsigned iterations;
+  double   min_ms;    // device time of the fastest iteration
+  double   median_ms; // median device time
+  double   p95_ms;    // 95th percentile device time
+  double   host_ms;   // median host wall time of an iteration, including enqueue overhead and the final wait
+} bench_stats;
+
+typedef struct {
+  const char *name;
+  const char *unit;   // what size counts, e.g. "floats" or "matrix dim"
+  size_t      size;
+  bench_stats stats;
+  double      bytes;  // bytes moved by one iteration, 0 if bandwidth isn't meaningful
+  double      flops;  // floating-point operations of one iteration, 0 if throughput isn't meaningful
+  int         valid;  // result of the benchmark's own correctness check
+} bench_result;
+
+typedef double (*bench_fn)(void *state);
+
+// clang-format off
+bench_stats bench_measure     (bench_fn, void *state, unsigned warmup, unsigned iterations);
+double      bench_event_ms    (cl_event first, cl_event last);
+double      bench_gbps        (const bench_result *);
+double      bench_gflops      (const bench_result *);
+
+void        bench_print_header(FILE *);
+void        bench_print_result(FILE *, const bench_result *);
+void        bench_json_begin  (FILE *, cl_device_id, unsigned warmup, unsigned iterations);
+void        bench_json_result (FILE *, const bench_result *);
+void        bench_json_end    (FILE *);
@@ -0,0 +1,232 @@
+#include "buffer_pool.h"
+#include "device.h"
+#include "trace.h"
+#include <stdlib.h>
+
+#define MIN_SIZE_CLASS 256
+// requests up to CARVE_LIMIT share slabs of SLAB_SIZE bytes
+#define CARVE_LIMIT (256 * 1024)
+#define SLAB_SIZE (4 * 1024 * 1024)
+#define HOST_PTR_FLAGS (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR)
+
+typedef struct {
+  cl_mem buffer;
+  cl_mem_flags flags;
+  size_t size_class;
+  cl_mem slab; // parent of a carved sub-buffer, NULL for a standalone buffer
+  int in_use;
+} pool_entry;
+
+typedef struct {
+  cl_mem buffer;
+  cl_mem_flags flags;
+  size_t offset;
+} slab;
+
+struct buffer_pool {
+  cl_context context;
+  size_t alignment;
+  pool_entry *entries;
+  size_t num_entries, entries_capacity;
+  slab *slabs;
+  size_t num_slabs;
+  buffer_pool_stats stats;
+};
+
+static size_t size_class(size_t size) {
+  size_t result = MIN_SIZE_CLASS;
+  while (result < size) {
+    result *= 2;
+  }
+  return result;
+}
+
+buffer_pool *buffer_pool_create(cl_context context) {
+  buffer_pool *pool = calloc(1, sizeof(buffer_pool));
+  pool->context = context;
+  // sub-buffer origins have to satisfy every device of the context
+  size_t alignment = device_base_alignment(context);
+  pool->alignment = alignment > MIN_SIZE_CLASS ? alignment : MIN_SIZE_CLASS;
+  clRetainContext(context);
+  return pool;
+}
+
+static void add_resident(buffer_pool *pool, size_t bytes) {
+  pool->stats.resident_bytes += bytes;
+  if (pool->stats.resident_bytes > pool->stats.peak_resident_bytes) {
+    pool->stats.peak_resident_bytes = pool->stats.resident_bytes;
+  }
+}
+
+// returns a sub-buffer of size_class bytes from a slab with the same flags, or NULL if the slab can't be created
+static cl_mem carve(buffer_pool *pool, cl_mem_flags flags, size_t size_class, cl_mem *parent, cl_int *err) {
+  slab *s = NULL;
+  for (size_t i = 0; i < pool->num_slabs; i++) {
+    if (pool->slabs[i].flags == flags && pool->slabs[i].offset + size_class <= SLAB_SIZE) {
+      s = &pool->slabs[i];
+      break;
+    }
+  }
+  if (!s) {
+    cl_mem buffer = clCreateBuffer(pool->context, flags, SLAB_SIZE, NULL, err);
+    if (*err) {
+      return NULL;
+    }
+    pool->slabs = realloc(pool->slabs, (pool->num_slabs + 1) * sizeof(slab));
+    s = &pool->slabs[pool->num_slabs++];
+    *s = (slab){buffer, flags, 0};
+    add_resident(pool, SLAB_SIZE);
+  }
+
+  // the sub-buffer inherits the slab's flags
+  cl_buffer_region region = {s->offset, size_class};
+  cl_mem buffer = clCreateSubBuffer(s->buffer, 0, CL_BUFFER_CREATE_TYPE_REGION, &region, err);
+  if (*err) {
+    return NULL;
+  }
+  s->offset += (size_class + pool->alignment - 1) / pool->alignment * pool->alignment;
+  *parent = s->buffer;
+  pool->stats.carved++;
+  return buffer;
+}
+
+cl_mem buffer_pool_acquire(buffer_pool *pool, cl_mem_flags flags, size_t size, cl_int *err) {
+  cl_int status;
+  if (!err) {
+    err = &status;
+  }
+  if (flags & HOST_PTR_FLAGS) {
+    *err = CL_INVALID_VALUE;
+    return NULL;
+  }
+
+  size_t bytes = size_class(size);
+  for (size_t i = 0; i < pool->num_entries; i++) {
+    pool_entry *e = &pool->entries[i];
+    if (!e->in_use && e->flags == flags && e->size_class == bytes) {
+      e->in_use = 1;
+      pool->stats.hits++;
+      pool->stats.in_use_bytes += bytes;
+      *err = CL_SUCCESS;
+      return e->buffer;
+    }
+  }
+
+  cl_mem buffer, parent = NULL;
+  if (bytes <= CARVE_LIMIT) {
+    buffer = carve(pool, flags, bytes, &parent, err);
+  } else {
+    buffer = clCreateBuffer(pool->context, flags, bytes, NULL, err);
+    if (!*err) {
+      add_resident(pool, bytes);
+    }
+  }
+  if (*err) {
+    return NULL;
+  }
+
+  if (pool->num_entries == pool->entries_capacity) {
+    pool->entries_capacity = pool->entries_capacity ? 2 * pool->entries_capacity : 32;
+    pool->entries = realloc(pool->entries, pool->entries_capacity * sizeof(pool_entry));
+  }
+  pool->entries[pool->num_entries++] = (pool_entry){buffer, flags, bytes, parent, 1};
+  pool->stats.misses++;
+  pool->stats.in_use_bytes += bytes;
+  return buffer;
+}
+
+cl_mem buffer_pool_acquire_copy(buffer_pool *pool, cl_command_queue queue, cl_mem_flags flags, size_t size, const void *host_ptr,
+                                cl_int *err) {
+  cl_int status;
+  if (!err) {
+    err = &status;
+  }
+  cl_mem buffer = buffer_pool_acquire(pool, flags & ~(cl_mem_flags)CL_MEM_COPY_HOST_PTR, size, err);
+  if (!buffer) {
+    return NULL;
+  }
+  // blocking, like CL_MEM_COPY_HOST_PTR the host data may be reused as soon as this returns
+  *err = clEnqueueWriteBuffer(queue, buffer, CL_BLOCKING, 0, size, host_ptr, 0, NULL, NULL);
+  if (*err) {
+    buffer_pool_release(pool, buffer);
+    return NULL;
+  }
+  return buffer;
+}
+
+void buffer_pool_release(buffer_pool *pool, cl_mem buffer) {
+  for (size_t i = 0; i < pool->num_entries; i++) {
+    pool_entry *e = &pool->entries[i];
+    if (e->buffer == buffer && e->in_use) {
+      e->in_use = 0;
+      pool->stats.in_use_bytes -= e->size_class;
+      return;
+    }
+  }
+  fprintf(stderr, "Buffer %p doesn't belong to the pool.\n", (void *)buffer);
+}
+
+void buffer_pool_trim(buffer_pool *pool) {
+  // a slab goes once none of its sub-buffers is in use, its free sub-buffers go with it
+  size_t kept_slabs = 0;
+  for (size_t i = 0; i < pool->num_slabs; i++) {
+    cl_mem slab_buffer = pool->slabs[i].buffer;
+    int busy = 0;
+    for (size_t j = 0; j < pool->num_entries; j++) {
+      busy |= pool->entries[j].slab == slab_buffer && pool->entries[j].in_use;
+    }
+    if (busy) {
+      pool->slabs[kept_slabs++] = pool->slabs[i];
+      continue;
+    }
+    for (size_t j = 0; j < pool->num_entries; j++) {
+      if (pool->entries[j].slab == slab_buffer) {
+        clReleaseMemObject(pool->entries[j].buffer);
+        pool->entries[j].buffer = NULL;
+      }
+    }
+    clReleaseMemObject(slab_buffer);
+    pool->stats.resident_bytes -= SLAB_SIZE;
+  }
+  pool->num_slabs = kept_slabs;
+
+  // free standalone buffers go right away
+  size_t kept = 0;
+  for (size_t i = 0; i < pool->num_entries; i++) {
+    pool_entry *e = &pool->entries[i];
+    if (!e->buffer) {
+      continue;
+    }
+    if (!e->in_use && !e->slab) {
+      clReleaseMemObject(e->buffer);
+      pool->stats.resident_bytes -= e->size_class;
+      continue;
+    }
+    pool->entries[kept++] = *e;
+  }
+  pool->num_entries = kept;
+}
+
+void buffer_pool_destroy(buffer_pool *pool) {
+  for (size_t i = 0; i < pool->num_entries; i++) {
+    clReleaseMemObject(pool->entries[i].buffer);
+  }
+  for (size_t i = 0; i < pool->num_slabs; i++) {
+    clReleaseMemObject(pool->slabs[i].buffer);
+  }
+  clReleaseContext(pool->context);
+  free(pool->entries);
+  free(pool->slabs);
+  free(pool);
+}
+
+buffer_pool_stats buffer_pool_get_stats(const buffer_pool *pool) { return pool->stats; }
+
+void buffer_pool_report(const buffer_pool *pool, FILE *out) {
+  const buffer_pool_stats *s = &pool->stats;
+  unsigned long requests = s->hits + s->misses;
+  fprintf(out, "Buffer pool: %lu hit(s), %lu miss(es) (%.1f%% hit rate), %lu carved from slabs\n", s->hits, s->misses,
+          requests ? 100.0 * s->hits / requests : 0.0, s->carved);
+  fprintf(out, "  resident: %zu KiB, peak %zu KiB, in use %zu KiB\n", s->resident_bytes / 1024, s->peak_resident_bytes / 1024,
+          s->in_use_bytes / 1024);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <stdio.h>
+
+// Recycles buffers of a context instead of creating and releasing them for every batch.
+//
+// Requests are rounded up to a power-of-two size class and served from the free buffers of the same class and flags.
+// Small requests are carved out of larger slabs as sub-buffers, aligned to the devices' CL_DEVICE_MEM_BASE_ADDR_ALIGN,
+// so a workload with many small temporaries only allocates a few real buffers. Released buffers stay resident until
+// buffer_pool_trim() or buffer_pool_destroy(). Host pointer flags can't be pooled, buffer_pool_acquire_copy() replaces
+// CL_MEM_COPY_HOST_PTR with a write. The pool isn't thread-safe.
+
+typedef struct buffer_pool buffer_pool;
+
+typedef struct {
+  unsigned long hits;                // requests served by a recycled buffer
+  unsigned long misses;              // requests that needed a new buffer or sub-buffer
+  unsigned long carved;              // misses served by carving a slab
+  size_t        resident_bytes;      // slabs and standalone buffers currently allocated
+  size_t        peak_resident_bytes;
+  size_t        in_use_bytes;        // size classes handed out and not yet released
+} buffer_pool_stats;
+
+// clang-format off
+buffer_pool      *buffer_pool_create      (cl_context);
+void              buffer_pool_destroy     (buffer_pool *);
+cl_mem            buffer_pool_acquire     (buffer_pool *, cl_mem_flags, size_t size, cl_int *err);
+cl_mem            buffer_pool_acquire_copy(buffer_pool *, cl_command_queue, cl_mem_flags, size_t size, const void *host_ptr, cl_int *err);
+void              buffer_pool_release     (buffer_pool *, cl_mem);
+void              buffer_pool_trim        (buffer_pool *);
+buffer_pool_stats buffer_pool_get_stats   (const buffer_pool *);
+void              buffer_pool_report      (const buffer_pool *, FILE *);
@@ -0,0 +1,197 @@
+#include "device.h"
+#include "error.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// a GPU compute unit issues a whole SIMD of work-items per clock, a CPU compute unit is a single hardware thread
+#define GPU_LANES_PER_CU 32
+#define ACCELERATOR_LANES_PER_CU 16
+#define MIN_LOCAL_MEM (32 * 1024)
+
+typedef struct {
+  cl_device_id device;
+  cl_uint platform_index;
+  cl_uint device_index;
+  double score;
+} candidate;
+
+static int contains_ignore_case(const char *haystack, const char *needle) {
+  size_t length = strlen(needle);
+  for (; *haystack; haystack++) {
+    size_t i = 0;
+    while (i < length && tolower((unsigned char)haystack[i]) == tolower((unsigned char)needle[i])) {
+      i++;
+    }
+    if (i == length) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+double device_score(cl_device_id device) {
+  cl_bool available, compiler_available;
+  cl_device_type type;
+  cl_uint compute_units, clock_mhz, vector_width;
+  cl_ulong global_mem, local_mem;
+
+  // clang-format off
+  cl_int err = clGetDeviceInfo(device, CL_DEVICE_AVAILABLE,                 sizeof(available),          &available,          NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_COMPILER_AVAILABLE,              sizeof(compiler_available), &compiler_available, NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_TYPE,                            sizeof(type),               &type,               NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS,               sizeof(compute_units),      &compute_units,      NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_MAX_CLOCK_FREQUENCY,             sizeof(clock_mhz),          &clock_mhz,          NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_NATIVE_VECTOR_WIDTH_FLOAT,       sizeof(vector_width),       &vector_width,       NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE,                 sizeof(global_mem),         &global_mem,         NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE,                  sizeof(local_mem),          &local_mem,          NULL);
+  // clang-format on
+  if (err || !available || !compiler_available) {
+    return 0.0;
+  }
+
+  double lanes = vector_width ? vector_width : 1;
+  if (type & CL_DEVICE_TYPE_GPU) {
+    lanes = GPU_LANES_PER_CU;
+  } else if (type & CL_DEVICE_TYPE_ACCELERATOR) {
+    lanes = ACCELERATOR_LANES_PER_CU;
+  }
+  // some drivers report a clock of 0, count it as 1 MHz so the device is still usable
+  double score = (double)compute_units * (clock_mhz ? clock_mhz : 1) * lanes;
+
+  // more global memory lets bigger problems stay resident, small local memory hurts the tiled kernels
+  score *= 1.0 + log2(1.0 + global_mem / (1024.0 * 1024.0 * 1024.0)) / 8.0;
+  if (local_mem < MIN_LOCAL_MEM) {
+    score *= 0.75;
+  }
+  return score;
+}
+
+static int matches_override(const candidate *c, const char *override) {
+  if (!strcmp(override, "list")) {
+    return 1;
+  }
+
+  cl_device_type type;
+  clGetDeviceInfo(c->device, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+  if (!strcmp(override, "cpu")) {
+    return (type & CL_DEVICE_TYPE_CPU) != 0;
+  }
+  if (!strcmp(override, "gpu")) {
+    return (type & CL_DEVICE_TYPE_GPU) != 0;
+  }
+  if (!strcmp(override, "accelerator")) {
+    return (type & CL_DEVICE_TYPE_ACCELERATOR) != 0;
+  }
+
+  unsigned platform_index, device_index;
+  char tail;
+  if (sscanf(override, "%u:%u%c", &platform_index, &device_index, &tail) == 2) {
+    return c->platform_index == platform_index && c->device_index == device_index;
+  }
+
+  char name[256];
+  clGetDeviceInfo(c->device, CL_DEVICE_NAME, sizeof(name), name, NULL);
+  return contains_ignore_case(name, override);
+}
+
+// returns all devices of all platforms, the caller frees the array
+static candidate *enumerate_devices(cl_uint *num_candidates) {
+  cl_uint num_platforms;
+  cl_int err = clGetPlatformIDs(0, NULL, &num_platforms);
+  check_error(err, "Couldn't identify a platform.");
+  if (!num_platforms) {
+    fprintf(stderr, "Couldn't find any OpenCL platform, is an ICD installed?\n");
+    exit(EXIT_FAILURE);
+  }
+  cl_platform_id *platforms = malloc(num_platforms * sizeof(cl_platform_id));
+  err = clGetPlatformIDs(num_platforms, platforms, NULL);
+  check_error(err, "Couldn't identify a platform.");
+
+  candidate *candidates = NULL;
+  *num_candidates = 0;
+  for (cl_uint p = 0; p < num_platforms; p++) {
+    cl_uint num_devices;
+    if (clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, 0, NULL, &num_devices) || !num_devices) {
+      continue;
+    }
+    cl_device_id *devices = malloc(num_devices * sizeof(cl_device_id));
+    clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, num_devices, devices, NULL);
+
+    candidates = realloc(candidates, (*num_candidates + num_devices) * sizeof(candidate));
+    for (cl_uint d = 0; d < num_devices; d++) {
+      candidates[*num_candidates] = (candidate){devices[d], p, d, device_score(devices[d])};
+      (*num_candidates)++;
+    }
+    free(devices);
+  }
+
+  free(platforms);
+  return candidates;
+}
+
+void device_report(FILE *out) {
+  cl_uint num_candidates;
+  candidate *candidates = enumerate_devices(&num_candidates);
+  for (cl_uint i = 0; i < num_candidates; i++) {
+    char name[256];
+    clGetDeviceInfo(candidates[i].device, CL_DEVICE_NAME, sizeof(name), name, NULL);
+    fprintf(out, "  %u:%u  %-48s score %.0f\n", candidates[i].platform_index, candidates[i].device_index, name, candidates[i].score);
+  }
+  free(candidates);
+}
+
+cl_device_id create_device(void) {
+  const char *override = getenv("OCL_DEVICE");
+  if (override && !*override) {
+    override = NULL;
+  }
+  if (override && !strcmp(override, "list")) {
+    fprintf(stderr, "OpenCL devices:\n");
+    device_report(stderr);
+  }
+
+  cl_uint num_candidates;
+  candidate *candidates = enumerate_devices(&num_candidates);
+
+  const candidate *best = NULL;
+  for (cl_uint i = 0; i < num_candidates; i++) {
+    const candidate *c = &candidates[i];
+    if (c->score <= 0.0 || (override && !matches_override(c, override))) {
+      continue;
+    }
+    if (!best || c->score > best->score) {
+      best = c;
+    }
+  }
+
+  if (!best) {
+    fprintf(stderr, override ? "OCL_DEVICE=%s doesn't match any available device.\n" : "Couldn't access any devices.\n", override);
+    exit(EXIT_FAILURE);
+  }
+  cl_device_id device = best->device;
+  free(candidates);
+  return device;
+}
+
+size_t device_base_alignment(cl_context context) {
+  cl_uint num_devices;
+  cl_int err = clGetContextInfo(context, CL_CONTEXT_NUM_DEVICES, sizeof(num_devices), &num_devices, NULL);
+  check_error(err, "Couldn't obtain context information.");
+  cl_device_id *devices = malloc(num_devices * sizeof(cl_device_id));
+  err = clGetContextInfo(context, CL_CONTEXT_DEVICES, num_devices * sizeof(cl_device_id), devices, NULL);
+  check_error(err, "Couldn't obtain context information.");
+
+  size_t alignment = 1;
+  for (cl_uint i = 0; i < num_devices; i++) {
+    cl_uint align_bits;
+    err = clGetDeviceInfo(devices[i], CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(align_bits), &align_bits, NULL);
+    check_error(err, "Couldn't obtain device information.");
+    if (align_bits / 8 > alignment) {
+      alignment = align_bits / 8;
+    }
+  }
+  free(devices);
+  return alignment;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <stdio.h>
+
+// Picks a device from every installed platform instead of the first GPU of the first platform.
+//
+// Each available device is scored by an estimate of its peak throughput (compute units x clock x SIMD lanes),
+// adjusted for global and local memory size, and the highest score wins. The OCL_DEVICE environment variable
+// overrides the choice:
+//   OCL_DEVICE=cpu|gpu|accelerator   best device of that type
+//   OCL_DEVICE=1:0                   device 0 of platform 1
+//   OCL_DEVICE=<text>                best device whose name contains <text> (case-insensitive)
+//   OCL_DEVICE=list                  print all candidates with their scores to stderr, then pick the best
+//
+// device_base_alignment() is the strictest CL_DEVICE_MEM_BASE_ADDR_ALIGN of a context's devices, in bytes.
+
+// clang-format off
+cl_device_id create_device        (void);
+double       device_score         (cl_device_id);
+void         device_report        (FILE *);
+size_t       device_base_alignment(cl_context);
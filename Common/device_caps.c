@@ -0,0 +1,394 @@
+#include "device_caps.h"
+#include "error.h"
+#include "program_cache.h"
+#include <CL/cl_ext.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_DEVICES 32
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+static const char *type_names[CAPS_NUM_TYPES] = {"char", "short", "int", "long", "float", "double", "half"};
+
+// clang-format off
+static const cl_device_info preferred_params[CAPS_NUM_TYPES] = {
+  CL_DEVICE_PREFERRED_VECTOR_WIDTH_CHAR,  CL_DEVICE_PREFERRED_VECTOR_WIDTH_SHORT, CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT,
+  CL_DEVICE_PREFERRED_VECTOR_WIDTH_LONG,  CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE,
+  CL_DEVICE_PREFERRED_VECTOR_WIDTH_HALF};
+static const cl_device_info native_params[CAPS_NUM_TYPES] = {
+  CL_DEVICE_NATIVE_VECTOR_WIDTH_CHAR,     CL_DEVICE_NATIVE_VECTOR_WIDTH_SHORT,    CL_DEVICE_NATIVE_VECTOR_WIDTH_INT,
+  CL_DEVICE_NATIVE_VECTOR_WIDTH_LONG,     CL_DEVICE_NATIVE_VECTOR_WIDTH_FLOAT,    CL_DEVICE_NATIVE_VECTOR_WIDTH_DOUBLE,
+  CL_DEVICE_NATIVE_VECTOR_WIDTH_HALF};
+// clang-format on
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static device_caps *probed[MAX_DEVICES];
+static unsigned num_probed;
+
+int caps_has_extension(const device_caps *caps, const char *extension) {
+  size_t length = strlen(extension);
+  for (const char *p = caps->extensions; (p = strstr(p, extension)); p += length) {
+    int starts = p == caps->extensions || p[-1] == ' ';
+    if (starts && (p[length] == ' ' || p[length] == '\0')) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// only the vendor extensions report a sub-group size before a kernel exists
+static void probe_sub_groups(device_caps *caps) {
+#ifdef CL_DEVICE_SUB_GROUP_SIZES_INTEL
+  if (caps_has_extension(caps, "cl_intel_required_subgroup_size")) {
+    size_t size = 0;
+    clGetDeviceInfo(caps->device, CL_DEVICE_SUB_GROUP_SIZES_INTEL, sizeof(caps->sub_group_sizes), caps->sub_group_sizes, &size);
+    caps->num_sub_group_sizes = size / sizeof(size_t);
+    return;
+  }
+#endif
+  cl_uint width = 0;
+#ifdef CL_DEVICE_WARP_SIZE_NV
+  if (caps_has_extension(caps, "cl_nv_device_attribute_query")) {
+    clGetDeviceInfo(caps->device, CL_DEVICE_WARP_SIZE_NV, sizeof(width), &width, NULL);
+  }
+#endif
+#ifdef CL_DEVICE_WAVEFRONT_WIDTH_AMD
+  if (caps_has_extension(caps, "cl_amd_device_attribute_query")) {
+    clGetDeviceInfo(caps->device, CL_DEVICE_WAVEFRONT_WIDTH_AMD, sizeof(width), &width, NULL);
+  }
+#endif
+  if (width) {
+    caps->sub_group_sizes[0] = width;
+    caps->num_sub_group_sizes = 1;
+  }
+}
+
+// OpenCL C 2.0 made the collectives core, 3.0 made them optional again
+static void probe_collectives(device_caps *caps) {
+  int major = 1;
+  sscanf(caps->version, "OpenCL %d.", &major);
+  if (major < 2) {
+    return;
+  }
+  snprintf(caps->cl_std, sizeof(caps->cl_std), "CL%d.0", major >= 3 ? 3 : 2);
+  caps->work_group_collectives = major == 2;
+  // 2.1 and 2.2 have core sub-groups in the API, but OpenCL C 2.0 only declares the builtins with the extension
+  caps->sub_groups = caps_has_extension(caps, "cl_khr_subgroups");
+#ifdef CL_VERSION_3_0
+  if (major >= 3) {
+    cl_bool supported = CL_FALSE;
+    cl_uint max_sub_groups = 0;
+    clGetDeviceInfo(caps->device, CL_DEVICE_WORK_GROUP_COLLECTIVE_FUNCTIONS_SUPPORT, sizeof(supported), &supported, NULL);
+    clGetDeviceInfo(caps->device, CL_DEVICE_MAX_NUM_SUB_GROUPS, sizeof(max_sub_groups), &max_sub_groups, NULL);
+    caps->work_group_collectives = supported;
+    caps->sub_groups |= max_sub_groups > 0;
+  }
+#endif
+}
+
+static device_caps *probe(cl_device_id device) {
+  device_caps *caps = calloc(1, sizeof(device_caps));
+  caps->device = device;
+
+  // clang-format off
+  cl_int err = clGetDeviceInfo(device, CL_DEVICE_NAME,                sizeof(caps->name),                caps->name,                 NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_VENDOR,                    sizeof(caps->vendor),              caps->vendor,               NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_VERSION,                   sizeof(caps->version),             caps->version,              NULL);
+  err |= clGetDeviceInfo(device, CL_DRIVER_VERSION,                   sizeof(caps->driver),              caps->driver,               NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_TYPE,                      sizeof(caps->type),                &caps->type,                NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS,         sizeof(caps->compute_units),       &caps->compute_units,       NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_MAX_CLOCK_FREQUENCY,       sizeof(caps->clock_mhz),           &caps->clock_mhz,           NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE,           sizeof(caps->global_mem),          &caps->global_mem,          NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE,            sizeof(caps->local_mem),           &caps->local_mem,           NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE,        sizeof(caps->max_alloc),           &caps->max_alloc,           NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE,       sizeof(caps->max_work_group_size), &caps->max_work_group_size, NULL);
+  // clang-format on
+  for (int t = 0; t < CAPS_NUM_TYPES; t++) {
+    err |= clGetDeviceInfo(device, preferred_params[t], sizeof(cl_uint), &caps->preferred_width[t], NULL);
+    err |= clGetDeviceInfo(device, native_params[t], sizeof(cl_uint), &caps->native_width[t], NULL);
+  }
+  check_error(err, "Couldn't probe the device capabilities.");
+
+  size_t size;
+  clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, NULL, &size);
+  caps->extensions = calloc(size + 1, 1);
+  clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, size, caps->extensions, NULL);
+
+  // OpenCL 3.0 devices may support doubles without listing the extension, the FP config is what counts
+  cl_device_fp_config fp64_config = 0;
+  clGetDeviceInfo(device, CL_DEVICE_DOUBLE_FP_CONFIG, sizeof(fp64_config), &fp64_config, NULL);
+  caps->fp64 = fp64_config != 0 || caps_has_extension(caps, "cl_khr_fp64");
+  caps->fp16 = caps_has_extension(caps, "cl_khr_fp16");
+  probe_sub_groups(caps);
+  probe_collectives(caps);
+  return caps;
+}
+
+static void write_string(FILE *out, const char *value) {
+  fputc('"', out);
+  for (const char *c = value; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      fputc('\\', out);
+    }
+    fputc((unsigned char)*c < ' ' ? ' ' : *c, out);
+  }
+  fputc('"', out);
+}
+
+static void write_widths(FILE *out, const char *indent, const char *key, const cl_uint *widths) {
+  fprintf(out, "%s  \"%s\": [", indent, key);
+  for (int t = 0; t < CAPS_NUM_TYPES; t++) {
+    fprintf(out, "%s%u", t ? ", " : "", widths[t]);
+  }
+  fprintf(out, "],\n");
+}
+
+void device_caps_write_json(const device_caps *caps, FILE *out, const char *indent) {
+  const char *type = caps->type & CL_DEVICE_TYPE_GPU ? "gpu" : caps->type & CL_DEVICE_TYPE_CPU ? "cpu" : "accelerator";
+  const char *strings[][2] = {{"name", caps->name}, {"vendor", caps->vendor}, {"version", caps->version}, {"driver", caps->driver}, {"type", type}};
+  fprintf(out, "%s{\n", indent);
+  for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+    fprintf(out, "%s  \"%s\": ", indent, strings[i][0]);
+    write_string(out, strings[i][1]);
+    fprintf(out, ",\n");
+  }
+  fprintf(out, "%s  \"compute_units\": %u,\n%s  \"clock_mhz\": %u,\n", indent, caps->compute_units, indent, caps->clock_mhz);
+  fprintf(out, "%s  \"vector_types\": [", indent);
+  for (int t = 0; t < CAPS_NUM_TYPES; t++) {
+    fprintf(out, "%s\"%s\"", t ? ", " : "", type_names[t]);
+  }
+  fprintf(out, "],\n");
+  write_widths(out, indent, "preferred_width", caps->preferred_width);
+  write_widths(out, indent, "native_width", caps->native_width);
+  fprintf(out, "%s  \"fp64\": %d,\n%s  \"fp16\": %d,\n", indent, caps->fp64, indent, caps->fp16);
+  fprintf(out, "%s  \"global_mem\": %llu,\n%s  \"local_mem\": %llu,\n%s  \"max_alloc\": %llu,\n", indent, (unsigned long long)caps->global_mem,
+          indent, (unsigned long long)caps->local_mem, indent, (unsigned long long)caps->max_alloc);
+  fprintf(out, "%s  \"max_work_group_size\": %zu,\n%s  \"sub_group_sizes\": [", indent, caps->max_work_group_size, indent);
+  for (unsigned i = 0; i < caps->num_sub_group_sizes; i++) {
+    fprintf(out, "%s%zu", i ? ", " : "", caps->sub_group_sizes[i]);
+  }
+  fprintf(out, "],\n%s  \"cl_std\": ", indent);
+  write_string(out, caps->cl_std);
+  fprintf(out, ",\n%s  \"work_group_collectives\": %d,\n%s  \"sub_groups\": %d,\n", indent, caps->work_group_collectives, indent,
+          caps->sub_groups);
+  fprintf(out, "%s  \"extensions\": ", indent);
+  write_string(out, caps->extensions);
+  fprintf(out, "\n%s}", indent);
+}
+
+/* Reading a profile back: only the flat layout device_caps_write_json() produces */
+
+static const char *json_value(const char *json, const char *key) {
+  char pattern[64];
+  snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+  const char *p = strstr(json, pattern);
+  if (!p) {
+    return NULL;
+  }
+  for (p += strlen(pattern); isspace((unsigned char)*p); p++) {
+  }
+  return p;
+}
+
+static void json_string(const char *json, const char *key, char *value, size_t size) {
+  const char *p = json_value(json, key);
+  if (!p || *p != '"') {
+    return;
+  }
+  size_t n = 0;
+  for (p++; *p && *p != '"' && n + 1 < size; p++) {
+    if (*p == '\\' && p[1]) {
+      p++;
+    }
+    value[n++] = *p;
+  }
+  value[n] = '\0';
+}
+
+static void json_number(const char *json, const char *key, unsigned long long *value) {
+  const char *p = json_value(json, key);
+  if (p && isdigit((unsigned char)*p)) {
+    *value = strtoull(p, NULL, 10);
+  }
+}
+
+// returns how many numbers the array held, up to max
+static unsigned json_numbers(const char *json, const char *key, unsigned long long *values, unsigned max) {
+  const char *p = json_value(json, key);
+  unsigned n = 0;
+  if (!p || *p != '[') {
+    return 0;
+  }
+  for (p++; *p && *p != ']' && n < max;) {
+    char *end;
+    unsigned long long value = strtoull(p, &end, 10);
+    if (end == p) {
+      p++;
+      continue;
+    }
+    values[n++] = value;
+    p = end;
+  }
+  return n;
+}
+
+static char *read_file(const char *path) {
+  FILE *handle = fopen(path, "rb");
+  if (!handle) {
+    return NULL;
+  }
+  fseek(handle, 0, SEEK_END);
+  size_t size = ftell(handle);
+  rewind(handle);
+  char *text = calloc(size + 1, 1);
+  if (fread(text, 1, size, handle) != size) {
+    free(text);
+    text = NULL;
+  }
+  fclose(handle);
+  return text;
+}
+
+static void load_profile(device_caps *caps, const char *path) {
+  char *json = read_file(path);
+  if (!json) {
+    fprintf(stderr, "Couldn't read the device profile %s, using the probed capabilities.\n", path);
+    return;
+  }
+  json_string(json, "name", caps->name, sizeof(caps->name));
+  json_string(json, "vendor", caps->vendor, sizeof(caps->vendor));
+  json_string(json, "version", caps->version, sizeof(caps->version));
+  json_string(json, "driver", caps->driver, sizeof(caps->driver));
+  json_string(json, "cl_std", caps->cl_std, sizeof(caps->cl_std));
+
+  unsigned long long value, values[CAPS_MAX_SUB_GROUP_SIZES > CAPS_NUM_TYPES ? CAPS_MAX_SUB_GROUP_SIZES : CAPS_NUM_TYPES];
+  // clang-format off
+  value = caps->compute_units;          json_number(json, "compute_units", &value);          caps->compute_units = value;
+  value = caps->clock_mhz;              json_number(json, "clock_mhz", &value);              caps->clock_mhz = value;
+  value = caps->fp64;                   json_number(json, "fp64", &value);                   caps->fp64 = value != 0;
+  value = caps->fp16;                   json_number(json, "fp16", &value);                   caps->fp16 = value != 0;
+  value = caps->global_mem;             json_number(json, "global_mem", &value);             caps->global_mem = value;
+  value = caps->local_mem;              json_number(json, "local_mem", &value);              caps->local_mem = value;
+  value = caps->max_alloc;              json_number(json, "max_alloc", &value);              caps->max_alloc = value;
+  value = caps->max_work_group_size;    json_number(json, "max_work_group_size", &value);    caps->max_work_group_size = value;
+  value = caps->work_group_collectives; json_number(json, "work_group_collectives", &value); caps->work_group_collectives = value != 0;
+  value = caps->sub_groups;             json_number(json, "sub_groups", &value);             caps->sub_groups = value != 0;
+  // clang-format on
+  if (json_numbers(json, "preferred_width", values, CAPS_NUM_TYPES) == CAPS_NUM_TYPES) {
+    for (int t = 0; t < CAPS_NUM_TYPES; t++) {
+      caps->preferred_width[t] = values[t];
+    }
+  }
+  if (json_numbers(json, "native_width", values, CAPS_NUM_TYPES) == CAPS_NUM_TYPES) {
+    for (int t = 0; t < CAPS_NUM_TYPES; t++) {
+      caps->native_width[t] = values[t];
+    }
+  }
+  caps->num_sub_group_sizes = json_numbers(json, "sub_group_sizes", values, CAPS_MAX_SUB_GROUP_SIZES);
+  for (unsigned i = 0; i < caps->num_sub_group_sizes; i++) {
+    caps->sub_group_sizes[i] = values[i];
+  }
+
+  const char *extensions = json_value(json, "extensions");
+  if (extensions && *extensions == '"') {
+    free(caps->extensions);
+    caps->extensions = calloc(strlen(extensions), 1);
+    json_string(json, "extensions", caps->extensions, strlen(extensions));
+  }
+  free(json);
+}
+
+/* Persisting the profile next to the cached binaries */
+
+static uint64_t fnv1a(uint64_t hash, const char *text) {
+  for (; *text; text++) {
+    hash ^= (unsigned char)*text;
+    hash *= FNV_PRIME;
+  }
+  hash ^= 0xff;
+  return hash * FNV_PRIME;
+}
+
+// the identity fixes the capabilities, so an existing profile is left alone
+static void save_profile(const device_caps *caps) {
+  const char *dir = program_cache_dir();
+  if (!dir) {
+    return;
+  }
+  char name[64];
+  size_t n = 0;
+  for (const char *c = caps->name; *c && n + 1 < sizeof(name); c++) {
+    if (isalnum((unsigned char)*c)) {
+      name[n++] = tolower((unsigned char)*c);
+    } else if (n && name[n - 1] != '_') {
+      name[n++] = '_';
+    }
+  }
+  name[n] = '\0';
+  uint64_t hash = fnv1a(fnv1a(fnv1a(fnv1a(FNV_OFFSET, caps->name), caps->vendor), caps->version), caps->driver);
+
+  char path[4352];
+  snprintf(path, sizeof(path), "%s/caps-%s-%016llx.json", dir, name, (unsigned long long)hash);
+  FILE *existing = fopen(path, "r");
+  if (existing) {
+    fclose(existing);
+    return;
+  }
+  FILE *out = fopen(path, "w");
+  if (out) {
+    device_caps_write_json(caps, out, "");
+    fprintf(out, "\n");
+    fclose(out);
+  }
+}
+
+const device_caps *device_caps_get(cl_device_id device) {
+  pthread_mutex_lock(&lock);
+  device_caps *caps = NULL;
+  for (unsigned i = 0; i < num_probed && !caps; i++) {
+    caps = probed[i]->device == device ? probed[i] : NULL;
+  }
+  if (!caps) {
+    caps = probe(device);
+    save_profile(caps);
+    const char *profile = getenv("OCL_CAPS");
+    if (profile && *profile) {
+      load_profile(caps, profile);
+    }
+    // past the table's size the profile is still returned, it's just probed again next time
+    if (num_probed < MAX_DEVICES) {
+      probed[num_probed++] = caps;
+    }
+  }
+  pthread_mutex_unlock(&lock);
+  return caps;
+}
+
+/* Selection */
+
+unsigned caps_vector_width(const device_caps *caps, caps_type type, unsigned min_width) {
+  unsigned width = caps->preferred_width[type];
+  unsigned result = 1;
+  while (result * 2 <= width && result < 16) {
+    result *= 2;
+  }
+  while (result < min_width && result < 16) {
+    result *= 2;
+  }
+  return result;
+}
+
+const char *caps_real_type(const device_caps *caps, int prefer_double) { return prefer_double && caps->fp64 ? "double" : "float"; }
+
+size_t caps_local_pow2(const device_caps *caps, size_t element_size, size_t reserve) {
+  size_t available = caps->local_mem > reserve ? caps->local_mem - reserve : 0;
+  size_t count = 1;
+  while (2 * count * element_size <= available) {
+    count *= 2;
+  }
+  return count;
+}
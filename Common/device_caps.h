@@ -0,0 +1,54 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <stdio.h>
+
+// Everything kernel variant selection needs to know about a device, gathered once.
+//
+// device_caps_get() probes the device the first time it is asked for and keeps the result for the run. The profile is
+// also written as JSON to caps-<name>-<hash>.json in the program cache directory (see program_cache.h), so the
+// capabilities of every device a machine has run on can be compared later; oclProbe writes the same profile for every
+// installed device. OCL_CAPS=<file.json> loads such a profile over the probed values, which lets a host make the
+// choices it would make on another device.
+//
+// The selection helpers turn the profile into the choices hosts used to hard-code: caps_vector_width() the width of a
+// vector type (float4 vs float8/16), caps_real_type() double or float, caps_local_pow2() how many elements a
+// power-of-two local-memory tile can hold. work_group_collectives and sub_groups say whether kernels built with
+// -cl-std=<cl_std> may use the collective builtins; on OpenCL 3.0 devices both are optional features.
+
+#define CAPS_MAX_SUB_GROUP_SIZES 8
+
+typedef enum { CAPS_CHAR, CAPS_SHORT, CAPS_INT, CAPS_LONG, CAPS_FLOAT, CAPS_DOUBLE, CAPS_HALF, CAPS_NUM_TYPES } caps_type;
+
+typedef struct {
+  cl_device_id   device;
+  char           name[256];
+  char           vendor[256];
+  char           version[128];
+  char           driver[128];
+  cl_device_type type;
+  cl_uint        compute_units;
+  cl_uint        clock_mhz;
+  cl_uint        preferred_width[CAPS_NUM_TYPES];
+  cl_uint        native_width[CAPS_NUM_TYPES];
+  int            fp64;
+  int            fp16;
+  cl_ulong       global_mem;
+  cl_ulong       local_mem;
+  cl_ulong       max_alloc;
+  size_t         max_work_group_size;
+  size_t         sub_group_sizes[CAPS_MAX_SUB_GROUP_SIZES]; // as reported by the vendor extensions, empty if none does
+  unsigned       num_sub_group_sizes;
+  char           cl_std[8];              // -cl-std value for OpenCL C 2.0 kernels, empty on 1.x devices
+  int            work_group_collectives; // work_group_reduce_* and friends
+  int            sub_groups;             // sub_group_reduce_* and friends, cl_khr_subgroups or 3.0's feature
+  char          *extensions;
+} device_caps;
+
+// clang-format off
+const device_caps *device_caps_get       (cl_device_id);
+void               device_caps_write_json(const device_caps *, FILE *, const char *indent);
+int                caps_has_extension    (const device_caps *, const char *extension);
+unsigned           caps_vector_width     (const device_caps *, caps_type, unsigned min_width); // a power of two, at most 16
+const char        *caps_real_type        (const device_caps *, int prefer_double);
+size_t             caps_local_pow2       (const device_caps *, size_t element_size, size_t reserve);
@@ -0,0 +1,159 @@
+#include "device_group.h"
+#include "device.h"
+#include "error.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_MEMBERS 64
+
+// other available devices of the same platform and type, the chosen device first
+static unsigned same_type_devices(cl_device_id device, cl_device_id *devices) {
+  cl_platform_id platform;
+  cl_device_type type;
+  cl_int err = clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+  check_error(err, "Couldn't obtain device information.");
+
+  cl_device_id found[MAX_MEMBERS];
+  cl_uint num_found;
+  if (clGetDeviceIDs(platform, type, MAX_MEMBERS, found, &num_found)) {
+    num_found = 0;
+  }
+  if (num_found > MAX_MEMBERS) {
+    num_found = MAX_MEMBERS;
+  }
+
+  unsigned n = 0;
+  devices[n++] = device;
+  for (cl_uint i = 0; i < num_found; i++) {
+    cl_bool available;
+    clGetDeviceInfo(found[i], CL_DEVICE_AVAILABLE, sizeof(available), &available, NULL);
+    if (found[i] != device && available && device_score(found[i]) > 0.0) {
+      devices[n++] = found[i];
+    }
+  }
+  return n;
+}
+
+static unsigned sub_devices(cl_device_id device, const cl_device_partition_property *properties, cl_device_id *devices) {
+  cl_uint n;
+  if (clCreateSubDevices(device, properties, MAX_MEMBERS, devices, &n) || n < 1) {
+    return 0;
+  }
+  return n > MAX_MEMBERS ? MAX_MEMBERS : n;
+}
+
+static unsigned numa_devices(cl_device_id device, cl_device_id *devices) {
+  cl_device_partition_property properties[] = {CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, CL_DEVICE_AFFINITY_DOMAIN_NUMA, 0};
+  return sub_devices(device, properties, devices);
+}
+
+static int is_cpu(cl_device_id device) {
+  cl_device_type type;
+  clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+  return (type & CL_DEVICE_TYPE_CPU) != 0;
+}
+
+device_group *device_group_create(cl_device_id device, const cl_queue_properties *properties) {
+  const char *mode = getenv("OCL_PARTITION");
+  if (!mode || !*mode) {
+    mode = "auto";
+  }
+
+  cl_device_id devices[MAX_MEMBERS];
+  unsigned n = 0, compute_units;
+  int partitioned = 0;
+  if (!strcmp(mode, "auto")) {
+    n = same_type_devices(device, devices);
+    // a lone CPU device is split by NUMA node, unless there's only one
+    if (n == 1 && is_cpu(device)) {
+      n = numa_devices(device, devices);
+      partitioned = n > 1;
+      if (n == 1) {
+        clReleaseDevice(devices[0]);
+      }
+    }
+  } else if (!strcmp(mode, "devices")) {
+    n = same_type_devices(device, devices);
+  } else if (!strcmp(mode, "numa")) {
+    n = numa_devices(device, devices);
+    partitioned = n > 0;
+  } else if (sscanf(mode, "equally:%u", &compute_units) == 1 && compute_units) {
+    cl_device_partition_property equally[] = {CL_DEVICE_PARTITION_EQUALLY, compute_units, 0};
+    n = sub_devices(device, equally, devices);
+    partitioned = n > 0;
+  } else if (strcmp(mode, "none")) {
+    fprintf(stderr, "Unknown OCL_PARTITION=%s, using the device alone.\n", mode);
+    mode = "none";
+  }
+  if (!partitioned && n <= 1) {
+    if (!n && strcmp(mode, "none") && strcmp(mode, "auto")) {
+      fprintf(stderr, "The device can't be partitioned with OCL_PARTITION=%s, using it alone.\n", mode);
+    }
+    devices[0] = device;
+    n = 1;
+  }
+
+  cl_int err;
+  device_group *group = calloc(1, sizeof(device_group));
+  group->context = clCreateContext(NULL, n, devices, NULL, NULL, &err);
+  check_error(err, "Couldn't create a context.");
+  group->num_members = n;
+  group->members = calloc(n, sizeof(group_member));
+  group->sub_devices = partitioned;
+
+  double total_score = 0.0;
+  for (unsigned i = 0; i < n; i++) {
+    group_member *m = &group->members[i];
+    m->device = devices[i];
+    m->queue = clCreateCommandQueueWithProperties(group->context, devices[i], properties, &err);
+    check_error(err, "Couldn't create a command queue.");
+    m->weight = device_score(devices[i]);
+    total_score += m->weight;
+  }
+  for (unsigned i = 0; i < n; i++) {
+    group->members[i].weight = total_score > 0.0 ? group->members[i].weight / total_score : 1.0 / n;
+  }
+  return group;
+}
+
+void device_group_destroy(device_group *group) {
+  for (unsigned i = 0; i < group->num_members; i++) {
+    clReleaseCommandQueue(group->members[i].queue);
+    if (group->sub_devices) {
+      clReleaseDevice(group->members[i].device);
+    }
+  }
+  clReleaseContext(group->context);
+  free(group->members);
+  free(group);
+}
+
+void device_group_split(const device_group *group, size_t total, size_t granularity, size_t *offsets, size_t *counts) {
+  size_t offset = 0;
+  for (unsigned i = 0; i < group->num_members; i++) {
+    // the last member takes what rounding left over
+    size_t count = total - offset;
+    if (i + 1 < group->num_members) {
+      count = (size_t)(total * group->members[i].weight) / granularity * granularity;
+      if (count > total - offset) {
+        count = total - offset;
+      }
+    }
+    offsets[i] = offset;
+    counts[i] = count;
+    offset += count;
+  }
+}
+
+void device_group_report(const device_group *group, FILE *out) {
+  fprintf(out, "Device group: %u %s\n", group->num_members, group->sub_devices ? "sub-device(s)" : "device(s)");
+  for (unsigned i = 0; i < group->num_members; i++) {
+    char name[256] = "";
+    cl_uint compute_units = 0;
+    clGetDeviceInfo(group->members[i].device, CL_DEVICE_NAME, sizeof(name), name, NULL);
+    clGetDeviceInfo(group->members[i].device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(compute_units), &compute_units, NULL);
+    fprintf(out, "  %u: %s, %u compute unit(s), %.1f%% of the work\n", i, name, compute_units, 100.0 * group->members[i].weight);
+  }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <stdio.h>
+
+// Spreads one workload over several devices or over the sub-devices of one device.
+//
+// device_group_create() starts from the chosen device. When its platform has further devices of the same type they
+// join it in one context, otherwise a CPU device is split into sub-devices per NUMA node, so every member's work stays
+// on memory close to its cores. OCL_PARTITION overrides the choice:
+//   OCL_PARTITION=none        just the device itself
+//   OCL_PARTITION=devices     every available device of the same type and platform
+//   OCL_PARTITION=numa        sub-devices by NUMA affinity domain
+//   OCL_PARTITION=equally:N   sub-devices of N compute units each
+// A partitioning the device doesn't support falls back to the device itself. Each member has its own in-order queue
+// and a weight from device_score(); device_group_split() cuts a range of work items into per-member shares by weight.
+// Programs have to be built per member, since build_program() targets a single device.
+
+typedef struct {
+  cl_device_id device;
+  cl_command_queue queue;
+  double weight; // share of the work, the weights add up to 1
+} group_member;
+
+typedef struct {
+  cl_context context;
+  unsigned num_members;
+  group_member *members;
+  int sub_devices; // the members are sub-devices of one device
+} device_group;
+
+// clang-format off
+device_group *device_group_create (cl_device_id, const cl_queue_properties *);
+void          device_group_destroy(device_group *);
+void          device_group_split  (const device_group *, size_t total, size_t granularity, size_t *offsets, size_t *counts);
+void          device_group_report (const device_group *, FILE *);
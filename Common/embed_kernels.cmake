@@ -0,0 +1,56 @@
+# Writes OUTPUT, a C file that registers the KERNELS (separated by |) with the program cache before main() runs.
+# With CLANG and LLVM_SPIRV set every kernel is also compiled to SPIR-V; a kernel that doesn't compile is embedded as
+# source only, the runtime build reports its errors.
+
+string(REPLACE "|" ";" KERNELS "${KERNELS}")
+get_filename_component(dir ${OUTPUT} DIRECTORY)
+
+function(c_bytes file variable)
+  file(READ ${file} hex HEX)
+  string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+  set(${variable} "${bytes}" PARENT_SCOPE)
+endfunction()
+
+set(arrays "")
+set(entries "")
+set(index 0)
+foreach(kernel ${KERNELS})
+  get_filename_component(name ${kernel} NAME)
+  file(SIZE ${kernel} size)
+  c_bytes(${kernel} bytes)
+  string(APPEND arrays "static const char source_${index}[] = {${bytes}0x00};\n")
+
+  set(il "NULL, 0")
+  if(CLANG AND LLVM_SPIRV)
+    set(bc ${dir}/${name}.bc)
+    set(spv ${dir}/${name}.spv)
+    execute_process(
+      COMMAND ${CLANG} -c -x cl -cl-std=CL1.2 -target spir64 -emit-llvm -O2 -Xclang -finclude-default-header -o ${bc} ${kernel}
+      RESULT_VARIABLE result ERROR_VARIABLE errors)
+    if(NOT result)
+      execute_process(COMMAND ${LLVM_SPIRV} ${bc} -o ${spv} RESULT_VARIABLE result ERROR_VARIABLE errors)
+    endif()
+    if(result)
+      message(WARNING "${name} couldn't be compiled to SPIR-V, embedding the source only:\n${errors}")
+    else()
+      file(SIZE ${spv} il_size)
+      c_bytes(${spv} il_bytes)
+      string(APPEND arrays "static const unsigned char il_${index}[] = {${il_bytes}};\n")
+      set(il "il_${index}, ${il_size}")
+    endif()
+  endif()
+
+  string(APPEND entries "  {\"${name}\", source_${index}, ${size}, ${il}},\n")
+  math(EXPR index "${index} + 1")
+endforeach()
+
+file(WRITE ${OUTPUT} "// Generated by embed_kernels.cmake, do not edit.
+#include \"program_cache.h\"
+#include <stddef.h>
+
+${arrays}
+static const embedded_program programs[] = {
+${entries}};
+
+__attribute__((constructor)) static void embed_programs(void) { program_cache_embed(programs, sizeof(programs) / sizeof(programs[0])); }
+")
@@ -0,0 +1,88 @@
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ERROR_NAME(code) \
+  case code:             \
+    return #code;
+
+const char *error_name(cl_int err) {
+  switch (err) {
+    ERROR_NAME(CL_SUCCESS)
+    ERROR_NAME(CL_DEVICE_NOT_FOUND)
+    ERROR_NAME(CL_DEVICE_NOT_AVAILABLE)
+    ERROR_NAME(CL_COMPILER_NOT_AVAILABLE)
+    ERROR_NAME(CL_MEM_OBJECT_ALLOCATION_FAILURE)
+    ERROR_NAME(CL_OUT_OF_RESOURCES)
+    ERROR_NAME(CL_OUT_OF_HOST_MEMORY)
+    ERROR_NAME(CL_PROFILING_INFO_NOT_AVAILABLE)
+    ERROR_NAME(CL_MEM_COPY_OVERLAP)
+    ERROR_NAME(CL_IMAGE_FORMAT_MISMATCH)
+    ERROR_NAME(CL_IMAGE_FORMAT_NOT_SUPPORTED)
+    ERROR_NAME(CL_BUILD_PROGRAM_FAILURE)
+    ERROR_NAME(CL_MAP_FAILURE)
+    ERROR_NAME(CL_MISALIGNED_SUB_BUFFER_OFFSET)
+    ERROR_NAME(CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST)
+    ERROR_NAME(CL_COMPILE_PROGRAM_FAILURE)
+    ERROR_NAME(CL_LINKER_NOT_AVAILABLE)
+    ERROR_NAME(CL_LINK_PROGRAM_FAILURE)
+    ERROR_NAME(CL_DEVICE_PARTITION_FAILED)
+    ERROR_NAME(CL_KERNEL_ARG_INFO_NOT_AVAILABLE)
+    ERROR_NAME(CL_INVALID_VALUE)
+    ERROR_NAME(CL_INVALID_DEVICE_TYPE)
+    ERROR_NAME(CL_INVALID_PLATFORM)
+    ERROR_NAME(CL_INVALID_DEVICE)
+    ERROR_NAME(CL_INVALID_CONTEXT)
+    ERROR_NAME(CL_INVALID_QUEUE_PROPERTIES)
+    ERROR_NAME(CL_INVALID_COMMAND_QUEUE)
+    ERROR_NAME(CL_INVALID_HOST_PTR)
+    ERROR_NAME(CL_INVALID_MEM_OBJECT)
+    ERROR_NAME(CL_INVALID_IMAGE_FORMAT_DESCRIPTOR)
+    ERROR_NAME(CL_INVALID_IMAGE_SIZE)
+    ERROR_NAME(CL_INVALID_SAMPLER)
+    ERROR_NAME(CL_INVALID_BINARY)
+    ERROR_NAME(CL_INVALID_BUILD_OPTIONS)
+    ERROR_NAME(CL_INVALID_PROGRAM)
+    ERROR_NAME(CL_INVALID_PROGRAM_EXECUTABLE)
+    ERROR_NAME(CL_INVALID_KERNEL_NAME)
+    ERROR_NAME(CL_INVALID_KERNEL_DEFINITION)
+    ERROR_NAME(CL_INVALID_KERNEL)
+    ERROR_NAME(CL_INVALID_ARG_INDEX)
+    ERROR_NAME(CL_INVALID_ARG_VALUE)
+    ERROR_NAME(CL_INVALID_ARG_SIZE)
+    ERROR_NAME(CL_INVALID_KERNEL_ARGS)
+    ERROR_NAME(CL_INVALID_WORK_DIMENSION)
+    ERROR_NAME(CL_INVALID_WORK_GROUP_SIZE)
+    ERROR_NAME(CL_INVALID_WORK_ITEM_SIZE)
+    ERROR_NAME(CL_INVALID_GLOBAL_OFFSET)
+    ERROR_NAME(CL_INVALID_EVENT_WAIT_LIST)
+    ERROR_NAME(CL_INVALID_EVENT)
+    ERROR_NAME(CL_INVALID_OPERATION)
+    ERROR_NAME(CL_INVALID_GL_OBJECT)
+    ERROR_NAME(CL_INVALID_BUFFER_SIZE)
+    ERROR_NAME(CL_INVALID_MIP_LEVEL)
+    ERROR_NAME(CL_INVALID_GLOBAL_WORK_SIZE)
+    ERROR_NAME(CL_INVALID_PROPERTY)
+    ERROR_NAME(CL_INVALID_IMAGE_DESCRIPTOR)
+    ERROR_NAME(CL_INVALID_COMPILER_OPTIONS)
+    ERROR_NAME(CL_INVALID_LINKER_OPTIONS)
+    ERROR_NAME(CL_INVALID_DEVICE_PARTITION_COUNT)
+#ifdef CL_VERSION_2_0
+    ERROR_NAME(CL_INVALID_PIPE_SIZE)
+    ERROR_NAME(CL_INVALID_DEVICE_QUEUE)
+#endif
+#ifdef CL_VERSION_2_2
+    ERROR_NAME(CL_INVALID_SPEC_ID)
+    ERROR_NAME(CL_MAX_SIZE_RESTRICTION_EXCEEDED)
+#endif
+  default:
+    return "CL_ERROR";
+  }
+}
+
+void check_error(cl_int err, const char *message) {
+  if (err) {
+    fprintf(stderr, "%s\nError: %s (%d)\n", message, error_name(err), err);
+    exit(EXIT_FAILURE);
+  }
+}
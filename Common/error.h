@@ -0,0 +1,11 @@
+#pragma once
+
+#include <CL/cl.h>
+
+// check_error() prints message with the name and number of the error code and exits if err is not CL_SUCCESS, so
+// that a sample can check every call on the same line. error_name() is the CL_* name of an error code, "CL_ERROR"
+// for codes the table doesn't know, like the vendor extensions' ones.
+
+// clang-format off
+void        check_error(cl_int err, const char *message);
+const char *error_name (cl_int err);
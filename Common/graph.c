@@ -0,0 +1,375 @@
+#include "graph.h"
+#include "error.h"
+#include "trace.h"
+#include <CL/cl_ext.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_SLOT ((unsigned)-1)
+
+typedef struct {
+  cl_uint index;
+  size_t size;
+  unsigned slot;   // NO_SLOT for a value
+  size_t offset;   // of the value in the graph's value store, unused for slots and local memory
+  int has_value;
+} graph_arg_entry;
+
+typedef struct {
+  cl_kernel kernel;
+  cl_uint work_dim;
+  size_t global_size[3], local_size[3];
+  int has_local_size;
+  unsigned first_arg, num_args; // into the graph's args
+} graph_command;
+
+// the arguments recorded for one kernel so far, dirty ones go with its next launch
+typedef struct {
+  cl_kernel kernel;
+  int launched;
+  unsigned num_args;
+  graph_arg_entry *args;
+  int *dirty;
+} graph_kernel;
+
+#ifdef cl_khr_command_buffer
+typedef struct {
+  cl_command_buffer_khr buffer;
+  cl_mem bound[GRAPH_MAX_SLOTS]; // retained while the recording exists, so a handle can't be recycled under it
+  cl_event last;
+} recording;
+#endif
+
+struct command_graph {
+  cl_command_queue queue;
+  graph_command *commands;
+  unsigned num_commands, max_commands;
+  graph_arg_entry *args;
+  unsigned num_args, max_args;
+  unsigned char *values;
+  size_t values_size, max_values_size;
+  graph_kernel *kernels;
+  unsigned num_kernels;
+  cl_mem bindings[GRAPH_MAX_SLOTS];
+  int finalized;
+
+#ifdef cl_khr_command_buffer
+  int use_command_buffer, simultaneous_use;
+  clCreateCommandBufferKHR_fn create_buffer;
+  clCommandNDRangeKernelKHR_fn command_ndrange;
+  clFinalizeCommandBufferKHR_fn finalize_buffer;
+  clEnqueueCommandBufferKHR_fn enqueue_buffer;
+  clReleaseCommandBufferKHR_fn release_buffer;
+  recording recordings[GRAPH_MAX_RECORDINGS];
+  unsigned next_victim;
+#endif
+};
+
+command_graph *graph_create(cl_command_queue queue) {
+  command_graph *g = calloc(1, sizeof(command_graph));
+  g->queue = queue;
+  clRetainCommandQueue(queue);
+  return g;
+}
+
+static graph_kernel *find_kernel(command_graph *g, cl_kernel kernel) {
+  for (unsigned i = 0; i < g->num_kernels; i++) {
+    if (g->kernels[i].kernel == kernel) {
+      return &g->kernels[i];
+    }
+  }
+  cl_uint num_args;
+  cl_int err = clGetKernelInfo(kernel, CL_KERNEL_NUM_ARGS, sizeof(num_args), &num_args, NULL);
+  check_error(err, "Couldn't count the kernel arguments.");
+  clRetainKernel(kernel);
+
+  g->kernels = realloc(g->kernels, (g->num_kernels + 1) * sizeof(graph_kernel));
+  graph_kernel *k = &g->kernels[g->num_kernels++];
+  k->kernel = kernel;
+  k->launched = 0;
+  k->num_args = num_args;
+  k->args = calloc(num_args, sizeof(graph_arg_entry));
+  k->dirty = calloc(num_args, sizeof(int));
+  return k;
+}
+
+static size_t store_value(command_graph *g, size_t size, const void *value) {
+  if (g->values_size + size > g->max_values_size) {
+    g->max_values_size = 2 * (g->values_size + size);
+    g->values = realloc(g->values, g->max_values_size);
+  }
+  size_t offset = g->values_size;
+  memcpy(g->values + offset, value, size);
+  g->values_size += size;
+  return offset;
+}
+
+static void set_arg(command_graph *g, cl_kernel kernel, graph_arg_entry entry, const void *value) {
+  check_error(g->finalized ? CL_INVALID_OPERATION : CL_SUCCESS, "The graph is already finalized.");
+  graph_kernel *k = find_kernel(g, kernel);
+  check_error(entry.index >= k->num_args ? CL_INVALID_ARG_INDEX : CL_SUCCESS, "Couldn't record a kernel argument.");
+
+  // an unchanged argument doesn't need to be set again
+  graph_arg_entry *old = &k->args[entry.index];
+  if (old->size == entry.size && old->slot == entry.slot && old->has_value == entry.has_value &&
+      (k->launched || k->dirty[entry.index]) && (!entry.has_value || !memcmp(g->values + old->offset, value, entry.size))) {
+    return;
+  }
+  if (entry.has_value) {
+    entry.offset = store_value(g, entry.size, value);
+  }
+  *old = entry;
+  k->dirty[entry.index] = 1;
+}
+
+void graph_arg(command_graph *g, cl_kernel kernel, cl_uint index, size_t size, const void *value) {
+  graph_arg_entry entry = {index, size, NO_SLOT, 0, value != NULL};
+  set_arg(g, kernel, entry, value);
+}
+
+void graph_arg_slot(command_graph *g, cl_kernel kernel, cl_uint index, unsigned slot) {
+  check_error(slot >= GRAPH_MAX_SLOTS ? CL_INVALID_VALUE : CL_SUCCESS, "Too many graph slots.");
+  graph_arg_entry entry = {index, sizeof(cl_mem), slot, 0, 0};
+  set_arg(g, kernel, entry, NULL);
+}
+
+void graph_ndrange(command_graph *g, cl_kernel kernel, cl_uint work_dim, const size_t *global_size, const size_t *local_size) {
+  check_error(g->finalized ? CL_INVALID_OPERATION : CL_SUCCESS, "The graph is already finalized.");
+  graph_kernel *k = find_kernel(g, kernel);
+  if (g->num_commands == g->max_commands) {
+    g->max_commands = g->max_commands ? 2 * g->max_commands : 16;
+    g->commands = realloc(g->commands, g->max_commands * sizeof(graph_command));
+  }
+  graph_command *c = &g->commands[g->num_commands++];
+  memset(c, 0, sizeof(*c));
+  c->kernel = kernel;
+  c->work_dim = work_dim;
+  memcpy(c->global_size, global_size, work_dim * sizeof(size_t));
+  if (local_size) {
+    memcpy(c->local_size, local_size, work_dim * sizeof(size_t));
+    c->has_local_size = 1;
+  }
+
+  c->first_arg = g->num_args;
+  for (cl_uint i = 0; i < k->num_args; i++) {
+    if (!k->dirty[i]) {
+      continue;
+    }
+    if (g->num_args == g->max_args) {
+      g->max_args = g->max_args ? 2 * g->max_args : 32;
+      g->args = realloc(g->args, g->max_args * sizeof(graph_arg_entry));
+    }
+    g->args[g->num_args++] = k->args[i];
+    k->dirty[i] = 0;
+  }
+  c->num_args = g->num_args - c->first_arg;
+  k->launched = 1;
+}
+
+static cl_int apply_args(const command_graph *g, const graph_command *c) {
+  cl_int err = CL_SUCCESS;
+  for (unsigned i = 0; i < c->num_args; i++) {
+    const graph_arg_entry *a = &g->args[c->first_arg + i];
+    if (a->slot != NO_SLOT) {
+      err |= clSetKernelArg(c->kernel, a->index, sizeof(cl_mem), &g->bindings[a->slot]);
+    } else {
+      err |= clSetKernelArg(c->kernel, a->index, a->size, a->has_value ? g->values + a->offset : NULL);
+    }
+  }
+  return err;
+}
+
+#ifdef cl_khr_command_buffer
+
+static void load_command_buffer(command_graph *g) {
+  const char *mode = getenv("OCL_GRAPH");
+  if (mode && !strcmp(mode, "replay")) {
+    return;
+  }
+  cl_device_id device;
+  cl_platform_id platform;
+  char extensions[8192] = "";
+  cl_int err = clGetCommandQueueInfo(g->queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL);
+  err |= clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, sizeof(extensions), extensions, NULL);
+  if (err || !strstr(extensions, "cl_khr_command_buffer")) {
+    return;
+  }
+
+  g->create_buffer = (clCreateCommandBufferKHR_fn)clGetExtensionFunctionAddressForPlatform(platform, "clCreateCommandBufferKHR");
+  g->command_ndrange = (clCommandNDRangeKernelKHR_fn)clGetExtensionFunctionAddressForPlatform(platform, "clCommandNDRangeKernelKHR");
+  g->finalize_buffer = (clFinalizeCommandBufferKHR_fn)clGetExtensionFunctionAddressForPlatform(platform, "clFinalizeCommandBufferKHR");
+  g->enqueue_buffer = (clEnqueueCommandBufferKHR_fn)clGetExtensionFunctionAddressForPlatform(platform, "clEnqueueCommandBufferKHR");
+  g->release_buffer = (clReleaseCommandBufferKHR_fn)clGetExtensionFunctionAddressForPlatform(platform, "clReleaseCommandBufferKHR");
+  g->use_command_buffer = g->create_buffer && g->command_ndrange && g->finalize_buffer && g->enqueue_buffer && g->release_buffer;
+
+  // revisions of the extension without the flag get a wait before re-enqueuing a pending command buffer
+#ifdef CL_COMMAND_BUFFER_SIMULTANEOUS_USE_KHR
+  cl_device_command_buffer_capabilities_khr capabilities = 0;
+  clGetDeviceInfo(device, CL_DEVICE_COMMAND_BUFFER_CAPABILITIES_KHR, sizeof(capabilities), &capabilities, NULL);
+  g->simultaneous_use = (capabilities & CL_COMMAND_BUFFER_CAPABILITY_SIMULTANEOUS_USE_KHR) != 0;
+#endif
+}
+
+static void release_recording(command_graph *g, recording *r) {
+  if (!r->buffer) {
+    return;
+  }
+  if (r->last) {
+    clReleaseEvent(r->last);
+  }
+  g->release_buffer(r->buffer);
+  for (unsigned i = 0; i < GRAPH_MAX_SLOTS; i++) {
+    if (r->bound[i]) {
+      clReleaseMemObject(r->bound[i]);
+    }
+  }
+  memset(r, 0, sizeof(*r));
+}
+
+// the commands chain through sync points, so they run in order whatever the device does with independent ones
+static recording *record(command_graph *g) {
+  for (unsigned i = 0; i < GRAPH_MAX_RECORDINGS; i++) {
+    if (g->recordings[i].buffer && !memcmp(g->recordings[i].bound, g->bindings, sizeof(g->bindings))) {
+      return &g->recordings[i];
+    }
+  }
+
+  recording *r = &g->recordings[g->next_victim];
+  g->next_victim = (g->next_victim + 1) % GRAPH_MAX_RECORDINGS;
+  release_recording(g, r);
+
+  cl_int err;
+#ifdef CL_COMMAND_BUFFER_SIMULTANEOUS_USE_KHR
+  cl_command_buffer_properties_khr properties[] = {CL_COMMAND_BUFFER_FLAGS_KHR, CL_COMMAND_BUFFER_SIMULTANEOUS_USE_KHR, 0};
+  r->buffer = g->create_buffer(1, &g->queue, g->simultaneous_use ? properties : NULL, &err);
+#else
+  r->buffer = g->create_buffer(1, &g->queue, NULL, &err);
+#endif
+  if (err) {
+    r->buffer = NULL;
+    return NULL;
+  }
+  cl_sync_point_khr previous = 0;
+  for (unsigned i = 0; i < g->num_commands && !err; i++) {
+    const graph_command *c = &g->commands[i];
+    cl_sync_point_khr sync_point;
+    err = apply_args(g, c);
+    err |= g->command_ndrange(r->buffer, NULL, NULL, c->kernel, c->work_dim, NULL, c->global_size, c->has_local_size ? c->local_size : NULL,
+                              i ? 1 : 0, i ? &previous : NULL, &sync_point, NULL);
+    previous = sync_point;
+  }
+  err = err ? err : g->finalize_buffer(r->buffer);
+  if (err) {
+    g->release_buffer(r->buffer);
+    r->buffer = NULL;
+    return NULL;
+  }
+
+  for (unsigned i = 0; i < GRAPH_MAX_SLOTS; i++) {
+    r->bound[i] = g->bindings[i];
+    if (r->bound[i]) {
+      clRetainMemObject(r->bound[i]);
+    }
+  }
+  return r;
+}
+
+static cl_int replay_command_buffer(command_graph *g, cl_event *first, cl_event *last) {
+  recording *r = record(g);
+  if (!r) {
+    // the runtime advertises the extension but can't record this graph, stay on the host-side list
+    g->use_command_buffer = 0;
+    return CL_INVALID_OPERATION;
+  }
+  if (r->last && !g->simultaneous_use) {
+    clWaitForEvents(1, &r->last);
+  }
+  cl_event event;
+  cl_int err = g->enqueue_buffer(0, NULL, r->buffer, 0, NULL, &event);
+  if (err) {
+    return err;
+  }
+  if (r->last) {
+    clReleaseEvent(r->last);
+  }
+  r->last = event;
+  if (first) {
+    clRetainEvent(event);
+    *first = event;
+  }
+  if (last && last != first) {
+    clRetainEvent(event);
+    *last = event;
+  }
+  return CL_SUCCESS;
+}
+
+#endif
+
+void graph_finalize(command_graph *g) {
+  g->finalized = 1;
+#ifdef cl_khr_command_buffer
+  load_command_buffer(g);
+#endif
+}
+
+void graph_bind(command_graph *g, unsigned slot, cl_mem buffer) {
+  check_error(slot >= GRAPH_MAX_SLOTS ? CL_INVALID_VALUE : CL_SUCCESS, "Too many graph slots.");
+  g->bindings[slot] = buffer;
+}
+
+cl_int graph_replay(command_graph *g, cl_event *first, cl_event *last) {
+  if (!g->finalized) {
+    return CL_INVALID_OPERATION;
+  }
+#ifdef cl_khr_command_buffer
+  if (g->use_command_buffer && replay_command_buffer(g, first, last) == CL_SUCCESS) {
+    return CL_SUCCESS;
+  }
+#endif
+
+  cl_int err = CL_SUCCESS;
+  for (unsigned i = 0; i < g->num_commands && !err; i++) {
+    const graph_command *c = &g->commands[i];
+    cl_event *event = i == 0 && first ? first : i + 1 == g->num_commands ? last : NULL;
+    err = apply_args(g, c);
+    err |= clEnqueueNDRangeKernel(g->queue, c->kernel, c->work_dim, NULL, c->global_size, c->has_local_size ? c->local_size : NULL, 0, NULL, event);
+  }
+  // a single command is both first and last
+  if (!err && g->num_commands == 1 && first && last) {
+    clRetainEvent(*first);
+    *last = *first;
+  }
+  return err;
+}
+
+unsigned graph_num_commands(const command_graph *g) { return g->num_commands; }
+
+int graph_uses_command_buffer(const command_graph *g) {
+#ifdef cl_khr_command_buffer
+  return g->use_command_buffer;
+#else
+  (void)g;
+  return 0;
+#endif
+}
+
+void graph_destroy(command_graph *g) {
+#ifdef cl_khr_command_buffer
+  for (unsigned i = 0; i < GRAPH_MAX_RECORDINGS; i++) {
+    release_recording(g, &g->recordings[i]);
+  }
+#endif
+  for (unsigned i = 0; i < g->num_kernels; i++) {
+    clReleaseKernel(g->kernels[i].kernel);
+    free(g->kernels[i].args);
+    free(g->kernels[i].dirty);
+  }
+  clReleaseCommandQueue(g->queue);
+  free(g->kernels);
+  free(g->commands);
+  free(g->args);
+  free(g->values);
+  free(g);
+}
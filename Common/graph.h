@@ -0,0 +1,34 @@
+#pragma once
+
+#include <CL/cl.h>
+
+// Records a multi-stage kernel pipeline once and replays it, instead of re-issuing every clSetKernelArg and
+// clEnqueueNDRangeKernel per call.
+//
+// Recording mirrors the C API: graph_arg() sets an argument the way clSetKernelArg() would, graph_arg_slot() leaves a
+// buffer argument to be bound per replay, and graph_ndrange() records a launch with the arguments as they stand. Only
+// the arguments that changed since the kernel's previous launch are stored with a launch, so a replay sets no more
+// arguments than it has to. Every argument has to be recorded this way, and between graph_finalize() and
+// graph_destroy() the graph owns its kernels' argument state.
+//
+// When the device has cl_khr_command_buffer (and the headers declare it) replays run as command buffers: one is
+// recorded per distinct set of bound buffers, up to GRAPH_MAX_RECORDINGS, and enqueued as a single command. Otherwise,
+// or with OCL_GRAPH=replay, graph_replay() walks the host-side list. The first and last events of a replay are the same
+// event when it runs as a command buffer.
+
+#define GRAPH_MAX_SLOTS 8
+#define GRAPH_MAX_RECORDINGS 4
+
+typedef struct command_graph command_graph;
+
+// clang-format off
+command_graph *graph_create                (cl_command_queue);
+void           graph_destroy               (command_graph *);
+void           graph_arg                   (command_graph *, cl_kernel, cl_uint index, size_t size, const void *value); // NULL for local memory
+void           graph_arg_slot              (command_graph *, cl_kernel, cl_uint index, unsigned slot);
+void           graph_ndrange               (command_graph *, cl_kernel, cl_uint work_dim, const size_t *global_size, const size_t *local_size);
+void           graph_finalize              (command_graph *);
+void           graph_bind                  (command_graph *, unsigned slot, cl_mem);
+cl_int         graph_replay                (command_graph *, cl_event *first, cl_event *last); // either event may be NULL
+unsigned       graph_num_commands          (const command_graph *);
+int            graph_uses_command_buffer   (const command_graph *);
@@ -0,0 +1,78 @@
+#include "host_mem.h"
+#include "device.h"
+#include "error.h"
+#include "trace.h"
+#include <stdlib.h>
+
+#define PAGE_SIZE 4096
+#define CACHE_LINE 64
+
+void *host_alloc(cl_context context, size_t size) {
+  size_t alignment = device_base_alignment(context);
+  if (alignment < PAGE_SIZE) {
+    alignment = PAGE_SIZE;
+  }
+  // aligned_alloc() wants a multiple of the alignment, which is also a multiple of the cache line
+  size_t padded = (size + alignment - 1) / alignment * alignment;
+  void *ptr = aligned_alloc(alignment, padded ? padded : alignment);
+  check_error(!ptr, "Couldn't allocate host memory.");
+  return ptr;
+}
+
+void host_free(void *ptr) { free(ptr); }
+
+cl_mem zero_copy_buffer(cl_context context, cl_mem_flags flags, size_t size, void *host_ptr, cl_int *err) {
+  // the runtime may use the memory in place, so the buffer covers whole cache lines
+  size_t padded = (size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+  return clCreateBuffer(context, flags | CL_MEM_USE_HOST_PTR, padded, host_ptr, err);
+}
+
+void *zero_copy_map(cl_command_queue queue, cl_mem buffer, cl_map_flags map_flags, size_t size, cl_int *err) {
+  return clEnqueueMapBuffer(queue, buffer, CL_BLOCKING, map_flags, 0, size, 0, NULL, NULL, err);
+}
+
+cl_int zero_copy_unmap(cl_command_queue queue, cl_mem buffer, void *mapped) {
+  cl_event event;
+  cl_int err = clEnqueueUnmapMemObject(queue, buffer, mapped, 0, NULL, &event);
+  if (err) {
+    return err;
+  }
+  // the host pointer may only be touched again once the unmap has completed
+  err = clWaitForEvents(1, &event);
+  clReleaseEvent(event);
+  return err;
+}
+
+int zero_copy_is_direct(cl_command_queue queue, cl_mem buffer, const void *host_ptr, size_t size) {
+  cl_int err;
+  void *mapped = zero_copy_map(queue, buffer, CL_MAP_READ, size, &err);
+  if (err) {
+    return 0;
+  }
+  int direct = mapped == host_ptr;
+  zero_copy_unmap(queue, buffer, mapped);
+  return direct;
+}
+
+pinned_mem pinned_alloc(cl_context context, cl_command_queue queue, size_t size, cl_int *err) {
+  pinned_mem m = {clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, NULL, err), NULL};
+  if (*err) {
+    return m;
+  }
+  m.ptr = clEnqueueMapBuffer(queue, m.buffer, CL_BLOCKING, CL_MAP_READ | CL_MAP_WRITE, 0, size, 0, NULL, NULL, err);
+  if (*err) {
+    clReleaseMemObject(m.buffer);
+    m.buffer = NULL;
+  }
+  return m;
+}
+
+void pinned_free(cl_command_queue queue, pinned_mem *m) {
+  if (!m->buffer) {
+    return;
+  }
+  zero_copy_unmap(queue, m->buffer, m->ptr);
+  clReleaseMemObject(m->buffer);
+  m->buffer = NULL;
+  m->ptr = NULL;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <CL/cl.h>
+
+// Host memory that CL_MEM_USE_HOST_PTR buffers can use in place.
+//
+// CPU and integrated GPU runtimes only skip the hidden copy of a CL_MEM_USE_HOST_PTR buffer if the host pointer is
+// aligned to the device's CL_DEVICE_MEM_BASE_ADDR_ALIGN (at least a page here) and the size is a multiple of a cache
+// line. host_alloc() returns heap memory that satisfies both, zero_copy_buffer() expects memory from it. Once such a
+// buffer exists the host has to access it through zero_copy_map()/zero_copy_unmap() instead of reading and writing
+// it: on a zero-copy device the map returns the host pointer itself and moves no data, zero_copy_is_direct() tells
+// whether that happened.
+//
+// pinned_alloc() hands out page-locked memory the portable way: it maps a CL_MEM_ALLOC_HOST_PTR buffer and keeps the
+// mapping until pinned_free(). Reads and writes from such memory can use DMA directly, while pageable memory usually
+// goes through a staging copy in the driver.
+
+typedef struct {
+  cl_mem buffer;
+  void  *ptr;
+} pinned_mem;
+
+// clang-format off
+void      *host_alloc         (cl_context, size_t size);
+void       host_free          (void *);
+cl_mem     zero_copy_buffer   (cl_context, cl_mem_flags, size_t size, void *host_ptr, cl_int *err);
+void      *zero_copy_map      (cl_command_queue, cl_mem, cl_map_flags, size_t size, cl_int *err);
+cl_int     zero_copy_unmap    (cl_command_queue, cl_mem, void *mapped);
+int        zero_copy_is_direct(cl_command_queue, cl_mem, const void *host_ptr, size_t size);
+pinned_mem pinned_alloc       (cl_context, cl_command_queue, size_t size, cl_int *err);
+void       pinned_free        (cl_command_queue, pinned_mem *);
@@ -0,0 +1,235 @@
+#include "kernel_registry.h"
+#include "error.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+#define MIN_CAPACITY 16
+
+typedef struct {
+  size_t size;
+  int set;             // the kernel has been given a value through registry_set_arg()
+  int local;           // the value was NULL, a __local size
+  unsigned char *value;
+} arg_state;
+
+struct registry_kernel {
+  cl_kernel kernel;
+  cl_uint num_args;
+  arg_state *args;
+  pthread_t thread;
+  unsigned long args_set, args_skipped;
+  registry_kernel *next; // the same name's kernel of another thread
+};
+
+typedef struct {
+  char *name; // NULL for an empty slot
+  cl_program program;
+  registry_kernel *kernels;
+} registry_entry;
+
+struct kernel_registry {
+  registry_entry *entries;
+  size_t capacity, count; // capacity is a power of two, at most 3/4 of it used
+  cl_program *programs;
+  size_t num_programs;
+  unsigned long created;
+  pthread_mutex_t mutex;
+};
+
+static uint64_t hash_name(const char *name) {
+  uint64_t hash = FNV_OFFSET;
+  for (const unsigned char *c = (const unsigned char *)name; *c; c++) {
+    hash ^= *c;
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+// the slot holding name, or the empty slot where it belongs
+static registry_entry *find_slot(registry_entry *entries, size_t capacity, const char *name) {
+  size_t i = hash_name(name) & (capacity - 1);
+  while (entries[i].name && strcmp(entries[i].name, name)) {
+    i = (i + 1) & (capacity - 1);
+  }
+  return &entries[i];
+}
+
+static void grow(kernel_registry *r) {
+  size_t capacity = r->capacity ? 2 * r->capacity : MIN_CAPACITY;
+  registry_entry *entries = calloc(capacity, sizeof(registry_entry));
+  for (size_t i = 0; i < r->capacity; i++) {
+    if (r->entries[i].name) {
+      *find_slot(entries, capacity, r->entries[i].name) = r->entries[i];
+    }
+  }
+  free(r->entries);
+  r->entries = entries;
+  r->capacity = capacity;
+}
+
+kernel_registry *kernel_registry_create(void) {
+  kernel_registry *r = calloc(1, sizeof(kernel_registry));
+  pthread_mutex_init(&r->mutex, NULL);
+  grow(r);
+  return r;
+}
+
+unsigned kernel_registry_add(kernel_registry *r, cl_program program) {
+  size_t size;
+  cl_int err = clGetProgramInfo(program, CL_PROGRAM_KERNEL_NAMES, 0, NULL, &size);
+  check_error(err, "Couldn't read the program's kernel names, is it built?");
+  char *names = malloc(size);
+  clGetProgramInfo(program, CL_PROGRAM_KERNEL_NAMES, size, names, NULL);
+
+  pthread_mutex_lock(&r->mutex);
+  clRetainProgram(program);
+  r->programs = realloc(r->programs, (r->num_programs + 1) * sizeof(cl_program));
+  r->programs[r->num_programs++] = program;
+
+  unsigned added = 0;
+  char *saveptr;
+  for (char *name = strtok_r(names, ";", &saveptr); name; name = strtok_r(NULL, ";", &saveptr)) {
+    if ((r->count + 1) * 4 > r->capacity * 3) {
+      grow(r);
+    }
+    registry_entry *entry = find_slot(r->entries, r->capacity, name);
+    if (entry->name) {
+      continue;
+    }
+    entry->name = strdup(name);
+    entry->program = program;
+    r->count++;
+    added++;
+  }
+  pthread_mutex_unlock(&r->mutex);
+  free(names);
+  return added;
+}
+
+static registry_kernel *create_kernel(cl_program program, const char *name) {
+  registry_kernel *k = calloc(1, sizeof(registry_kernel));
+  cl_int err;
+  k->kernel = clCreateKernel(program, name, &err);
+  check_error(err, "Couldn't create a kernel.");
+  err = clGetKernelInfo(k->kernel, CL_KERNEL_NUM_ARGS, sizeof(k->num_args), &k->num_args, NULL);
+  check_error(err, "Couldn't read the number of kernel arguments.");
+  k->args = calloc(k->num_args, sizeof(arg_state));
+  k->thread = pthread_self();
+  return k;
+}
+
+registry_kernel *kernel_registry_get(kernel_registry *r, const char *name) {
+  pthread_t self = pthread_self();
+  pthread_mutex_lock(&r->mutex);
+  registry_entry *entry = find_slot(r->entries, r->capacity, name);
+  registry_kernel *k = NULL;
+  if (entry->name) {
+    for (k = entry->kernels; k && !pthread_equal(k->thread, self); k = k->next) {
+    }
+    if (!k) {
+      k = create_kernel(entry->program, entry->name);
+      k->next = entry->kernels;
+      entry->kernels = k;
+      r->created++;
+    }
+  }
+  pthread_mutex_unlock(&r->mutex);
+  return k;
+}
+
+cl_kernel registry_kernel_handle(const registry_kernel *k) { return k->kernel; }
+
+cl_uint registry_kernel_num_args(const registry_kernel *k) { return k->num_args; }
+
+cl_int registry_set_arg(registry_kernel *k, cl_uint index, size_t size, const void *value) {
+  if (index >= k->num_args) {
+    return CL_INVALID_ARG_INDEX;
+  }
+  arg_state *arg = &k->args[index];
+  if (arg->set && arg->size == size && arg->local == !value && (!value || !memcmp(arg->value, value, size))) {
+    k->args_skipped++;
+    return CL_SUCCESS;
+  }
+
+  cl_int err = clSetKernelArg(k->kernel, index, size, value);
+  k->args_set++;
+  if (err) {
+    arg->set = 0;
+    return err;
+  }
+  if (value) {
+    if (!arg->value || arg->size < size) {
+      free(arg->value);
+      arg->value = malloc(size);
+    }
+    memcpy(arg->value, value, size);
+  }
+  arg->size = size;
+  arg->local = !value;
+  arg->set = 1;
+  return CL_SUCCESS;
+}
+
+void registry_kernel_reset_args(registry_kernel *k) {
+  for (cl_uint i = 0; i < k->num_args; i++) {
+    k->args[i].set = 0;
+  }
+}
+
+kernel_registry_stats kernel_registry_get_stats(kernel_registry *r) {
+  kernel_registry_stats stats = {0, 0, 0, 0};
+  pthread_mutex_lock(&r->mutex);
+  stats.kernels = r->count;
+  stats.created = r->created;
+  // the counters belong to each thread's kernels, a thread that is setting arguments right now may be a call behind
+  for (size_t i = 0; i < r->capacity; i++) {
+    for (registry_kernel *k = r->entries[i].kernels; k; k = k->next) {
+      stats.args_set += k->args_set;
+      stats.args_skipped += k->args_skipped;
+    }
+  }
+  pthread_mutex_unlock(&r->mutex);
+  return stats;
+}
+
+void kernel_registry_report(kernel_registry *r, FILE *out) {
+  kernel_registry_stats stats = kernel_registry_get_stats(r);
+  pthread_mutex_lock(&r->mutex);
+  size_t num_programs = r->num_programs;
+  pthread_mutex_unlock(&r->mutex);
+  fprintf(out, "Kernel registry: %lu name(s) in %zu program(s), %lu kernel object(s) created\n", stats.kernels, num_programs,
+          stats.created);
+  unsigned long calls = stats.args_set + stats.args_skipped;
+  if (calls) {
+    fprintf(out, "  arguments: %lu set, %lu skipped as unchanged (%.1f%%)\n", stats.args_set, stats.args_skipped,
+            100.0 * stats.args_skipped / calls);
+  }
+}
+
+void kernel_registry_destroy(kernel_registry *r) {
+  for (size_t i = 0; i < r->capacity; i++) {
+    registry_kernel *k = r->entries[i].kernels;
+    while (k) {
+      registry_kernel *next = k->next;
+      for (cl_uint a = 0; a < k->num_args; a++) {
+        free(k->args[a].value);
+      }
+      free(k->args);
+      clReleaseKernel(k->kernel);
+      free(k);
+      k = next;
+    }
+    free(r->entries[i].name);
+  }
+  for (size_t i = 0; i < r->num_programs; i++) {
+    clReleaseProgram(r->programs[i]);
+  }
+  free(r->programs);
+  free(r->entries);
+  pthread_mutex_destroy(&r->mutex);
+  free(r);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <stdio.h>
+
+// Finds kernels by name across all the programs of a pipeline and hands every thread its own kernel objects.
+//
+// kernel_registry_add() indexes the kernels of a built program in a hash map, without creating any of them; the first
+// program to define a name keeps it. kernel_registry_get() returns the calling thread's kernel of that name and
+// creates it on the thread's first request, since arguments set on a shared cl_kernel would race. The registry keeps
+// every kernel and program until kernel_registry_destroy().
+//
+// registry_set_arg() remembers the last value of each argument and skips clSetKernelArg() when it is set to the same
+// bytes again, which saves most calls of a loop that only changes a few arguments per launch. The comparison sees a
+// cl_mem as a handle: after releasing a buffer that a kernel had as argument, registry_kernel_reset_args() makes sure
+// a new buffer at the same address is set for real. Arguments set with clSetKernelArg() directly aren't tracked.
+
+typedef struct kernel_registry kernel_registry;
+typedef struct registry_kernel registry_kernel;
+
+typedef struct {
+  unsigned long kernels;      // kernel names indexed
+  unsigned long created;      // kernel objects created, one per name and thread that asked for it
+  unsigned long args_set;     // clSetKernelArg() calls made by registry_set_arg()
+  unsigned long args_skipped; // registry_set_arg() calls that found the value already set
+} kernel_registry_stats;
+
+// clang-format off
+kernel_registry      *kernel_registry_create    (void);
+void                  kernel_registry_destroy   (kernel_registry *);
+unsigned              kernel_registry_add       (kernel_registry *, cl_program); // returns the number of new names
+registry_kernel      *kernel_registry_get       (kernel_registry *, const char *name); // NULL if no program has it
+kernel_registry_stats kernel_registry_get_stats (kernel_registry *);
+void                  kernel_registry_report    (kernel_registry *, FILE *);
+
+cl_kernel             registry_kernel_handle    (const registry_kernel *);
+cl_uint               registry_kernel_num_args  (const registry_kernel *);
+cl_int                registry_set_arg          (registry_kernel *, cl_uint index, size_t size, const void *value);
+void                  registry_kernel_reset_args(registry_kernel *);
@@ -0,0 +1,446 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <array>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include "device.h"
+#include "program_cache.h"
+}
+
+// Header-only C++17 layer over the OpenCL C API, replacing the deprecated cl.hpp.
+//
+// Every handle is move-only and releases its object when it goes out of scope, so a cl_mem or cl_event can't leak and
+// nothing is retained or released behind the caller's back. Failed calls throw ocl::error with the OpenCL error code.
+// Commands only create an event when the caller passes one to receive it; the wait list is a span over raw cl_events,
+// so an enqueue costs no allocation. kernel::set_args() binds all arguments of a kernel at once and rejects the wrong
+// count at runtime and pointers at compile time. queue::map() returns a mapping that unmaps itself and reads like a
+// span over the buffer's elements. Programs are built through build_program_with_options() and its binary cache.
+
+namespace ocl {
+
+class error : public std::runtime_error {
+public:
+  error(cl_int code, const char *message) : std::runtime_error(message), code_(code) {}
+  cl_int code() const noexcept { return code_; }
+
+private:
+  cl_int code_;
+};
+
+inline void check(cl_int err, const char *message) {
+  if (err) {
+    throw error(err, message);
+  }
+}
+
+// contiguous elements owned by someone else
+template <typename T> class span {
+public:
+  constexpr span() = default;
+  constexpr span(T *data, size_t size) : data_(data), size_(size) {}
+  template <size_t N> constexpr span(T (&array)[N]) : data_(array), size_(N) {}
+  // only safe as a parameter: the list's array lives until the end of the full expression
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winit-list-lifetime"
+#endif
+  template <typename U, typename = std::enable_if_t<std::is_same_v<const U, T>>>
+  constexpr span(std::initializer_list<U> list) : data_(list.begin()), size_(list.size()) {}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+  template <typename U> span(std::vector<U> &vector) : data_(vector.data()), size_(vector.size()) {}
+  template <typename U> span(const std::vector<U> &vector) : data_(vector.data()), size_(vector.size()) {}
+
+  constexpr T *data() const { return data_; }
+  constexpr size_t size() const { return size_; }
+  constexpr size_t size_bytes() const { return size_ * sizeof(T); }
+  constexpr bool empty() const { return !size_; }
+  constexpr T *begin() const { return data_; }
+  constexpr T *end() const { return data_ + size_; }
+  constexpr T &operator[](size_t i) const { return data_[i]; }
+
+private:
+  T *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// events a command waits for, the list only has to live until the enqueue returns
+using wait_list = span<const cl_event>;
+
+template <typename T, cl_int(CL_API_CALL *Release)(T)> class handle {
+public:
+  handle() = default;
+  explicit handle(T raw) : raw_(raw) {}
+  handle(handle &&other) noexcept : raw_(std::exchange(other.raw_, nullptr)) {}
+  handle &operator=(handle &&other) noexcept {
+    if (this != &other) {
+      reset(std::exchange(other.raw_, nullptr));
+    }
+    return *this;
+  }
+  handle(const handle &) = delete;
+  handle &operator=(const handle &) = delete;
+  ~handle() { reset(); }
+
+  T get() const { return raw_; }
+  explicit operator bool() const { return raw_ != nullptr; }
+
+  // takes ownership of raw, releasing the previous object
+  void reset(T raw = nullptr) {
+    if (raw_) {
+      Release(raw_);
+    }
+    raw_ = raw;
+  }
+
+  // gives up ownership without releasing
+  T detach() { return std::exchange(raw_, nullptr); }
+
+protected:
+  T raw_ = nullptr;
+};
+
+/* Devices */
+
+inline std::string device_name(cl_device_id device) {
+  size_t size;
+  check(clGetDeviceInfo(device, CL_DEVICE_NAME, 0, nullptr, &size), "Couldn't read the device name.");
+  std::string name(size, '\0');
+  check(clGetDeviceInfo(device, CL_DEVICE_NAME, size, name.data(), nullptr), "Couldn't read the device name.");
+  name.resize(size ? size - 1 : 0);
+  return name;
+}
+
+// the devices of the given type on the same platform as device
+inline std::vector<cl_device_id> platform_devices(cl_device_id device, cl_device_type type) {
+  cl_platform_id platform;
+  check(clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, nullptr), "Couldn't find the device's platform.");
+  cl_uint count;
+  check(clGetDeviceIDs(platform, type, 0, nullptr, &count), "Couldn't access any devices.");
+  std::vector<cl_device_id> devices(count);
+  check(clGetDeviceIDs(platform, type, count, devices.data(), nullptr), "Couldn't access any devices.");
+  return devices;
+}
+
+/* Context */
+
+class context : public handle<cl_context, clReleaseContext> {
+public:
+  context() = default;
+  explicit context(cl_device_id device) : context(span<const cl_device_id>(&device, 1)) {}
+  explicit context(span<const cl_device_id> devices) {
+    cl_int err;
+    raw_ = clCreateContext(nullptr, (cl_uint)devices.size(), devices.data(), nullptr, nullptr, &err);
+    check(err, "Couldn't create a context.");
+  }
+
+  std::vector<cl_device_id> devices() const {
+    cl_uint count;
+    check(clGetContextInfo(raw_, CL_CONTEXT_NUM_DEVICES, sizeof(count), &count, nullptr), "Couldn't read the context's devices.");
+    std::vector<cl_device_id> devices(count);
+    check(clGetContextInfo(raw_, CL_CONTEXT_DEVICES, count * sizeof(cl_device_id), devices.data(), nullptr),
+          "Couldn't read the context's devices.");
+    return devices;
+  }
+};
+
+/* Memory */
+
+class buffer : public handle<cl_mem, clReleaseMemObject> {
+public:
+  buffer() = default;
+  explicit buffer(cl_mem raw) : handle(raw) {}
+  buffer(const context &ctx, cl_mem_flags flags, size_t size, void *host_ptr = nullptr) {
+    cl_int err;
+    raw_ = clCreateBuffer(ctx.get(), flags, size, host_ptr, &err);
+    check(err, "Couldn't create a buffer.");
+  }
+  // sized after data, for CL_MEM_COPY_HOST_PTR or CL_MEM_USE_HOST_PTR
+  template <typename T>
+  buffer(const context &ctx, cl_mem_flags flags, span<T> data) : buffer(ctx, flags, data.size_bytes(), (void *)data.data()) {}
+
+  // origin has to be a multiple of device_base_alignment()
+  buffer sub_buffer(cl_mem_flags flags, size_t origin, size_t size) const {
+    cl_buffer_region region = {origin, size};
+    cl_int err;
+    cl_mem sub = clCreateSubBuffer(raw_, flags, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+    check(err, "Couldn't create a sub-buffer.");
+    return buffer(sub);
+  }
+
+  size_t size() const {
+    size_t size;
+    check(clGetMemObjectInfo(raw_, CL_MEM_SIZE, sizeof(size), &size, nullptr), "Couldn't read the buffer size.");
+    return size;
+  }
+
+  void *host_ptr() const {
+    void *ptr;
+    check(clGetMemObjectInfo(raw_, CL_MEM_HOST_PTR, sizeof(ptr), &ptr, nullptr), "Couldn't read the buffer's host pointer.");
+    return ptr;
+  }
+};
+
+// a __local kernel argument of size bytes
+struct local {
+  size_t size;
+};
+
+/* Programs and kernels */
+
+class program : public handle<cl_program, clReleaseProgram> {
+public:
+  program() = default;
+  // a build failure prints the build log and exits, like build_program()
+  program(const context &ctx, cl_device_id device, const char *filename, const char *options = nullptr)
+      : handle(build_program_with_options(ctx.get(), device, filename, options)) {}
+};
+
+class kernel : public handle<cl_kernel, clReleaseKernel> {
+public:
+  kernel() = default;
+  explicit kernel(cl_kernel raw) : handle(raw) { read_num_args(); }
+  kernel(const program &prog, const char *name) {
+    cl_int err;
+    raw_ = clCreateKernel(prog.get(), name, &err);
+    check(err, "Couldn't create a kernel.");
+    read_num_args();
+  }
+
+  static std::vector<kernel> all(const program &prog) {
+    cl_uint count;
+    check(clCreateKernelsInProgram(prog.get(), 0, nullptr, &count), "Couldn't find the program's kernels.");
+    std::vector<cl_kernel> raw(count);
+    check(clCreateKernelsInProgram(prog.get(), count, raw.data(), nullptr), "Couldn't create the program's kernels.");
+    std::vector<kernel> kernels;
+    kernels.reserve(count);
+    for (cl_kernel k : raw) {
+      kernels.emplace_back(k);
+    }
+    return kernels;
+  }
+
+  std::string name() const {
+    size_t size;
+    check(clGetKernelInfo(raw_, CL_KERNEL_FUNCTION_NAME, 0, nullptr, &size), "Couldn't read the kernel name.");
+    std::string name(size, '\0');
+    check(clGetKernelInfo(raw_, CL_KERNEL_FUNCTION_NAME, size, name.data(), nullptr), "Couldn't read the kernel name.");
+    name.resize(size ? size - 1 : 0);
+    return name;
+  }
+
+  cl_uint num_args() const { return num_args_; }
+
+  // buffers, local sizes, raw cl_mem handles and plain values such as cl_int or cl_float4
+  template <typename T> void set_arg(cl_uint index, const T &value) {
+    cl_int err;
+    if constexpr (std::is_same_v<T, buffer>) {
+      cl_mem mem = value.get();
+      err = clSetKernelArg(raw_, index, sizeof(mem), &mem);
+    } else if constexpr (std::is_same_v<T, local>) {
+      err = clSetKernelArg(raw_, index, value.size, nullptr);
+    } else {
+      static_assert(std::is_same_v<T, cl_mem> || (std::is_trivially_copyable_v<T> && !std::is_pointer_v<T>),
+                    "kernel arguments are buffers, local memory or plain values, not host pointers");
+      err = clSetKernelArg(raw_, index, sizeof(T), &value);
+    }
+    check(err, "Couldn't set a kernel argument.");
+  }
+
+  // binds every argument in order
+  template <typename... Args> void set_args(const Args &...args) {
+    if (sizeof...(Args) != num_args_) {
+      throw error(CL_INVALID_KERNEL_ARGS, "Wrong number of kernel arguments.");
+    }
+    cl_uint index = 0;
+    (set_arg(index++, args), ...);
+  }
+
+private:
+  void read_num_args() {
+    check(clGetKernelInfo(raw_, CL_KERNEL_NUM_ARGS, sizeof(num_args_), &num_args_, nullptr), "Couldn't count the kernel arguments.");
+  }
+
+  cl_uint num_args_ = 0;
+};
+
+/* Events */
+
+class event : public handle<cl_event, clReleaseEvent> {
+public:
+  event() = default;
+  explicit event(cl_event raw) : handle(raw) {}
+
+  void wait() const { check(clWaitForEvents(1, &raw_), "Couldn't wait for an event."); }
+
+  // needs a queue with CL_QUEUE_PROFILING_ENABLE
+  cl_ulong profiling_info(cl_profiling_info name) const {
+    cl_ulong value;
+    check(clGetEventProfilingInfo(raw_, name, sizeof(value), &value, nullptr), "Couldn't get profiling information.");
+    return value;
+  }
+  cl_ulong duration_ns() const { return profiling_info(CL_PROFILING_COMMAND_END) - profiling_info(CL_PROFILING_COMMAND_START); }
+
+  void set_callback(cl_int status, void(CL_CALLBACK *callback)(cl_event, cl_int, void *), void *data = nullptr) const {
+    check(clSetEventCallback(raw_, status, callback, data), "Couldn't set an event callback.");
+  }
+};
+
+class user_event : public event {
+public:
+  explicit user_event(const context &ctx) {
+    cl_int err;
+    raw_ = clCreateUserEvent(ctx.get(), &err);
+    check(err, "Couldn't create a user event.");
+  }
+
+  void set_status(cl_int status) const { check(clSetUserEventStatus(raw_, status), "Couldn't set the user event status."); }
+};
+
+/* Queue */
+
+// a global or local NDRange, no dimensions leaves the local size to the runtime
+struct range {
+  range() = default;
+  range(size_t x) : dims(1), sizes{x} {}
+  range(size_t x, size_t y) : dims(2), sizes{x, y} {}
+  range(size_t x, size_t y, size_t z) : dims(3), sizes{x, y, z} {}
+  const size_t *data() const { return dims ? sizes : nullptr; }
+
+  cl_uint dims = 0;
+  size_t sizes[3] = {};
+};
+
+// elements of a mapped buffer, unmapped when the mapping goes out of scope; the queue has to outlive it
+template <typename T> class mapping {
+public:
+  mapping(cl_command_queue queue, cl_mem mem, T *data, size_t size) : queue_(queue), mem_(mem), elements_(data, size) {}
+  mapping(mapping &&other) noexcept
+      : queue_(other.queue_), mem_(std::exchange(other.mem_, nullptr)), elements_(std::exchange(other.elements_, {})) {}
+  mapping &operator=(mapping &&other) noexcept {
+    if (this != &other) {
+      release();
+      queue_ = other.queue_;
+      mem_ = std::exchange(other.mem_, nullptr);
+      elements_ = std::exchange(other.elements_, {});
+    }
+    return *this;
+  }
+  mapping(const mapping &) = delete;
+  mapping &operator=(const mapping &) = delete;
+  ~mapping() { release(); }
+
+  span<T> elements() const { return elements_; }
+  T *data() const { return elements_.data(); }
+  size_t size() const { return elements_.size(); }
+  T *begin() const { return elements_.begin(); }
+  T *end() const { return elements_.end(); }
+  T &operator[](size_t i) const { return elements_[i]; }
+
+  // enqueues the unmap now, the destructor does the same but can't report errors
+  void unmap(event *done = nullptr) {
+    cl_event raw = nullptr;
+    cl_int err = clEnqueueUnmapMemObject(queue_, mem_, elements_.data(), 0, nullptr, done ? &raw : nullptr);
+    mem_ = nullptr;
+    check(err, "Couldn't unmap the buffer.");
+    if (done) {
+      done->reset(raw);
+    }
+  }
+
+private:
+  void release() {
+    if (mem_) {
+      clEnqueueUnmapMemObject(queue_, mem_, elements_.data(), 0, nullptr, nullptr);
+      mem_ = nullptr;
+    }
+  }
+
+  cl_command_queue queue_;
+  cl_mem mem_;
+  span<T> elements_;
+};
+
+// every command takes an optional wait list and an optional event to receive, only a requested event is created
+class queue : public handle<cl_command_queue, clReleaseCommandQueue> {
+public:
+  queue() = default;
+  queue(const context &ctx, cl_device_id device, cl_command_queue_properties properties = 0) {
+    cl_queue_properties list[] = {CL_QUEUE_PROPERTIES, properties, 0};
+    cl_int err;
+    raw_ = clCreateCommandQueueWithProperties(ctx.get(), device, properties ? list : nullptr, &err);
+    check(err, "Couldn't create a command queue.");
+  }
+
+  void run(const kernel &k, const range &global, const range &local = {}, wait_list waits = {}, event *done = nullptr) const {
+    cl_event raw = nullptr;
+    cl_int err = clEnqueueNDRangeKernel(raw_, k.get(), global.dims, nullptr, global.data(), local.data(), (cl_uint)waits.size(),
+                                        waits.data(), done ? &raw : nullptr);
+    finish_command(err, raw, done, "Couldn't enqueue the kernel.");
+  }
+
+  // a single work-item, what clEnqueueTask did before it was deprecated
+  void task(const kernel &k, wait_list waits = {}, event *done = nullptr) const { run(k, range(1), range(1), waits, done); }
+
+  void write(const buffer &mem, cl_bool blocking, size_t offset, size_t size, const void *ptr, wait_list waits = {},
+             event *done = nullptr) const {
+    cl_event raw = nullptr;
+    cl_int err = clEnqueueWriteBuffer(raw_, mem.get(), blocking, offset, size, ptr, (cl_uint)waits.size(), waits.data(), done ? &raw : nullptr);
+    finish_command(err, raw, done, "Couldn't write the buffer.");
+  }
+
+  void read(const buffer &mem, cl_bool blocking, size_t offset, size_t size, void *ptr, wait_list waits = {}, event *done = nullptr) const {
+    cl_event raw = nullptr;
+    cl_int err = clEnqueueReadBuffer(raw_, mem.get(), blocking, offset, size, ptr, (cl_uint)waits.size(), waits.data(), done ? &raw : nullptr);
+    finish_command(err, raw, done, "Couldn't read the buffer.");
+  }
+
+  // origins and regions are in bytes for x and in rows and slices for y and z
+  void read_rect(const buffer &mem, cl_bool blocking, const std::array<size_t, 3> &buffer_origin, const std::array<size_t, 3> &host_origin,
+                 const std::array<size_t, 3> &region, size_t buffer_row_pitch, size_t buffer_slice_pitch, size_t host_row_pitch,
+                 size_t host_slice_pitch, void *ptr, wait_list waits = {}, event *done = nullptr) const {
+    cl_event raw = nullptr;
+    cl_int err = clEnqueueReadBufferRect(raw_, mem.get(), blocking, buffer_origin.data(), host_origin.data(), region.data(), buffer_row_pitch,
+                                         buffer_slice_pitch, host_row_pitch, host_slice_pitch, ptr, (cl_uint)waits.size(), waits.data(),
+                                         done ? &raw : nullptr);
+    finish_command(err, raw, done, "Couldn't read the buffer rectangle.");
+  }
+
+  void copy(const buffer &src, const buffer &dst, size_t src_offset, size_t dst_offset, size_t size, wait_list waits = {},
+            event *done = nullptr) const {
+    cl_event raw = nullptr;
+    cl_int err = clEnqueueCopyBuffer(raw_, src.get(), dst.get(), src_offset, dst_offset, size, (cl_uint)waits.size(), waits.data(),
+                                     done ? &raw : nullptr);
+    finish_command(err, raw, done, "Couldn't copy the buffer.");
+  }
+
+  // blocking map of count elements from element offset on
+  template <typename T> mapping<T> map(const buffer &mem, cl_map_flags flags, size_t offset, size_t count, wait_list waits = {}) const {
+    cl_int err;
+    void *ptr = clEnqueueMapBuffer(raw_, mem.get(), CL_TRUE, flags, offset * sizeof(T), count * sizeof(T), (cl_uint)waits.size(), waits.data(),
+                                   nullptr, &err);
+    check(err, "Couldn't map the buffer.");
+    return mapping<T>(raw_, mem.get(), static_cast<T *>(ptr), count);
+  }
+
+  void flush() const { check(clFlush(raw_), "Couldn't flush the queue."); }
+  void finish() const { check(clFinish(raw_), "Couldn't finish the queue."); }
+
+private:
+  static void finish_command(cl_int err, cl_event raw, event *done, const char *message) {
+    check(err, message);
+    if (done) {
+      done->reset(raw);
+    }
+  }
+};
+
+} // namespace ocl
@@ -0,0 +1,545 @@
+#include "program_cache.h"
+#include "error.h"
+#include "timer.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CACHE_SUBDIR "opencl-in-action"
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+#define IL_OPTIONS "-x spirv"
+
+static program_cache_stats stats;
+static const embedded_program *embedded;
+static unsigned num_embedded;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+  const unsigned char *bytes = data;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+  // separator, so that "ab" + "c" and "a" + "bc" hash differently
+  hash ^= 0xff;
+  return hash * FNV_PRIME;
+}
+
+static uint64_t hash_device_info(uint64_t hash, cl_device_id device, cl_device_info param) {
+  size_t size;
+  cl_int err = clGetDeviceInfo(device, param, 0, NULL, &size);
+  check_error(err, "Couldn't obtain device information.");
+  char *value = malloc(size);
+  clGetDeviceInfo(device, param, size, value, NULL);
+  hash = fnv1a(hash, value, size);
+  free(value);
+  return hash;
+}
+
+static uint64_t hash_platform_info(uint64_t hash, cl_platform_id platform, cl_platform_info param) {
+  size_t size;
+  cl_int err = clGetPlatformInfo(platform, param, 0, NULL, &size);
+  check_error(err, "Couldn't obtain platform information.");
+  char *value = malloc(size);
+  clGetPlatformInfo(platform, param, size, value, NULL);
+  hash = fnv1a(hash, value, size);
+  free(value);
+  return hash;
+}
+
+static uint64_t cache_key(cl_device_id device, const char *source, size_t length, const char *options) {
+  cl_platform_id platform;
+  cl_int err = clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL);
+  check_error(err, "Couldn't obtain the device platform.");
+
+  uint64_t hash = FNV_OFFSET;
+  hash = fnv1a(hash, source, length);
+  hash = fnv1a(hash, options, strlen(options));
+  hash = hash_platform_info(hash, platform, CL_PLATFORM_NAME);
+  hash = hash_platform_info(hash, platform, CL_PLATFORM_VERSION);
+  hash = hash_device_info(hash, device, CL_DEVICE_NAME);
+  hash = hash_device_info(hash, device, CL_DEVICE_VENDOR);
+  hash = hash_device_info(hash, device, CL_DEVICE_VERSION);
+  hash = hash_device_info(hash, device, CL_DRIVER_VERSION);
+  return hash;
+}
+
+// creates every missing component of path, like mkdir -p
+static int make_dirs(char *path) {
+  for (char *p = path + 1; *p; p++) {
+    if (*p == '/') {
+      *p = '\0';
+      int failed = mkdir(path, 0755) && errno != EEXIST;
+      *p = '/';
+      if (failed) {
+        return -1;
+      }
+    }
+  }
+  return mkdir(path, 0755) && errno != EEXIST ? -1 : 0;
+}
+
+const char *program_cache_dir(void) {
+  static char dir[4096];
+  static int initialized;
+  if (initialized) {
+    return *dir ? dir : NULL;
+  }
+  initialized = 1;
+
+  if (getenv("OCL_CACHE_DISABLE")) {
+    return NULL;
+  }
+
+  const char *env;
+  if ((env = getenv("OCL_CACHE_DIR")) && *env) {
+    snprintf(dir, sizeof(dir), "%s", env);
+  } else if ((env = getenv("XDG_CACHE_HOME")) && *env) {
+    snprintf(dir, sizeof(dir), "%s/%s", env, CACHE_SUBDIR);
+  } else if ((env = getenv("HOME")) && *env) {
+    snprintf(dir, sizeof(dir), "%s/.cache/%s", env, CACHE_SUBDIR);
+  } else {
+    snprintf(dir, sizeof(dir), ".ocl_cache");
+  }
+
+  if (make_dirs(dir)) {
+    fprintf(stderr, "Couldn't create program cache directory %s, caching disabled.\n", dir);
+    *dir = '\0';
+    return NULL;
+  }
+  return dir;
+}
+
+static unsigned char *read_binary(const char *path, size_t *size) {
+  FILE *handle = fopen(path, "rb");
+  if (!handle) {
+    return NULL;
+  }
+  fseek(handle, 0, SEEK_END);
+  *size = ftell(handle);
+  rewind(handle);
+  unsigned char *binary = malloc(*size);
+  if (*size == 0 || fread(binary, 1, *size, handle) != *size) {
+    free(binary);
+    binary = NULL;
+  }
+  fclose(handle);
+  return binary;
+}
+
+// writes to a temporary file first so concurrent runs never see a partial binary
+static void write_binary(const char *path, const unsigned char *binary, size_t size) {
+  char tmp_path[4200];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
+  FILE *handle = fopen(tmp_path, "wb");
+  if (!handle) {
+    return;
+  }
+  size_t written = fwrite(binary, 1, size, handle);
+  if (fclose(handle) || written != size || rename(tmp_path, path)) {
+    remove(tmp_path);
+  }
+}
+
+void program_build_log(cl_program program, cl_device_id device) {
+  size_t log_size;
+  clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+  char *program_log = malloc(log_size);
+  clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, program_log, NULL);
+  printf("%s\n", program_log);
+  free(program_log);
+}
+
+// the cached binary as a program that still needs a build, NULL (and the file removed) if the driver rejects it
+static cl_program create_cached(cl_context ctx, cl_device_id device, const char *path) {
+  size_t size;
+  unsigned char *binary = read_binary(path, &size);
+  if (!binary) {
+    return NULL;
+  }
+
+  cl_int err, binary_status;
+  cl_program program = clCreateProgramWithBinary(ctx, 1, &device, &size, (const unsigned char **)&binary, &binary_status, &err);
+  free(binary);
+  if (err || binary_status) {
+    if (!err) {
+      clReleaseProgram(program);
+    }
+    remove(path);
+    return NULL;
+  }
+  return program;
+}
+
+static cl_program load_cached(cl_context ctx, cl_device_id device, const char *path, const char *options) {
+  cl_program program = create_cached(ctx, device, path);
+  if (!program) {
+    return NULL;
+  }
+
+  // binaries still need a build to become executable, but it skips the front end
+  cl_int err = clBuildProgram(program, 1, &device, options, NULL, NULL);
+  if (err) {
+    clReleaseProgram(program);
+    remove(path);
+    return NULL;
+  }
+  return program;
+}
+
+static void store_cached(cl_program program, cl_device_id device, const char *path) {
+  cl_uint num_devices;
+  cl_int err = clGetProgramInfo(program, CL_PROGRAM_NUM_DEVICES, sizeof(num_devices), &num_devices, NULL);
+  check_error(err, "Couldn't obtain program information.");
+  cl_device_id *devices = malloc(num_devices * sizeof(cl_device_id));
+  size_t *sizes = malloc(num_devices * sizeof(size_t));
+  unsigned char **binaries = calloc(num_devices, sizeof(unsigned char *));
+  err = clGetProgramInfo(program, CL_PROGRAM_DEVICES, num_devices * sizeof(cl_device_id), devices, NULL);
+  err |= clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, num_devices * sizeof(size_t), sizes, NULL);
+  check_error(err, "Couldn't obtain program information.");
+
+  // only fetch the binary of the device the program was built for, NULL entries are skipped
+  for (cl_uint i = 0; i < num_devices; i++) {
+    if (devices[i] == device && sizes[i] > 0) {
+      binaries[i] = malloc(sizes[i]);
+      err = clGetProgramInfo(program, CL_PROGRAM_BINARIES, num_devices * sizeof(unsigned char *), binaries, NULL);
+      if (!err) {
+        write_binary(path, binaries[i], sizes[i]);
+      }
+      free(binaries[i]);
+      break;
+    }
+  }
+
+  free(binaries);
+  free(sizes);
+  free(devices);
+}
+
+cl_program build_program_from_source(cl_context ctx, cl_device_id device, const char *source, size_t length, const char *options) {
+  if (!options) {
+    options = "";
+  }
+  double start = timer_ms();
+
+  char path[4200];
+  const char *dir = program_cache_dir();
+  if (dir) {
+    snprintf(path, sizeof(path), "%s/%016llx.bin", dir, (unsigned long long)cache_key(device, source, length, options));
+    cl_program program = load_cached(ctx, device, path, options);
+    if (program) {
+      stats.hits++;
+      stats.hit_ms += timer_ms() - start;
+      return program;
+    }
+  }
+
+  cl_int err;
+  cl_program program = clCreateProgramWithSource(ctx, 1, &source, &length, &err);
+  check_error(err, "Couldn't create the program.");
+  err = clBuildProgram(program, 1, &device, options, NULL, NULL);
+  if (err) {
+    program_build_log(program, device);
+    exit(EXIT_FAILURE);
+  }
+  if (dir) {
+    store_cached(program, device, path);
+  }
+
+  stats.misses++;
+  stats.miss_ms += timer_ms() - start;
+  return program;
+}
+
+void program_cache_embed(const embedded_program *programs, unsigned count) {
+  embedded_program *all = realloc((void *)embedded, (num_embedded + count) * sizeof(embedded_program));
+  memcpy(all + num_embedded, programs, count * sizeof(embedded_program));
+  embedded = all;
+  num_embedded += count;
+}
+
+static const embedded_program *find_embedded(const char *filename) {
+  const char *name = strrchr(filename, '/');
+  name = name ? name + 1 : filename;
+  for (unsigned i = 0; i < num_embedded; i++) {
+    if (!strcmp(embedded[i].filename, name)) {
+      return &embedded[i];
+    }
+  }
+  return NULL;
+}
+
+static int accepts_spirv(cl_device_id device) {
+  char version[256] = "";
+  // devices before OpenCL 2.1 don't know the query
+  if (clGetDeviceInfo(device, CL_DEVICE_IL_VERSION, sizeof(version), version, NULL)) {
+    return 0;
+  }
+  return strstr(version, "SPIR-V") != NULL;
+}
+
+// NULL if the device rejects the IL, the caller falls back to the source
+static cl_program build_program_from_il(cl_context ctx, cl_device_id device, const unsigned char *il, size_t size) {
+  double start = timer_ms();
+
+  // the IL is cached like a source, the key just hashes different bytes
+  char path[4200];
+  const char *dir = program_cache_dir();
+  if (dir) {
+    snprintf(path, sizeof(path), "%s/%016llx.bin", dir, (unsigned long long)cache_key(device, (const char *)il, size, IL_OPTIONS));
+    cl_program program = load_cached(ctx, device, path, "");
+    if (program) {
+      stats.hits++;
+      stats.il++;
+      stats.hit_ms += timer_ms() - start;
+      return program;
+    }
+  }
+
+  cl_int err;
+  cl_program program = clCreateProgramWithIL(ctx, il, size, &err);
+  if (err) {
+    return NULL;
+  }
+  if (clBuildProgram(program, 1, &device, "", NULL, NULL)) {
+    clReleaseProgram(program);
+    return NULL;
+  }
+  if (dir) {
+    store_cached(program, device, path);
+  }
+
+  stats.misses++;
+  stats.il++;
+  stats.miss_ms += timer_ms() - start;
+  return program;
+}
+
+typedef struct {
+  const char          *source;
+  size_t               length;
+  char                *owned;   // the file contents when the program isn't embedded
+  const unsigned char *il;      // SPIR-V to try first, NULL to build from the source
+  size_t               il_size;
+} program_source;
+
+static void resolve_source(const char *filename, cl_device_id device, const char *options, program_source *src) {
+  memset(src, 0, sizeof(*src));
+  const embedded_program *e = find_embedded(filename);
+  if (e) {
+    src->source = e->source;
+    src->length = e->source_size;
+    if (e->il && (!options || !*options) && !getenv("OCL_IL_DISABLE") && accepts_spirv(device)) {
+      src->il = e->il;
+      src->il_size = e->il_size;
+    }
+    return;
+  }
+
+  FILE *program_handle = fopen(filename, "r");
+  if (program_handle == NULL) {
+    perror("Couldn't find the program file");
+    exit(EXIT_FAILURE);
+  }
+  fseek(program_handle, 0, SEEK_END);
+  size_t program_size = ftell(program_handle);
+  rewind(program_handle);
+  src->owned = malloc(program_size);
+  src->length = fread(src->owned, sizeof(char), program_size, program_handle);
+  src->source = src->owned;
+  fclose(program_handle);
+}
+
+cl_program build_program_with_options(cl_context ctx, cl_device_id device, const char *filename, const char *options) {
+  program_source src;
+  resolve_source(filename, device, options, &src);
+  cl_program program = src.il ? build_program_from_il(ctx, device, src.il, src.il_size) : NULL;
+  if (!program) {
+    program = build_program_from_source(ctx, device, src.source, src.length, options);
+  }
+  free(src.owned);
+  return program;
+}
+
+cl_program build_program(cl_context ctx, cl_device_id device, const char *filename) {
+  return build_program_with_options(ctx, device, filename, NULL);
+}
+
+/* Asynchronous builds */
+
+typedef enum { FUTURE_BINARY, FUTURE_IL, FUTURE_SOURCE } future_kind;
+
+struct program_future {
+  cl_context      ctx;
+  cl_device_id    device;
+  char           *options;
+  program_source  src;
+  char            path[4200];
+  int             cached;   // path names the cache file
+  future_kind     kind;     // what the running build started from
+  cl_program      program;
+  double          start, end;
+  int             done;     // set by the notify callback, under the mutex
+  int             finished; // fallbacks, caching and statistics taken care of
+  pthread_mutex_t mutex;
+  pthread_cond_t  cond;
+};
+
+// runs on a driver thread, or inside clBuildProgram() on drivers that build synchronously
+static void CL_CALLBACK build_notify(cl_program program, void *user_data) {
+  (void)program;
+  program_future *f = user_data;
+  pthread_mutex_lock(&f->mutex);
+  f->end = timer_ms();
+  f->done = 1;
+  pthread_cond_broadcast(&f->cond);
+  pthread_mutex_unlock(&f->mutex);
+}
+
+static void start_build(program_future *f, cl_program program, future_kind kind, const char *options) {
+  f->program = program;
+  f->kind = kind;
+  // the callback only comes for builds that started, an error here means there won't be one
+  if (clBuildProgram(program, 1, &f->device, options, build_notify, f)) {
+    pthread_mutex_lock(&f->mutex);
+    f->end = timer_ms();
+    f->done = 1;
+    pthread_mutex_unlock(&f->mutex);
+  }
+}
+
+program_future *build_program_async(cl_context ctx, cl_device_id device, const char *filename, const char *options) {
+  program_future *f = calloc(1, sizeof(program_future));
+  f->ctx = ctx;
+  f->device = device;
+  f->options = strdup(options ? options : "");
+  pthread_mutex_init(&f->mutex, NULL);
+  pthread_cond_init(&f->cond, NULL);
+  if (getenv("OCL_BUILD_SYNC")) {
+    f->program = build_program_with_options(ctx, device, filename, options);
+    f->done = f->finished = 1;
+    return f;
+  }
+
+  resolve_source(filename, device, f->options, &f->src);
+  f->start = timer_ms();
+  const char *dir = program_cache_dir();
+  if (dir) {
+    // the same keys as the synchronous builds, so both share the cache
+    const char *key_source = f->src.il ? (const char *)f->src.il : f->src.source;
+    size_t key_length = f->src.il ? f->src.il_size : f->src.length;
+    uint64_t key = cache_key(device, key_source, key_length, f->src.il ? IL_OPTIONS : f->options);
+    snprintf(f->path, sizeof(f->path), "%s/%016llx.bin", dir, (unsigned long long)key);
+    f->cached = 1;
+    cl_program program = create_cached(ctx, device, f->path);
+    if (program) {
+      start_build(f, program, FUTURE_BINARY, f->src.il ? "" : f->options);
+      return f;
+    }
+  }
+
+  cl_int err;
+  if (f->src.il) {
+    cl_program program = clCreateProgramWithIL(ctx, f->src.il, f->src.il_size, &err);
+    if (!err) {
+      start_build(f, program, FUTURE_IL, "");
+      return f;
+    }
+  }
+  cl_program program = clCreateProgramWithSource(ctx, 1, &f->src.source, &f->src.length, &err);
+  check_error(err, "Couldn't create the program.");
+  start_build(f, program, FUTURE_SOURCE, f->options);
+  return f;
+}
+
+int program_future_ready(program_future *f) {
+  pthread_mutex_lock(&f->mutex);
+  int done = f->done;
+  pthread_mutex_unlock(&f->mutex);
+  return done;
+}
+
+// waits for the build, then does what the synchronous path would have done with its result
+static void finish(program_future *f) {
+  pthread_mutex_lock(&f->mutex);
+  while (!f->done) {
+    pthread_cond_wait(&f->cond, &f->mutex);
+  }
+  pthread_mutex_unlock(&f->mutex);
+  if (f->finished) {
+    return;
+  }
+  f->finished = 1;
+
+  cl_build_status status = CL_BUILD_ERROR;
+  clGetProgramBuildInfo(f->program, f->device, CL_PROGRAM_BUILD_STATUS, sizeof(status), &status, NULL);
+  if (status == CL_BUILD_SUCCESS) {
+    if (f->kind == FUTURE_BINARY) {
+      stats.hits++;
+      stats.hit_ms += f->end - f->start;
+    } else {
+      if (f->cached) {
+        store_cached(f->program, f->device, f->path);
+      }
+      stats.misses++;
+      stats.miss_ms += f->end - f->start;
+    }
+    stats.il += f->src.il != NULL;
+  } else if (f->kind == FUTURE_SOURCE) {
+    program_build_log(f->program, f->device);
+    exit(EXIT_FAILURE);
+  } else {
+    // a stale binary or a rejected IL, the synchronous builds retry with what's left
+    clReleaseProgram(f->program);
+    f->program = NULL;
+    if (f->kind == FUTURE_BINARY) {
+      remove(f->path);
+      if (f->src.il) {
+        f->program = build_program_from_il(f->ctx, f->device, f->src.il, f->src.il_size);
+      }
+    }
+    if (!f->program) {
+      f->program = build_program_from_source(f->ctx, f->device, f->src.source, f->src.length, f->options);
+    }
+  }
+  free(f->src.owned);
+  f->src.owned = NULL;
+}
+
+cl_kernel program_future_kernel(program_future *f, const char *name) {
+  finish(f);
+  cl_int err;
+  cl_kernel kernel = clCreateKernel(f->program, name, &err);
+  check_error(err, "Couldn't create a kernel.");
+  return kernel;
+}
+
+cl_program program_future_get(program_future *f) {
+  finish(f);
+  cl_program program = f->program;
+  pthread_cond_destroy(&f->cond);
+  pthread_mutex_destroy(&f->mutex);
+  free(f->options);
+  free(f);
+  return program;
+}
+
+program_cache_stats program_cache_get_stats(void) { return stats; }
+
+void program_cache_report(FILE *out) {
+  const char *dir = program_cache_dir();
+  fprintf(out, "Program cache: %u hit(s), %u miss(es) [%s]\n", stats.hits, stats.misses, dir ? dir : "disabled");
+  if (stats.misses) {
+    fprintf(out, "  cold build (source): %8.2f ms avg\n", stats.miss_ms / stats.misses);
+  }
+  if (stats.hits) {
+    fprintf(out, "  warm build (binary): %8.2f ms avg\n", stats.hit_ms / stats.hits);
+  }
+  if (stats.il) {
+    fprintf(out, "  from embedded SPIR-V: %u program(s)\n", stats.il);
+  }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <stdio.h>
+
+// Builds programs through an on-disk cache of device binaries.
+//
+// The cache key hashes the program source, the build options and the platform/device/driver versions, so a driver
+// update or a changed .cl file simply misses. Binaries live in $OCL_CACHE_DIR, falling back to
+// $XDG_CACHE_HOME/opencl-in-action and ~/.cache/opencl-in-action. Setting OCL_CACHE_DISABLE always compiles from
+// source. A build failure prints the build log and exits.
+//
+// Executables built with ocl_embed_kernels() carry their .cl files, and SPIR-V compiled from them at build time when
+// clang and llvm-spirv were found, so they run without loose kernel files. build_program_with_options() looks the
+// file name up among the embedded programs first. Without build options it loads the SPIR-V with
+// clCreateProgramWithIL() on devices that report a SPIR-V IL version, falling back to the embedded source if the
+// device can't take it; options such as -D need the source, since the IL has already been preprocessed.
+// OCL_IL_DISABLE always builds from source.
+//
+// build_program_async() takes the same path through the embedded programs, the SPIR-V and the cache, but hands
+// clBuildProgram() a notify callback, so it returns once the driver has the build and the host can decode images or
+// parse input meanwhile; several calls in a row compile every program a pipeline needs side by side.
+// program_future_kernel() waits for the build and creates a kernel, program_future_get() waits and passes the program
+// on to the caller, freeing the future. Either one falls back the way the synchronous build does when a cached binary
+// or the IL turns out unusable, and a failed source build prints the log and exits. OCL_BUILD_SYNC builds inside
+// build_program_async(), to measure what the overlap saves.
+
+typedef struct {
+  unsigned hits;    // programs created from a cached binary
+  unsigned misses;  // programs compiled from source
+  double   hit_ms;  // total time spent on hits
+  double   miss_ms; // total time spent on misses
+  unsigned il;      // programs created from embedded SPIR-V, also counted as hits or misses
+} program_cache_stats;
+
+typedef struct {
+  const char          *filename; // without directories
+  const char          *source;
+  size_t               source_size;
+  const unsigned char *il;       // SPIR-V, NULL if the build couldn't produce it
+  size_t               il_size;
+} embedded_program;
+
+typedef struct program_future program_future;
+
+// clang-format off
+cl_program          build_program             (cl_context, cl_device_id, const char *filename);
+cl_program          build_program_with_options(cl_context, cl_device_id, const char *filename, const char *options);
+cl_program          build_program_from_source (cl_context, cl_device_id, const char *source, size_t length, const char *options);
+void                program_build_log         (cl_program, cl_device_id); // prints the device's build log to stdout
+program_cache_stats program_cache_get_stats   (void);
+void                program_cache_embed       (const embedded_program *, unsigned count); // called by the generated code
+const char         *program_cache_dir         (void); // NULL if caching is disabled or the directory can't be created
+void                program_cache_report      (FILE *);
+
+program_future     *build_program_async       (cl_context, cl_device_id, const char *filename, const char *options);
+int                 program_future_ready      (program_future *); // 1 once the build has finished, never blocks
+cl_kernel           program_future_kernel     (program_future *, const char *name);
+cl_program          program_future_get        (program_future *);
@@ -0,0 +1,421 @@
+#include "reduce.h"
+#include "device_caps.h"
+#include "error.h"
+#include "program_cache.h"
+#include "trace.h"
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGRAM_FILE "reduce.cl"
+#define PASS_KERNEL "reduce_pass"
+#define PARTIALS_KERNEL "reduce_partials"
+#define SINGLE_KERNEL "reduce_single"
+#define GROUPS_PER_UNIT 4 // work-groups of the single pass per compute unit
+#define MAX_ACC_SIZE 16   // an index and a double
+
+typedef struct {
+  const char *name;
+  caps_type caps;
+  size_t size;
+  const char *lowest, *highest; // as the kernels spell them
+  double low, high;
+} type_info;
+
+// clang-format off
+static const type_info types[] = {
+  [REDUCE_INT]    = {"int",    CAPS_INT,    sizeof(cl_int),    "INT_MIN",   "INT_MAX",  INT_MIN,   INT_MAX},
+  [REDUCE_UINT]   = {"uint",   CAPS_INT,    sizeof(cl_uint),   "0",         "UINT_MAX", 0,         UINT_MAX},
+  [REDUCE_FLOAT]  = {"float",  CAPS_FLOAT,  sizeof(cl_float),  "-INFINITY", "INFINITY", -INFINITY, INFINITY},
+  [REDUCE_DOUBLE] = {"double", CAPS_DOUBLE, sizeof(cl_double), "-INFINITY", "INFINITY", -INFINITY, INFINITY},
+};
+
+static const char *collective_names[] = {
+  [REDUCE_AUTO] = "auto", [REDUCE_TREE] = "tree", [REDUCE_SUB_GROUP] = "sub_group", [REDUCE_WORK_GROUP] = "work_group",
+};
+
+static const char *op_names[] = {
+  [REDUCE_SUM]    = "sum",    [REDUCE_PRODUCT] = "product", [REDUCE_MIN] = "min", [REDUCE_MAX] = "max",
+  [REDUCE_ARGMIN] = "argmin", [REDUCE_ARGMAX]  = "argmax",  [REDUCE_AND] = "and", [REDUCE_OR]  = "or",
+  [REDUCE_SUM_COMPENSATED] = "sum_compensated",
+};
+// clang-format on
+
+struct reducer {
+  cl_context context;
+  cl_program program;
+  cl_kernel pass;
+  cl_kernel partials;
+  cl_kernel single;
+  reduce_op op;
+  reduce_type type;
+  reduce_mode mode;
+  reduce_collective collective;
+  size_t acc_size;      // bytes of the kernels' accumulator
+  unsigned char identity[MAX_ACC_SIZE];
+  size_t local_size;
+  unsigned width;       // elements per work-item
+  cl_mem scratch[2];    // accumulators of the passes, which alternate between them
+  size_t scratch_count; // accumulators each scratch buffer holds
+  size_t max_groups;    // of the single pass
+  cl_mem group_results; // one accumulator per work-group of the single pass
+  cl_mem ticket;        // counts the finished work-groups of the single pass, the last one resets it
+  cl_mem result;        // of reducer_run()
+};
+
+const char *reduce_op_name(reduce_op op) { return op_names[op]; }
+
+const char *reduce_type_name(reduce_type type) { return types[type].name; }
+
+const char *reduce_collective_name(reduce_collective collective) { return collective_names[collective]; }
+
+// what the device and the operation allow of the request, OCL_REDUCE_COLLECTIVE decides for REDUCE_AUTO
+static reduce_collective pick_collective(const device_caps *caps, reduce_op op, reduce_collective wanted) {
+  const char *env = getenv("OCL_REDUCE_COLLECTIVE");
+  if (wanted == REDUCE_AUTO && env && *env) {
+    for (int c = REDUCE_TREE; c <= REDUCE_WORK_GROUP; c++) {
+      if (!strcmp(env, collective_names[c])) {
+        wanted = c;
+      }
+    }
+  }
+  if (op == REDUCE_PRODUCT || op == REDUCE_ARGMIN || op == REDUCE_ARGMAX || op == REDUCE_SUM_COMPENSATED) {
+    return REDUCE_TREE;
+  }
+  if ((wanted == REDUCE_AUTO || wanted == REDUCE_WORK_GROUP) && caps->work_group_collectives) {
+    return REDUCE_WORK_GROUP;
+  }
+  if ((wanted == REDUCE_AUTO || wanted == REDUCE_SUB_GROUP) && caps->sub_groups) {
+    return REDUCE_SUB_GROUP;
+  }
+  return REDUCE_TREE;
+}
+
+// the accumulator the kernels start from, laid out the way reducer_run() reads results
+static void set_identity(reducer *r) {
+  reduce_result identity = {.index = CL_ULONG_MAX};
+  double value = r->op == REDUCE_PRODUCT ? 1.0 : 0.0;
+  if (r->op == REDUCE_MIN || r->op == REDUCE_ARGMIN) {
+    value = types[r->type].high;
+  } else if (r->op == REDUCE_MAX || r->op == REDUCE_ARGMAX) {
+    value = types[r->type].low;
+  }
+  switch (r->type) {
+  case REDUCE_INT:
+    identity.value.i = (cl_int)value;
+    break;
+  case REDUCE_UINT:
+    identity.value.u = (cl_uint)value;
+    break;
+  case REDUCE_FLOAT:
+    identity.value.f = (cl_float)value;
+    break;
+  case REDUCE_DOUBLE:
+    identity.value.d = value;
+    break;
+  }
+  if (r->op == REDUCE_AND || r->op == REDUCE_OR) {
+    identity.value.i = r->op == REDUCE_AND;
+  }
+
+  if (r->op == REDUCE_ARGMIN || r->op == REDUCE_ARGMAX) {
+    memcpy(r->identity, &identity.index, sizeof(cl_ulong));
+    memcpy(r->identity + sizeof(cl_ulong), &identity.value, types[r->type].size);
+  } else if (r->op == REDUCE_SUM_COMPENSATED) {
+    memset(r->identity, 0, r->acc_size); // 0 + 0, in every type
+  } else {
+    memcpy(r->identity, &identity.value, r->acc_size);
+  }
+}
+
+reducer *reducer_create(cl_context context, cl_device_id device, reduce_op op, reduce_type type, size_t local_size) {
+  return reducer_create_collective(context, device, op, type, local_size, REDUCE_AUTO);
+}
+
+reducer *reducer_create_collective(cl_context context, cl_device_id device, reduce_op op, reduce_type type, size_t local_size,
+                                   reduce_collective collective) {
+  const device_caps *caps = device_caps_get(device);
+  if (type == REDUCE_DOUBLE && !caps->fp64) {
+    return NULL;
+  }
+  reducer *r = calloc(1, sizeof(reducer));
+  r->context = context;
+  clRetainContext(context);
+  r->op = op;
+  r->type = type;
+  r->collective = pick_collective(caps, op, collective);
+  if (op == REDUCE_ARGMIN || op == REDUCE_ARGMAX) {
+    r->acc_size = 2 * sizeof(cl_ulong); // the index, then the value padded to its alignment
+  } else if (op == REDUCE_AND || op == REDUCE_OR) {
+    r->acc_size = sizeof(cl_int);
+  } else if (op == REDUCE_SUM_COMPENSATED) {
+    r->acc_size = 2 * types[type].size; // the sum, then its rounding error
+  } else {
+    r->acc_size = types[type].size;
+  }
+  set_identity(r);
+
+  r->width = caps_vector_width(caps, types[type].caps, 4);
+  char options[256], op_macro[32], collective_options[64] = "";
+  snprintf(op_macro, sizeof(op_macro), "REDUCE_%s", op_names[op]);
+  for (char *c = op_macro; *c; c++) {
+    *c = toupper(*c);
+  }
+  if (r->collective != REDUCE_TREE) {
+    int n = snprintf(collective_options, sizeof(collective_options), " -cl-std=%s -DREDUCE_COLLECTIVE_%s", caps->cl_std,
+                     collective_names[r->collective]);
+    for (char *c = collective_options + n - strlen(collective_names[r->collective]); *c; c++) {
+      *c = toupper(*c);
+    }
+  }
+  snprintf(options, sizeof(options), "-DREDUCE_TYPE=%s -DTYPE_LOWEST=%s -DTYPE_HIGHEST=%s -D%s -DVECTOR_WIDTH=%u%s%s", types[type].name,
+           types[type].lowest, types[type].highest, op_macro, r->width, type == REDUCE_DOUBLE ? " -DREDUCE_FP64" : "",
+           collective_options);
+  r->program = build_program_with_options(context, device, PROGRAM_FILE, options);
+
+  cl_int err;
+  r->pass = clCreateKernel(r->program, PASS_KERNEL, &err);
+  check_error(err, "Couldn't create the reduction kernel.");
+  r->partials = clCreateKernel(r->program, PARTIALS_KERNEL, &err);
+  check_error(err, "Couldn't create the reduction kernel.");
+  r->single = clCreateKernel(r->program, SINGLE_KERNEL, &err);
+  check_error(err, "Couldn't create the reduction kernel.");
+
+  // a power of two the kernels, the device and its local memory all allow
+  if (local_size == 0 || local_size > caps->max_work_group_size) {
+    local_size = caps->max_work_group_size;
+  }
+  cl_kernel kernels[] = {r->pass, r->partials, r->single};
+  for (int i = 0; i < 3; i++) {
+    size_t kernel_max;
+    err = clGetKernelWorkGroupInfo(kernels[i], device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(kernel_max), &kernel_max, NULL);
+    check_error(err, "Couldn't query the reduction kernel's work-group size.");
+    if (local_size > kernel_max) {
+      local_size = kernel_max;
+    }
+  }
+  size_t limit = caps_local_pow2(caps, r->acc_size, 0);
+  r->local_size = 1;
+  while (2 * r->local_size <= local_size && 2 * r->local_size <= limit) {
+    r->local_size *= 2;
+  }
+
+  r->max_groups = caps->compute_units * GROUPS_PER_UNIT;
+  r->group_results = clCreateBuffer(context, CL_MEM_READ_WRITE, r->max_groups * r->acc_size, NULL, &err);
+  check_error(err, "Couldn't create the reduction group results buffer.");
+  cl_uint zero = 0;
+  r->ticket = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(zero), &zero, &err);
+  check_error(err, "Couldn't create the reduction ticket buffer.");
+  r->result = clCreateBuffer(context, CL_MEM_READ_WRITE, r->acc_size, NULL, &err);
+  check_error(err, "Couldn't create the reduction result buffer.");
+  return r;
+}
+
+void reducer_destroy(reducer *r) {
+  for (int i = 0; i < 2; i++) {
+    if (r->scratch[i]) {
+      clReleaseMemObject(r->scratch[i]);
+    }
+  }
+  clReleaseMemObject(r->group_results);
+  clReleaseMemObject(r->ticket);
+  clReleaseMemObject(r->result);
+  clReleaseKernel(r->pass);
+  clReleaseKernel(r->partials);
+  clReleaseKernel(r->single);
+  clReleaseProgram(r->program);
+  clReleaseContext(r->context);
+  free(r);
+}
+
+void reducer_set_mode(reducer *r, reduce_mode mode) { r->mode = mode; }
+
+size_t reducer_local_size(const reducer *r) { return r->local_size; }
+
+reduce_collective reducer_collective(const reducer *r) { return r->collective; }
+
+size_t reducer_result_size(const reducer *r) { return r->acc_size; }
+
+static size_t pass_groups(const reducer *r, size_t count) {
+  size_t per_group = r->local_size * r->width;
+  return (count + per_group - 1) / per_group;
+}
+
+unsigned reducer_passes(const reducer *r, size_t count) {
+  if (r->mode == REDUCE_SINGLE_PASS) {
+    return 1;
+  }
+  unsigned passes = 1;
+  for (size_t n = pass_groups(r, count); n > 1; n = pass_groups(r, n)) {
+    passes++;
+  }
+  return passes;
+}
+
+// the first pass writes the most accumulators, both buffers hold that many
+static cl_int reserve_scratch(reducer *r, size_t count) {
+  if (count <= r->scratch_count) {
+    return CL_SUCCESS;
+  }
+  cl_int err = CL_SUCCESS;
+  for (int i = 0; i < 2; i++) {
+    if (r->scratch[i]) {
+      clReleaseMemObject(r->scratch[i]);
+    }
+    r->scratch[i] = clCreateBuffer(r->context, CL_MEM_READ_WRITE, count * r->acc_size, NULL, &err);
+    if (err) {
+      r->scratch[i] = NULL;
+      r->scratch_count = 0;
+      return err;
+    }
+  }
+  r->scratch_count = count;
+  return CL_SUCCESS;
+}
+
+static void hand_out(cl_event event, cl_event *target) {
+  if (target) {
+    clRetainEvent(event);
+    *target = event;
+  }
+}
+
+// a launch of its own for every level, the passes alternate between the scratch buffers
+static cl_int enqueue_passes(reducer *r, cl_command_queue queue, cl_mem input, size_t count, cl_mem result, cl_event *start,
+                             cl_event *end) {
+  cl_int err = CL_SUCCESS;
+  size_t groups = pass_groups(r, count);
+  if (groups > 1 && (err = reserve_scratch(r, groups))) {
+    return err;
+  }
+
+  cl_event first = NULL, last = NULL;
+  cl_mem in = input;
+  for (unsigned pass = 0; err == CL_SUCCESS; pass++) {
+    groups = pass_groups(r, count);
+    cl_kernel kernel = pass ? r->partials : r->pass;
+    cl_mem out = groups == 1 ? result : r->scratch[pass % 2];
+    cl_ulong n = count;
+    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &in);
+    err |= clSetKernelArg(kernel, 1, sizeof(n), &n);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &out);
+    err |= clSetKernelArg(kernel, 3, r->local_size * r->acc_size, NULL);
+    if (err) {
+      break;
+    }
+    if (last && last != first) {
+      clReleaseEvent(last);
+    }
+    size_t global_size = groups * r->local_size;
+    err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global_size, &r->local_size, 0, NULL, &last);
+    if (err) {
+      last = NULL;
+      break;
+    }
+    if (!first) {
+      first = last;
+    }
+    if (groups == 1) {
+      break;
+    }
+    in = out;
+    count = groups;
+  }
+
+  if (!err) {
+    hand_out(first, start);
+    hand_out(last, end);
+  }
+  if (last && last != first) {
+    clReleaseEvent(last);
+  }
+  if (first) {
+    clReleaseEvent(first);
+  }
+  return err;
+}
+
+// a single launch with as many work-groups as keep the compute units busy, fewer for short inputs
+static cl_int enqueue_single(reducer *r, cl_command_queue queue, cl_mem input, size_t count, cl_mem result, cl_event *event) {
+  size_t groups = pass_groups(r, count);
+  if (groups > r->max_groups) {
+    groups = r->max_groups;
+  }
+  cl_ulong n = count;
+  cl_int err = clSetKernelArg(r->single, 0, sizeof(cl_mem), &input);
+  err |= clSetKernelArg(r->single, 1, sizeof(n), &n);
+  err |= clSetKernelArg(r->single, 2, sizeof(cl_mem), &r->group_results);
+  err |= clSetKernelArg(r->single, 3, sizeof(cl_mem), &r->ticket);
+  err |= clSetKernelArg(r->single, 4, sizeof(cl_mem), &result);
+  err |= clSetKernelArg(r->single, 5, r->local_size * r->acc_size, NULL);
+  if (err) {
+    return err;
+  }
+  size_t global_size = groups * r->local_size;
+  return clEnqueueNDRangeKernel(queue, r->single, 1, NULL, &global_size, &r->local_size, 0, NULL, event);
+}
+
+cl_int reducer_enqueue(reducer *r, cl_command_queue queue, cl_mem input, size_t count, cl_mem result, cl_event *start, cl_event *end) {
+  cl_event event;
+  cl_int err;
+  if (count == 0) {
+    err = clEnqueueFillBuffer(queue, result, r->identity, r->acc_size, 0, r->acc_size, 0, NULL, &event);
+  } else if (r->mode == REDUCE_SINGLE_PASS) {
+    err = enqueue_single(r, queue, input, count, result, &event);
+  } else {
+    return enqueue_passes(r, queue, input, count, result, start, end);
+  }
+  if (!err) {
+    hand_out(event, start);
+    hand_out(event, end);
+    clReleaseEvent(event);
+  }
+  return err;
+}
+
+// hi + lo of a compensated pair, in double and rounded to the element type
+static double compensated_value(reduce_type type, const unsigned char *pair, reduce_result *result) {
+  size_t size = types[type].size;
+  reduce_result hi, lo;
+  memcpy(&hi.value, pair, size);
+  memcpy(&lo.value, pair + size, size);
+  double sum;
+  switch (type) {
+  case REDUCE_INT:
+    result->value.i = hi.value.i + lo.value.i;
+    return (double)hi.value.i + lo.value.i;
+  case REDUCE_UINT:
+    result->value.u = hi.value.u + lo.value.u;
+    return (double)hi.value.u + lo.value.u;
+  case REDUCE_FLOAT:
+    sum = (double)hi.value.f + lo.value.f;
+    result->value.f = (cl_float)sum;
+    return sum;
+  case REDUCE_DOUBLE:
+  default:
+    result->value.d = hi.value.d + lo.value.d;
+    return result->value.d;
+  }
+}
+
+reduce_result reducer_run(reducer *r, cl_command_queue queue, cl_mem input, size_t count) {
+  cl_int err = reducer_enqueue(r, queue, input, count, r->result, NULL, NULL);
+  check_error(err, "Couldn't enqueue the reduction.");
+  unsigned char acc[MAX_ACC_SIZE];
+  err = clEnqueueReadBuffer(queue, r->result, CL_BLOCKING, 0, r->acc_size, acc, 0, NULL, NULL);
+  check_error(err, "Couldn't read the reduction result.");
+
+  reduce_result result = {.index = CL_ULONG_MAX};
+  if (r->op == REDUCE_ARGMIN || r->op == REDUCE_ARGMAX) {
+    memcpy(&result.index, acc, sizeof(cl_ulong));
+    memcpy(&result.value, acc + sizeof(cl_ulong), types[r->type].size);
+  } else if (r->op == REDUCE_SUM_COMPENSATED) {
+    result.compensated = compensated_value(r->type, acc, &result);
+  } else {
+    memcpy(&result.value, acc, r->acc_size);
+  }
+  return result;
+}
@@ -0,0 +1,278 @@
+// Kernels of reduce.h. reducer_create() builds them for one operation and element type:
+//   REDUCE_TYPE                element type, int, uint, float or double
+//   TYPE_LOWEST, TYPE_HIGHEST  its extreme values, the identities of max and min
+//   REDUCE_SUM ... REDUCE_OR, REDUCE_SUM_COMPENSATED
+//                              the operation, exactly one of them defined
+//   VECTOR_WIDTH               elements per vector load, 2, 4, 8 or 16
+//   REDUCE_COLLECTIVE_SUB_GROUP or REDUCE_COLLECTIVE_WORK_GROUP
+//                              the builtins that combine a work-group's accumulators instead of the local-memory tree,
+//                              for sum, min, max, and and or; they need -cl-std=CL2.0 or later
+#ifndef REDUCE_TYPE
+#define REDUCE_TYPE float
+#define TYPE_LOWEST (-INFINITY)
+#define TYPE_HIGHEST INFINITY
+#define REDUCE_SUM
+#endif
+#ifndef VECTOR_WIDTH
+#define VECTOR_WIDTH 4
+#endif
+#ifdef REDUCE_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+#if defined(REDUCE_COLLECTIVE_SUB_GROUP) && defined(cl_khr_subgroups)
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+#endif
+#define VECTOR_TYPE(type, width) VECTOR_TYPE_(type, width)
+#define VECTOR_TYPE_(type, width) type##width
+#define VLOAD(width) VLOAD_(width)
+#define VLOAD_(width) vload##width
+typedef REDUCE_TYPE T;
+typedef VECTOR_TYPE(REDUCE_TYPE, VECTOR_WIDTH) TN;
+
+// The accumulator of the operation, its identity, how the element at an index becomes an accumulator (LIFT) and how
+// two accumulators combine. The arg variants keep the index of their value and prefer the lower index on ties, so the
+// result doesn't depend on the order in which work-groups finish.
+#if defined(REDUCE_SUM)
+typedef T acc_t;
+#define IDENTITY ((acc_t)0)
+#define LIFT(x, i) (x)
+#define COMBINE(a, b) ((a) + (b))
+#define COLLECTIVE(scope, x) scope##_reduce_add(x)
+#elif defined(REDUCE_PRODUCT)
+typedef T acc_t;
+#define IDENTITY ((acc_t)1)
+#define LIFT(x, i) (x)
+#define COMBINE(a, b) ((a) * (b))
+#elif defined(REDUCE_MIN)
+typedef T acc_t;
+#define IDENTITY ((acc_t)TYPE_HIGHEST)
+#define LIFT(x, i) (x)
+#define COMBINE(a, b) min(a, b)
+#define COLLECTIVE(scope, x) scope##_reduce_min(x)
+#elif defined(REDUCE_MAX)
+typedef T acc_t;
+#define IDENTITY ((acc_t)TYPE_LOWEST)
+#define LIFT(x, i) (x)
+#define COMBINE(a, b) max(a, b)
+#define COLLECTIVE(scope, x) scope##_reduce_max(x)
+#elif defined(REDUCE_ARGMIN) || defined(REDUCE_ARGMAX)
+typedef struct {
+   ulong index;
+   T     value;
+} acc_t;
+
+acc_t make_acc(ulong index, T value) {
+
+   acc_t acc;
+   acc.index = index;
+   acc.value = value;
+   return acc;
+}
+
+acc_t better(acc_t a, acc_t b) {
+
+#ifdef REDUCE_ARGMIN
+   int a_wins = a.value < b.value, b_wins = b.value < a.value;
+#else
+   int a_wins = a.value > b.value, b_wins = b.value > a.value;
+#endif
+   return a_wins || (!b_wins && a.index < b.index) ? a : b;
+}
+
+#ifdef REDUCE_ARGMIN
+#define IDENTITY make_acc(ULONG_MAX, TYPE_HIGHEST)
+#else
+#define IDENTITY make_acc(ULONG_MAX, TYPE_LOWEST)
+#endif
+#define LIFT(x, i) make_acc(i, x)
+#define COMBINE(a, b) better(a, b)
+#elif defined(REDUCE_AND)
+typedef int acc_t;
+#define IDENTITY 1
+#define LIFT(x, i) ((x) != 0)
+#define COMBINE(a, b) ((a) && (b))
+#define COLLECTIVE(scope, x) scope##_all(x)
+#elif defined(REDUCE_OR)
+typedef int acc_t;
+#define IDENTITY 0
+#define LIFT(x, i) ((x) != 0)
+#define COMBINE(a, b) ((a) || (b))
+#define COLLECTIVE(scope, x) scope##_any(x)
+#elif defined(REDUCE_SUM_COMPENSATED)
+// The sum rounded to T and the rounding error it left behind, so the pair carries about twice T's precision. Two-sum
+// recovers the exact error of every addition: an element added to a pair is compensated the way Kahan-Babuska
+// summation does it, two pairs add as double-float numbers, and the result is renormalised so that lo stays below half
+// an ulp of hi. Contracting or reassociating these additions would lose the error terms; the kernels are built without
+// the unsafe math options.
+typedef struct {
+   T hi;
+   T lo;
+} acc_t;
+
+acc_t make_pair(T hi, T lo) {
+
+   acc_t acc;
+   acc.hi = hi;
+   acc.lo = lo;
+   return acc;
+}
+
+acc_t add_pair(acc_t a, acc_t b) {
+
+   T sum = a.hi + b.hi;
+   T b_part = sum - a.hi;
+   T error = (a.hi - (sum - b_part)) + (b.hi - b_part);
+   error += a.lo + b.lo;
+   T hi = sum + error;
+   return make_pair(hi, error - (hi - sum));
+}
+
+#define IDENTITY make_pair(0, 0)
+#define LIFT(x, i) make_pair(x, 0)
+#define COMBINE(a, b) add_pair(a, b)
+#endif
+#if (defined(REDUCE_COLLECTIVE_SUB_GROUP) || defined(REDUCE_COLLECTIVE_WORK_GROUP)) && !defined(COLLECTIVE)
+#error "The operation has no collective builtin, build it with the local-memory tree."
+#endif
+
+// combines the components of the vector loaded from element index base on into acc
+acc_t combine_vector(acc_t acc, TN v, ulong base) {
+
+   T *components = (T*)&v;
+   for(int i = 0; i < VECTOR_WIDTH; i++) {
+      acc = COMBINE(acc, LIFT(components[i], base + i));
+   }
+   return acc;
+}
+
+// Combines the accumulators of a work-group, the result is valid in work-item 0. The tree needs a power-of-two local
+// size and one partials entry per work-item, the sub-group path one per sub-group; partials may be reused after the
+// next barrier.
+acc_t group_reduce(acc_t acc, local acc_t* partials) {
+
+#if defined(REDUCE_COLLECTIVE_WORK_GROUP)
+   return COLLECTIVE(work_group, acc);
+#elif defined(REDUCE_COLLECTIVE_SUB_GROUP)
+   // every sub-group reduces in registers, then the first one reduces the sub-groups' results
+   uint sub_group = get_sub_group_id();
+   acc = COLLECTIVE(sub_group, acc);
+   if(get_sub_group_local_id() == 0) {
+      partials[sub_group] = acc;
+   }
+   barrier(CLK_LOCAL_MEM_FENCE);
+   if(sub_group == 0) {
+      acc = IDENTITY;
+      for(uint i = get_sub_group_local_id(); i < get_num_sub_groups(); i += get_sub_group_size()) {
+         acc = COMBINE(acc, partials[i]);
+      }
+      acc = COLLECTIVE(sub_group, acc);
+   }
+   return acc;
+#else
+   size_t lid = get_local_id(0);
+   partials[lid] = acc;
+   barrier(CLK_LOCAL_MEM_FENCE);
+   for(size_t i = get_local_size(0)/2; i>0; i >>= 1) {
+      if(lid < i) {
+         partials[lid] = COMBINE(partials[lid], partials[lid + i]);
+      }
+      barrier(CLK_LOCAL_MEM_FENCE);
+   }
+   return partials[0];
+#endif
+}
+
+// First pass over count elements: every work-item combines VECTOR_WIDTH consecutive elements, every work-group
+// get_local_size(0) * VECTOR_WIDTH of them, and the group's accumulator goes to out[group]. The local size must be a
+// power of two; work-items past the end contribute the identity and the last full vector is followed by guarded
+// scalar loads.
+kernel void reduce_pass(global const T* in,
+                        ulong           count,
+                        global acc_t*   out,
+                        local  acc_t*   partials) {
+
+   size_t lid  = get_local_id(0);
+   ulong  base = get_global_id(0) * VECTOR_WIDTH;
+
+   acc_t acc = IDENTITY;
+   if(base + VECTOR_WIDTH <= count) {
+      acc = combine_vector(acc, VLOAD(VECTOR_WIDTH)(get_global_id(0), in), base);
+   }
+   else {
+      for(ulong i = base; i < count; i++) {
+         acc = COMBINE(acc, LIFT(in[i], i));
+      }
+   }
+   acc = group_reduce(acc, partials);
+   if(lid == 0) {
+      out[get_group_id(0)] = acc;
+   }
+}
+
+// The later passes, over the accumulators the previous one left: the same grouping, with scalar loads.
+kernel void reduce_partials(global const acc_t* in,
+                            ulong               count,
+                            global acc_t*       out,
+                            local  acc_t*       partials) {
+
+   size_t lid  = get_local_id(0);
+   ulong  base = get_global_id(0) * VECTOR_WIDTH;
+
+   acc_t acc = IDENTITY;
+   for(ulong i = base; i < base + VECTOR_WIDTH && i < count; i++) {
+      acc = COMBINE(acc, in[i]);
+   }
+   acc = group_reduce(acc, partials);
+   if(lid == 0) {
+      out[get_group_id(0)] = acc;
+   }
+}
+
+// The whole reduction in one launch: work-items stride over the vectors of in by the global size and keep their
+// accumulator in registers, every work-group leaves its accumulator in group_results[group], and the group that takes
+// the last ticket combines them into out[0]. The fence orders a group's result before its ticket, the counter is back
+// at 0 for the next launch once the last group is done.
+kernel void reduce_single(global const T*        in,
+                          ulong                  count,
+                          volatile global acc_t* group_results,
+                          volatile global uint*  ticket,
+                          global acc_t*          out,
+                          local  acc_t*          partials) {
+
+   size_t lid         = get_local_id(0);
+   size_t group_size  = get_local_size(0);
+   size_t global_size = get_global_size(0);
+   size_t num_groups  = get_num_groups(0);
+   local  int last_group;
+
+   acc_t acc = IDENTITY;
+   ulong vectors = count / VECTOR_WIDTH;
+   for(ulong v = get_global_id(0); v < vectors; v += global_size) {
+      acc = combine_vector(acc, VLOAD(VECTOR_WIDTH)(v, in), v * VECTOR_WIDTH);
+   }
+   for(ulong i = vectors * VECTOR_WIDTH + get_global_id(0); i < count; i += global_size) {
+      acc = COMBINE(acc, LIFT(in[i], i));
+   }
+   acc = group_reduce(acc, partials);
+   if(lid == 0) {
+      group_results[get_group_id(0)] = acc;
+      write_mem_fence(CLK_GLOBAL_MEM_FENCE);
+      last_group = atomic_inc(ticket) == num_groups - 1;
+   }
+   barrier(CLK_LOCAL_MEM_FENCE);
+   if(!last_group) {
+      return;
+   }
+
+   read_mem_fence(CLK_GLOBAL_MEM_FENCE);
+   acc = IDENTITY;
+   for(size_t i = lid; i < num_groups; i += group_size) {
+      acc_t group_result = group_results[i];
+      acc = COMBINE(acc, group_result);
+   }
+   acc = group_reduce(acc, partials);
+   if(lid == 0) {
+      out[0] = acc;
+      *ticket = 0;
+   }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <stddef.h>
+
+// Reduces a buffer of any length on the device: sum, product, min, max, argmin, argmax, logical and/or over int, uint,
+// float or double elements, and a compensated sum that keeps about twice the precision of the element type.
+//
+// Every operation comes from the same kernels in Common/reduce.cl, built with macros for the element type and the
+// operation's accumulator, identity and combine step; reducer_create() picks them at runtime and the program cache
+// keeps the binary of each combination. Argmin and argmax carry the element's index along with its value and settle
+// ties on the lower index, logical and/or treat nonzero elements as true and produce an int.
+//
+// A plain float sum loses digits as it grows: every addition rounds to 24 bits, and a million elements already cost
+// several significant digits. REDUCE_SUM_COMPENSATED accumulates a pair instead, the rounded sum and the error the
+// rounding left, compensating every element Kahan-style and adding pairs as double-float numbers in the tree. The
+// result is nearly as accurate as a double sum of float input and, since the pair stays in float registers, runs at
+// float speed on devices with slow or no fp64. The result buffer holds the pair; reducer_run() adds its halves in double.
+//
+// Each pass of reducer_enqueue() has every work-item load one vector of the device's preferred width for the type
+// (4 at least), guards the loads of the tail instead of requiring the count to be a multiple of anything, and leaves one
+// accumulator per work-group; passes repeat until a single work-group produces the result, so the number of passes
+// follows from the count and the local size (reducer_passes()). The input buffer is only read, the accumulators go to
+// scratch buffers the reducer keeps and grows as needed.
+//
+// REDUCE_SINGLE_PASS does it all in one launch instead. Only as many work-groups start as keep the compute units busy,
+// their work-items stride over the input by the global size and accumulate in registers, and every group leaves its
+// result in a small buffer. Each group then takes a ticket from an atomic counter, and the group holding the last
+// ticket combines the group results and resets the counter. Launch overhead no longer grows with the count, and the
+// input is read exactly once.
+//
+// The accumulators of a work-group are combined by a barrier-synchronised tree in local memory, or by the collective
+// builtins of OpenCL C 2.0 where the device has them: work_group_reduce_*() does the whole group in one call,
+// sub_group_reduce_*() (cl_khr_subgroups, or the 3.0 feature) each sub-group in registers and leaves local memory only
+// the sub-groups' results. REDUCE_AUTO takes the work-group builtins, then the sub-group ones, then the tree, and
+// OCL_REDUCE_COLLECTIVE=tree|sub_group|work_group overrides that choice. Product, argmin, argmax and the compensated
+// sum have no builtin and always use the tree, as does any request the device can't serve; reducer_collective() tells
+// which one was built.
+//
+// Hosts embed Common/reduce.cl next to their own kernels with ocl_embed_kernels(<target> ../../Common/reduce.cl). A
+// reducer belongs to one context and device and isn't thread-safe: concurrent reductions would share its kernels,
+// scratch buffers and ticket counter.
+
+typedef struct reducer reducer;
+
+typedef enum {
+  REDUCE_MULTI_PASS,  // one launch per level, the default
+  REDUCE_SINGLE_PASS, // one launch, the last work-group to finish combines the group results
+} reduce_mode;
+
+typedef enum {
+  REDUCE_SUM,
+  REDUCE_PRODUCT,
+  REDUCE_MIN,
+  REDUCE_MAX,
+  REDUCE_ARGMIN,
+  REDUCE_ARGMAX,
+  REDUCE_AND,
+  REDUCE_OR,
+  REDUCE_SUM_COMPENSATED, // a sum as a (sum, rounding error) pair of the element type, float and double benefit
+} reduce_op;
+
+typedef enum {
+  REDUCE_AUTO,       // the fastest the device supports for the operation
+  REDUCE_TREE,       // local memory and barriers, works everywhere
+  REDUCE_SUB_GROUP,  // sub_group_reduce_*() and a short pass over the sub-groups' results
+  REDUCE_WORK_GROUP, // work_group_reduce_*()
+} reduce_collective;
+
+typedef enum { REDUCE_INT, REDUCE_UINT, REDUCE_FLOAT, REDUCE_DOUBLE } reduce_type;
+
+typedef struct {
+  union {
+    cl_int    i; // also the result of REDUCE_AND and REDUCE_OR, 0 or 1
+    cl_uint   u;
+    cl_float  f;
+    cl_double d;
+  } value;
+  cl_ulong index;       // the element REDUCE_ARGMIN or REDUCE_ARGMAX found, CL_ULONG_MAX for an empty input
+  cl_double compensated; // REDUCE_SUM_COMPENSATED: both halves of the pair added in double, value rounds it to the type
+} reduce_result;
+
+// clang-format off
+reducer          *reducer_create           (cl_context, cl_device_id, reduce_op, reduce_type,
+                                            size_t local_size); // rounded down to a power of two, 0 for the largest;
+                                                                // NULL for double on a device without fp64
+reducer          *reducer_create_collective(cl_context, cl_device_id, reduce_op, reduce_type, size_t local_size,
+                                            reduce_collective); // reducer_create() asks for REDUCE_AUTO
+void              reducer_destroy          (reducer *);
+void              reducer_set_mode         (reducer *, reduce_mode);
+size_t            reducer_local_size       (const reducer *);
+reduce_collective reducer_collective       (const reducer *); // never REDUCE_AUTO
+unsigned          reducer_passes           (const reducer *, size_t count);
+size_t            reducer_result_size      (const reducer *); // bytes reducer_enqueue() writes to its result buffer
+const char       *reduce_op_name           (reduce_op);
+const char       *reduce_type_name         (reduce_type);
+const char       *reduce_collective_name   (reduce_collective);
+
+// enqueues every launch, the result lands at the start of result; start and end (either may be NULL) mark the first
+// and the last command
+cl_int            reducer_enqueue          (reducer *, cl_command_queue, cl_mem input, size_t count, cl_mem result,
+                                            cl_event *start, cl_event *end);
+reduce_result     reducer_run              (reducer *, cl_command_queue, cl_mem input, size_t count); // blocking, exits on errors
@@ -0,0 +1,441 @@
+#include "reference.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_THREADS 256
+// below this much work per thread, starting the thread costs more than it saves
+#define MIN_GRAIN 4096
+#define GEMM_BLOCK_K 128
+#define GEMM_BLOCK_N 1024
+#define GEMM_BLOCK_BT 64
+#define LANES 8
+
+typedef void (*range_fn)(void *ctx, size_t begin, size_t end);
+
+typedef struct {
+  range_fn fn;
+  void *ctx;
+  size_t begin, end;
+} range_task;
+
+unsigned ref_threads(void) {
+  const char *env = getenv("OCL_REF_THREADS");
+  long threads = env && atoi(env) > 0 ? atoi(env) : sysconf(_SC_NPROCESSORS_ONLN);
+  return threads < 1 ? 1 : threads > MAX_THREADS ? MAX_THREADS : threads;
+}
+
+static void *run_range(void *arg) {
+  range_task *t = arg;
+  t->fn(t->ctx, t->begin, t->end);
+  return NULL;
+}
+
+// splits [0, n) into contiguous ranges of at least grain items, the calling thread takes the first one
+static void parallel_for(size_t n, size_t grain, range_fn fn, void *ctx) {
+  size_t threads = ref_threads();
+  if (threads > n / grain) {
+    threads = n / grain ? n / grain : 1;
+  }
+  if (threads == 1) {
+    fn(ctx, 0, n);
+    return;
+  }
+  range_task tasks[MAX_THREADS];
+  pthread_t ids[MAX_THREADS];
+  for (size_t t = 0; t < threads; t++) {
+    tasks[t] = (range_task){fn, ctx, n * t / threads, n * (t + 1) / threads};
+  }
+  size_t started = 1;
+  for (; started < threads; started++) {
+    if (pthread_create(&ids[started], NULL, run_range, &tasks[started])) {
+      break;
+    }
+  }
+  // whatever couldn't get a thread runs here
+  for (size_t t = started; t < threads; t++) {
+    run_range(&tasks[t]);
+  }
+  run_range(&tasks[0]);
+  for (size_t t = 1; t < started; t++) {
+    pthread_join(ids[t], NULL);
+  }
+}
+
+/* GEMM */
+
+typedef struct {
+  size_t n, k;
+  const float *a, *b;
+  float *c;
+} gemm_args;
+
+// blocks of B stay in cache while every row of the thread's range streams past them
+static void gemm_rows(void *ctx, size_t begin, size_t end) {
+  const gemm_args *g = ctx;
+  for (size_t i = begin; i < end; i++) {
+    memset(g->c + i * g->n, 0, g->n * sizeof(float));
+  }
+  for (size_t p0 = 0; p0 < g->k; p0 += GEMM_BLOCK_K) {
+    size_t p1 = p0 + GEMM_BLOCK_K < g->k ? p0 + GEMM_BLOCK_K : g->k;
+    for (size_t j0 = 0; j0 < g->n; j0 += GEMM_BLOCK_N) {
+      size_t j1 = j0 + GEMM_BLOCK_N < g->n ? j0 + GEMM_BLOCK_N : g->n;
+      for (size_t i = begin; i < end; i++) {
+        float *restrict c_row = g->c + i * g->n;
+        for (size_t p = p0; p < p1; p++) {
+          const float a_ip = g->a[i * g->k + p];
+          const float *restrict b_row = g->b + p * g->n;
+          for (size_t j = j0; j < j1; j++) {
+            c_row[j] += a_ip * b_row[j];
+          }
+        }
+      }
+    }
+  }
+}
+
+void ref_gemm(size_t m, size_t n, size_t k, const float *a, const float *b, float *c) {
+  gemm_args g = {n, k, a, b, c};
+  parallel_for(m, 1 + MIN_GRAIN / (n * k + 1), gemm_rows, &g);
+}
+
+// independent partial sums in fixed lanes, which the compiler turns into vector registers
+static float dot(const float *restrict x, const float *restrict y, size_t n) {
+  float lanes[LANES] = {0};
+  size_t i = 0;
+  for (; i + LANES <= n; i += LANES) {
+    for (int l = 0; l < LANES; l++) {
+      lanes[l] += x[i + l] * y[i + l];
+    }
+  }
+  float sum = 0.0f;
+  for (; i < n; i++) {
+    sum += x[i] * y[i];
+  }
+  for (int l = 0; l < LANES; l++) {
+    sum += lanes[l];
+  }
+  return sum;
+}
+
+static void gemm_bt_rows(void *ctx, size_t begin, size_t end) {
+  const gemm_args *g = ctx;
+  for (size_t i = begin; i < end; i++) {
+    memset(g->c + i * g->n, 0, g->n * sizeof(float));
+  }
+  for (size_t p0 = 0; p0 < g->k; p0 += GEMM_BLOCK_N) {
+    size_t len = p0 + GEMM_BLOCK_N < g->k ? GEMM_BLOCK_N : g->k - p0;
+    for (size_t j0 = 0; j0 < g->n; j0 += GEMM_BLOCK_BT) {
+      size_t j1 = j0 + GEMM_BLOCK_BT < g->n ? j0 + GEMM_BLOCK_BT : g->n;
+      for (size_t i = begin; i < end; i++) {
+        for (size_t j = j0; j < j1; j++) {
+          g->c[i * g->n + j] += dot(g->a + i * g->k + p0, g->b + j * g->k + p0, len);
+        }
+      }
+    }
+  }
+}
+
+void ref_gemm_bt(size_t m, size_t n, size_t k, const float *a, const float *bt, float *c) {
+  gemm_args g = {n, k, a, bt, c};
+  parallel_for(m, 1 + MIN_GRAIN / (n * k + 1), gemm_bt_rows, &g);
+}
+
+/* FFT: iterative radix 2, the stages run their butterflies in parallel */
+
+typedef struct {
+  size_t n, half;
+  unsigned log2_n, log2_half;
+  const double *in;
+  double *out, *twiddles;
+  double sign, scale;
+} fft_args;
+
+static void fft_twiddles(void *ctx, size_t begin, size_t end) {
+  const fft_args *f = ctx;
+  for (size_t k = begin; k < end; k++) {
+    double angle = f->sign * 2.0 * M_PI * (double)k / (double)f->n;
+    f->twiddles[2 * k] = cos(angle);
+    f->twiddles[2 * k + 1] = sin(angle);
+  }
+}
+
+static void fft_reorder(void *ctx, size_t begin, size_t end) {
+  const fft_args *f = ctx;
+  for (size_t i = begin; i < end; i++) {
+    size_t reversed = 0;
+    for (unsigned bit = 0; bit < f->log2_n; bit++) {
+      reversed |= ((i >> bit) & 1) << (f->log2_n - 1 - bit);
+    }
+    f->out[2 * reversed] = f->in[2 * i];
+    f->out[2 * reversed + 1] = f->in[2 * i + 1];
+  }
+}
+
+// butterfly b of the stage combines point k of a block of 2 * half points with its partner half points further on
+static void fft_butterflies(void *ctx, size_t begin, size_t end) {
+  const fft_args *f = ctx;
+  size_t stride = f->n / (2 * f->half);
+  for (size_t b = begin; b < end; b++) {
+    size_t k = b & (f->half - 1);
+    size_t top = ((b >> f->log2_half) << (f->log2_half + 1)) + k, bottom = top + f->half;
+    double w_re = f->twiddles[2 * k * stride], w_im = f->twiddles[2 * k * stride + 1];
+    double *x = f->out;
+    double t_re = w_re * x[2 * bottom] - w_im * x[2 * bottom + 1];
+    double t_im = w_re * x[2 * bottom + 1] + w_im * x[2 * bottom];
+    x[2 * bottom] = x[2 * top] - t_re;
+    x[2 * bottom + 1] = x[2 * top + 1] - t_im;
+    x[2 * top] += t_re;
+    x[2 * top + 1] += t_im;
+  }
+}
+
+static void fft_scale(void *ctx, size_t begin, size_t end) {
+  const fft_args *f = ctx;
+  for (size_t i = begin; i < end; i++) {
+    f->out[i] *= f->scale;
+  }
+}
+
+void ref_fft(size_t n, const double *in, double *out, int direction) {
+  fft_args f = {n, 1, 0, 0, in, out, malloc(n * sizeof(double)), direction < 0 ? 1.0 : -1.0, 1.0 / n};
+  while (((size_t)1 << f.log2_n) < n) {
+    f.log2_n++;
+  }
+  parallel_for(n / 2, MIN_GRAIN, fft_twiddles, &f);
+  parallel_for(n, MIN_GRAIN, fft_reorder, &f);
+  for (f.log2_half = 0; f.half < n; f.half *= 2, f.log2_half++) {
+    parallel_for(n / 2, MIN_GRAIN, fft_butterflies, &f);
+  }
+  if (direction < 0) {
+    parallel_for(2 * n, MIN_GRAIN, fft_scale, &f);
+  }
+  free(f.twiddles);
+}
+
+/* Sum */
+
+typedef struct {
+  const float *data;
+  size_t n, num_chunks;
+  double partials[MAX_THREADS];
+} sum_args;
+
+static void sum_chunks(void *ctx, size_t begin, size_t end) {
+  sum_args *s = ctx;
+  for (size_t chunk = begin; chunk < end; chunk++) {
+    const float *restrict data = s->data;
+    size_t i = s->n * chunk / s->num_chunks, last = s->n * (chunk + 1) / s->num_chunks;
+    double lanes[LANES] = {0};
+    for (; i + LANES <= last; i += LANES) {
+      for (int l = 0; l < LANES; l++) {
+        lanes[l] += data[i + l];
+      }
+    }
+    double sum = 0.0;
+    for (; i < last; i++) {
+      sum += data[i];
+    }
+    for (int l = 0; l < LANES; l++) {
+      sum += lanes[l];
+    }
+    s->partials[chunk] = sum;
+  }
+}
+
+double ref_sum(const float *data, size_t n) {
+  sum_args s = {data, n, ref_threads(), {0}};
+  if (s.num_chunks > n / MIN_GRAIN) {
+    s.num_chunks = n / MIN_GRAIN ? n / MIN_GRAIN : 1;
+  }
+  parallel_for(s.num_chunks, 1, sum_chunks, &s);
+  double sum = 0.0;
+  for (size_t chunk = 0; chunk < s.num_chunks; chunk++) {
+    sum += s.partials[chunk];
+  }
+  return sum;
+}
+
+/* Sort: runs sorted by the threads, then merged pairwise */
+
+typedef struct {
+  float *data, *scratch;
+  size_t *bounds; // run r is [bounds[r], bounds[r + 1])
+  size_t num_runs;
+} sort_args;
+
+static int compare_floats(const void *a, const void *b) {
+  float x = *(const float *)a, y = *(const float *)b;
+  return (x > y) - (x < y);
+}
+
+static void sort_runs(void *ctx, size_t begin, size_t end) {
+  sort_args *s = ctx;
+  for (size_t r = begin; r < end; r++) {
+    qsort(s->data + s->bounds[r], s->bounds[r + 1] - s->bounds[r], sizeof(float), compare_floats);
+  }
+}
+
+static void merge_pairs(void *ctx, size_t begin, size_t end) {
+  sort_args *s = ctx;
+  for (size_t pair = begin; pair < end; pair++) {
+    size_t lo = s->bounds[2 * pair], mid = s->bounds[2 * pair + 1];
+    size_t hi = 2 * pair + 2 <= s->num_runs ? s->bounds[2 * pair + 2] : mid;
+    size_t i = lo, j = mid, out = lo;
+    while (i < mid && j < hi) {
+      s->scratch[out++] = s->data[j] < s->data[i] ? s->data[j++] : s->data[i++];
+    }
+    memcpy(s->scratch + out, s->data + i, (mid - i) * sizeof(float));
+    out += mid - i;
+    memcpy(s->scratch + out, s->data + j, (hi - j) * sizeof(float));
+  }
+}
+
+void ref_sort(float *data, size_t n) {
+  size_t num_runs = ref_threads();
+  if (n < MIN_GRAIN * num_runs) {
+    qsort(data, n, sizeof(float), compare_floats);
+    return;
+  }
+  sort_args s = {data, malloc(n * sizeof(float)), malloc((num_runs + 1) * sizeof(size_t)), num_runs};
+  for (size_t r = 0; r <= num_runs; r++) {
+    s.bounds[r] = n * r / num_runs;
+  }
+  parallel_for(num_runs, 1, sort_runs, &s);
+  while (s.num_runs > 1) {
+    size_t pairs = (s.num_runs + 1) / 2;
+    parallel_for(pairs, 1, merge_pairs, &s);
+    for (size_t r = 0; r < pairs; r++) {
+      s.bounds[r] = s.bounds[2 * r];
+    }
+    s.bounds[pairs] = n;
+    s.num_runs = pairs;
+    float *swap = s.data;
+    s.data = s.scratch;
+    s.scratch = swap;
+  }
+  if (s.data != data) {
+    memcpy(data, s.data, n * sizeof(float));
+    s.scratch = s.data;
+  }
+  free(s.scratch);
+  free(s.bounds);
+}
+
+/* SpMV and convolution */
+
+typedef struct {
+  const int *row_offsets, *cols;
+  const float *values, *x;
+  float *y;
+} spmv_args;
+
+static void spmv_rows(void *ctx, size_t begin, size_t end) {
+  const spmv_args *s = ctx;
+  for (size_t row = begin; row < end; row++) {
+    double sum = 0.0;
+    for (int i = s->row_offsets[row]; i < s->row_offsets[row + 1]; i++) {
+      sum += (double)s->values[i] * s->x[s->cols[i]];
+    }
+    s->y[row] = sum;
+  }
+}
+
+void ref_spmv(size_t num_rows, const int *row_offsets, const int *cols, const float *values, const float *x, float *y) {
+  spmv_args s = {row_offsets, cols, values, x, y};
+  parallel_for(num_rows, MIN_GRAIN / 16, spmv_rows, &s);
+}
+
+typedef struct {
+  size_t width, height, filter_size;
+  const float *in, *filter;
+  float *out;
+} convolve_args;
+
+static void convolve_rows(void *ctx, size_t begin, size_t end) {
+  const convolve_args *c = ctx;
+  long radius = c->filter_size / 2;
+  for (size_t y = begin; y < end; y++) {
+    float *restrict out_row = c->out + y * c->width;
+    memset(out_row, 0, c->width * sizeof(float));
+    for (long fy = 0; fy < (long)c->filter_size; fy++) {
+      long sy = (long)y + fy - radius;
+      const float *in_row = c->in + (sy < 0 ? 0 : sy >= (long)c->height ? (long)c->height - 1 : sy) * c->width;
+      for (long fx = 0; fx < (long)c->filter_size; fx++) {
+        const float weight = c->filter[fy * c->filter_size + fx];
+        long shift = fx - radius;
+        // the clamped columns at both edges, then the interior as one contiguous, vectorisable loop
+        size_t lo = shift < 0 ? -shift : 0, hi = shift > 0 ? c->width - shift : c->width;
+        lo = lo < c->width ? lo : c->width;
+        hi = hi > lo ? hi : lo;
+        for (size_t x = 0; x < lo; x++) {
+          out_row[x] += weight * in_row[0];
+        }
+        for (size_t x = lo; x < hi; x++) {
+          out_row[x] += weight * in_row[x + shift];
+        }
+        for (size_t x = hi; x < c->width; x++) {
+          out_row[x] += weight * in_row[c->width - 1];
+        }
+      }
+    }
+  }
+}
+
+void ref_convolve(size_t width, size_t height, const float *in, size_t filter_size, const float *filter, float *out) {
+  convolve_args c = {width, height, filter_size, in, filter, out};
+  parallel_for(height, 1 + MIN_GRAIN / (width * filter_size * filter_size), convolve_rows, &c);
+}
+
+/* Comparison */
+
+static void compare_element(ref_comparison *c, size_t i, double actual, double expected, double abs_tol, double rel_tol,
+                            double *worst_ratio) {
+  double error = fabs(actual - expected), tolerance = abs_tol + rel_tol * fabs(expected);
+  // NaN never compares as within tolerance
+  int within = error <= tolerance;
+  double ratio = within ? error / (tolerance > 0.0 ? tolerance : 1.0) : INFINITY;
+  if (!within) {
+    c->mismatches++;
+  }
+  if (ratio > *worst_ratio || (c->worst == (size_t)-1)) {
+    *worst_ratio = ratio;
+    c->worst = i;
+  }
+  if (error > c->max_abs_error || isnan(error)) {
+    c->max_abs_error = error;
+  }
+  if (expected != 0.0 && (error / fabs(expected) > c->max_rel_error || isnan(error))) {
+    c->max_rel_error = error / fabs(expected);
+  }
+}
+
+ref_comparison ref_compare(const float *actual, const float *expected, size_t n, double abs_tol, double rel_tol) {
+  ref_comparison c = {n, 0, (size_t)-1, 0.0, 0.0};
+  double worst_ratio = -1.0;
+  for (size_t i = 0; i < n; i++) {
+    compare_element(&c, i, actual[i], expected[i], abs_tol, rel_tol, &worst_ratio);
+  }
+  return c;
+}
+
+ref_comparison ref_compare_double(const float *actual, const double *expected, size_t n, double abs_tol, double rel_tol) {
+  ref_comparison c = {n, 0, (size_t)-1, 0.0, 0.0};
+  double worst_ratio = -1.0;
+  for (size_t i = 0; i < n; i++) {
+    compare_element(&c, i, actual[i], expected[i], abs_tol, rel_tol, &worst_ratio);
+  }
+  return c;
+}
+
+int ref_report(FILE *out, const char *name, ref_comparison c) {
+  fprintf(out, "%s: %zu of %zu elements outside the tolerance, max abs error %g, max rel error %g", name, c.mismatches, c.count,
+          c.max_abs_error, c.max_rel_error);
+  if (c.mismatches) {
+    fprintf(out, ", worst at %zu", c.worst);
+  }
+  fprintf(out, "\n");
+  return c.mismatches == 0;
+}
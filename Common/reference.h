@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+// CPU reference implementations that check the kernels' results at full size.
+//
+// Every routine splits its work over ref_threads() POSIX threads, the number of online processors unless
+// OCL_REF_THREADS says otherwise, and keeps its inner loops contiguous and free of aliasing so that the compiler can
+// vectorise them: the GEMMs are cache-blocked, the FFT is iterative with a precomputed twiddle table, the sort merges
+// thread-sorted runs. Sums and the FFT work in double, so the reference is the more accurate side of a comparison.
+// Timed with timer_ms(), the same routines give a CPU baseline for the benchmarks.
+//
+// ref_compare() accepts an element when |actual - expected| <= abs_tol + rel_tol * |expected|, counts the elements
+// that aren't and remembers the worst one; ref_report() prints that summary and returns whether everything passed.
+
+typedef struct {
+  size_t count;
+  size_t mismatches;
+  size_t worst;         // index of the element furthest outside (or closest to) its tolerance
+  double max_abs_error;
+  double max_rel_error; // relative to |expected|, for the elements whose expected value isn't 0
+} ref_comparison;
+
+// clang-format off
+unsigned       ref_threads       (void);
+
+void           ref_gemm          (size_t m, size_t n, size_t k, const float *a, const float *b, float *c);  // C = A * B, row-major
+void           ref_gemm_bt       (size_t m, size_t n, size_t k, const float *a, const float *bt, float *c); // C = A * B^T
+void           ref_fft           (size_t n, const double *in, double *out, int direction); // interleaved complex, n a power of two,
+                                                                                           // direction < 0 is the inverse, scaled by 1/n;
+                                                                                           // in and out must not overlap
+double         ref_sum           (const float *data, size_t n);
+void           ref_sort          (float *data, size_t n);
+void           ref_spmv          (size_t num_rows, const int *row_offsets, const int *cols, const float *values, const float *x,
+                                  float *y); // CSR
+void           ref_convolve      (size_t width, size_t height, const float *in, size_t filter_size, const float *filter,
+                                  float *out); // odd filter size, edges clamped
+
+ref_comparison ref_compare       (const float *actual, const float *expected, size_t n, double abs_tol, double rel_tol);
+ref_comparison ref_compare_double(const float *actual, const double *expected, size_t n, double abs_tol, double rel_tol);
+int            ref_report        (FILE *, const char *name, ref_comparison);
@@ -0,0 +1,159 @@
+#include "specialize.h"
+#include "error.h"
+#include "program_cache.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_MAX_VARIANTS 32
+
+typedef struct {
+  cl_context context;
+  cl_device_id device;
+  char *filename;
+  char *options;
+  int specialized;
+  cl_program program;
+} variant;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static variant *variants;
+static unsigned num_variants, max_variants;
+static spec_stats stats;
+
+spec_param spec_int(const char *name, long long value) {
+  spec_param p = {name};
+  snprintf(p.value, sizeof(p.value), "%lld", value);
+  return p;
+}
+
+// a cast keeps the literal a float whatever the value looks like
+spec_param spec_float(const char *name, double value) {
+  spec_param p = {name};
+  snprintf(p.value, sizeof(p.value), "((float)%.9g)", value);
+  return p;
+}
+
+spec_param spec_text(const char *name, const char *text) {
+  spec_param p = {name};
+  snprintf(p.value, sizeof(p.value), "%s", text);
+  return p;
+}
+
+static int by_name(const void *a, const void *b) { return strcmp((*(const spec_param **)a)->name, (*(const spec_param **)b)->name); }
+
+// options followed by one -D per parameter, the same set always gives the same string
+static char *specialized_options(const char *options, const spec_param *params, unsigned num_params) {
+  const spec_param **sorted = malloc(num_params * sizeof(spec_param *));
+  size_t length = strlen(options) + 1;
+  for (unsigned i = 0; i < num_params; i++) {
+    sorted[i] = &params[i];
+    length += strlen(params[i].name) + strlen(params[i].value) + 4;
+    for (const char *c = params[i].value; *c; c++) {
+      check_error(isspace((unsigned char)*c) ? CL_INVALID_BUILD_OPTIONS : CL_SUCCESS, "Specialisation values can't contain whitespace.");
+    }
+  }
+  qsort(sorted, num_params, sizeof(spec_param *), by_name);
+
+  char *result = malloc(length);
+  char *end = result + sprintf(result, "%s", options);
+  for (unsigned i = 0; i < num_params; i++) {
+    end += sprintf(end, "%s-D%s=%s", end == result ? "" : " ", sorted[i]->name, sorted[i]->value);
+  }
+  free(sorted);
+  return result;
+}
+
+static variant *find(cl_context context, cl_device_id device, const char *filename, const char *options) {
+  for (unsigned i = 0; i < num_variants; i++) {
+    variant *v = &variants[i];
+    if (v->context == context && v->device == device && !strcmp(v->filename, filename) && !strcmp(v->options, options)) {
+      return v;
+    }
+  }
+  return NULL;
+}
+
+static unsigned count_specialized(cl_context context, cl_device_id device, const char *filename) {
+  unsigned count = 0;
+  for (unsigned i = 0; i < num_variants; i++) {
+    count += variants[i].specialized && variants[i].context == context && variants[i].device == device && !strcmp(variants[i].filename, filename);
+  }
+  return count;
+}
+
+static unsigned variant_limit(void) {
+  const char *env = getenv("OCL_SPEC_MAX_VARIANTS");
+  int limit = env ? atoi(env) : 0;
+  return limit > 0 ? (unsigned)limit : DEFAULT_MAX_VARIANTS;
+}
+
+cl_program build_program_specialized(cl_context context, cl_device_id device, const char *filename, const char *options,
+                                     const spec_param *params, unsigned num_params) {
+  if (!options) {
+    options = "";
+  }
+  int specialized = num_params > 0 && !getenv("OCL_SPEC_DISABLE");
+  char *full = specialized ? specialized_options(options, params, num_params) : strdup(options);
+
+  pthread_mutex_lock(&lock);
+  variant *v = find(context, device, filename, full);
+  if (!v && specialized && count_specialized(context, device, filename) >= variant_limit()) {
+    stats.fallbacks++;
+    specialized = 0;
+    free(full);
+    full = strdup(options);
+    v = find(context, device, filename, full);
+  }
+
+  if (v) {
+    stats.hits++;
+    free(full);
+  } else {
+    if (num_variants == max_variants) {
+      max_variants = max_variants ? 2 * max_variants : 16;
+      variants = realloc(variants, max_variants * sizeof(variant));
+    }
+    v = &variants[num_variants++];
+    v->context = context;
+    v->device = device;
+    v->filename = strdup(filename);
+    v->options = full;
+    v->specialized = specialized;
+    v->program = build_program_with_options(context, device, filename, full);
+    stats.builds++;
+  }
+
+  // the table keeps its own reference, the caller releases the returned one
+  cl_program program = v->program;
+  clRetainProgram(program);
+  pthread_mutex_unlock(&lock);
+  return program;
+}
+
+spec_stats spec_get_stats(void) {
+  pthread_mutex_lock(&lock);
+  spec_stats result = stats;
+  pthread_mutex_unlock(&lock);
+  return result;
+}
+
+void spec_release_all(void) {
+  pthread_mutex_lock(&lock);
+  for (unsigned i = 0; i < num_variants; i++) {
+    clReleaseProgram(variants[i].program);
+    free(variants[i].filename);
+    free(variants[i].options);
+  }
+  free(variants);
+  variants = NULL;
+  num_variants = max_variants = 0;
+  pthread_mutex_unlock(&lock);
+}
+
+void spec_report(FILE *out) {
+  spec_stats s = spec_get_stats();
+  fprintf(out, "Specialisation: %u variant(s) built, %u reused, %u served by the generic build%s\n", s.builds, s.hits, s.fallbacks,
+          getenv("OCL_SPEC_DISABLE") ? " [disabled]" : "");
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <stdio.h>
+
+// Builds one program variant per distinct set of compile-time parameters.
+//
+// A specialisable kernel keeps its runtime arguments and overrides them when the matching macro is defined, e.g.
+//   #ifdef FFT_SIZE
+//      size = FFT_SIZE;
+//   #endif
+// so the host sets the same arguments for every variant, and the compiler can fold constants and unroll loops in the
+// specialised ones. build_program_specialized() turns the parameters into -DNAME=value options, sorted by name, and
+// keeps each variant for the rest of the run; build_program_from_source() caches the binaries across runs. Once a
+// program file has OCL_SPEC_MAX_VARIANTS variants on a device (default 32), further parameter sets get the generic
+// build without the parameters instead of another compile. OCL_SPEC_DISABLE always builds the generic variant.
+
+#define SPEC_VALUE_SIZE 48
+
+typedef struct {
+  const char *name;            // macro the kernel tests with #ifdef
+  char value[SPEC_VALUE_SIZE]; // replacement text
+} spec_param;
+
+typedef struct {
+  unsigned hits;      // variants reused within the run
+  unsigned builds;    // variants built, generic ones included
+  unsigned fallbacks; // parameter sets served by the generic variant
+} spec_stats;
+
+// clang-format off
+spec_param spec_int                 (const char *name, long long value);
+spec_param spec_float               (const char *name, double value);
+spec_param spec_text                (const char *name, const char *text); // a type name such as double or float4, no whitespace
+
+cl_program build_program_specialized(cl_context, cl_device_id, const char *filename, const char *options,
+                                     const spec_param *params, unsigned num_params);
+spec_stats spec_get_stats           (void);
+void       spec_release_all         (void); // the kept programs hold their contexts alive until then
+void       spec_report              (FILE *);
@@ -0,0 +1,151 @@
+#include "stream.h"
+#include "trace.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+enum { UPLOAD, COMPUTE, DOWNLOAD, NUM_STAGES };
+
+typedef struct {
+  cl_mem input, output;
+  cl_event free; // last command of the slot's previous chunk, NULL if the slot hasn't been used
+} slot;
+
+// shared with the completion callbacks, which run on driver threads
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  size_t completed;
+  cl_int status;
+  stream_done_fn done;
+  void *state;
+} progress;
+
+typedef struct {
+  progress *progress;
+  stream_chunk chunk;
+  const void *output;
+} job;
+
+static void CL_CALLBACK chunk_complete(cl_event event, cl_int status, void *user_data) {
+  (void)event;
+  job *j = user_data;
+  progress *p = j->progress;
+  pthread_mutex_lock(&p->lock);
+  if (status < 0 && !p->status) {
+    p->status = status;
+  }
+  if (status >= 0 && p->done) {
+    p->done(p->state, &j->chunk, j->output);
+  }
+  p->completed++;
+  pthread_cond_signal(&p->cond);
+  pthread_mutex_unlock(&p->lock);
+  free(j);
+}
+
+// enqueues upload, compute and download of one chunk, *last gets the event of the chunk's last command
+static cl_int enqueue_chunk(cl_command_queue *queues, const slot *s, const stream_chunk *chunk, const void *input, void *output,
+                            size_t output_size, stream_compute_fn compute, void *state, cl_event *last) {
+  cl_event uploaded, computed;
+  cl_int err = clEnqueueWriteBuffer(queues[UPLOAD], s->input, CL_FALSE, 0, chunk->size, (const char *)input + chunk->offset, s->free ? 1 : 0,
+                                    s->free ? &s->free : NULL, &uploaded);
+  if (err) {
+    return err;
+  }
+  err = compute(state, queues[COMPUTE], chunk, uploaded, &computed);
+  clReleaseEvent(uploaded);
+  if (err || !output_size) {
+    *last = computed;
+    return err;
+  }
+  err = clEnqueueReadBuffer(queues[DOWNLOAD], s->output, CL_FALSE, 0, output_size, (char *)output + chunk->index * output_size, 1, &computed,
+                            last);
+  clReleaseEvent(computed);
+  return err;
+}
+
+cl_int stream_run(cl_context context, cl_device_id device, const stream_config *config, const void *input, size_t input_size, void *output,
+                  stream_compute_fn compute, stream_done_fn done, void *state) {
+  cl_int err = CL_SUCCESS;
+  cl_command_queue queues[NUM_STAGES];
+  for (int i = 0; i < NUM_STAGES; i++) {
+    queues[i] = clCreateCommandQueueWithProperties(context, device, NULL, &err);
+    if (err) {
+      while (i--) {
+        clReleaseCommandQueue(queues[i]);
+      }
+      return err;
+    }
+  }
+
+  unsigned depth = config->depth ? config->depth : 1;
+  slot *slots = calloc(depth, sizeof(slot));
+  for (unsigned i = 0; i < depth && !err; i++) {
+    slots[i].input = clCreateBuffer(context, CL_MEM_READ_WRITE, config->chunk_size, NULL, &err);
+    if (!err && config->output_size) {
+      slots[i].output = clCreateBuffer(context, CL_MEM_WRITE_ONLY, config->output_size, NULL, &err);
+    }
+  }
+
+  progress p = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, CL_SUCCESS, done, state};
+  size_t num_chunks = (input_size + config->chunk_size - 1) / config->chunk_size, enqueued = 0;
+  for (; enqueued < num_chunks && !err; enqueued++) {
+    slot *s = &slots[enqueued % depth];
+    stream_chunk chunk = {enqueued, enqueued * config->chunk_size, config->chunk_size, s->input, s->output};
+    if (chunk.offset + chunk.size > input_size) {
+      chunk.size = input_size - chunk.offset;
+    }
+
+    cl_event last;
+    err = enqueue_chunk(queues, s, &chunk, input, output, config->output_size, compute, state, &last);
+    if (err) {
+      break;
+    }
+    job *j = malloc(sizeof(job));
+    *j = (job){&p, chunk, config->output_size ? (const char *)output + chunk.index * config->output_size : NULL};
+    err = clSetEventCallback(last, CL_COMPLETE, chunk_complete, j);
+    if (err) {
+      free(j);
+      clReleaseEvent(last);
+      break;
+    }
+    if (s->free) {
+      clReleaseEvent(s->free);
+    }
+    s->free = last;
+    // get the chunk going while the next one is enqueued
+    for (int i = 0; i < NUM_STAGES; i++) {
+      clFlush(queues[i]);
+    }
+  }
+
+  // chunks that made it into the queues still complete, their callbacks reference p
+  pthread_mutex_lock(&p.lock);
+  while (p.completed < enqueued) {
+    pthread_cond_wait(&p.cond, &p.lock);
+  }
+  pthread_mutex_unlock(&p.lock);
+  if (!err) {
+    err = p.status;
+  }
+
+  for (int i = 0; i < NUM_STAGES; i++) {
+    clFinish(queues[i]);
+    clReleaseCommandQueue(queues[i]);
+  }
+  for (unsigned i = 0; i < depth; i++) {
+    if (slots[i].free) {
+      clReleaseEvent(slots[i].free);
+    }
+    if (slots[i].input) {
+      clReleaseMemObject(slots[i].input);
+    }
+    if (slots[i].output) {
+      clReleaseMemObject(slots[i].output);
+    }
+  }
+  free(slots);
+  pthread_mutex_destroy(&p.lock);
+  pthread_cond_destroy(&p.cond);
+  return err;
+}
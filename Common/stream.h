@@ -0,0 +1,36 @@
+#pragma once
+
+#include <CL/cl.h>
+
+// Streams a large host input through the device in chunks, overlapping transfers with compute.
+//
+// The input is cut into chunks of chunk_size bytes. Up to depth chunks are in flight at once, each in its own slot of
+// device buffers, and every stage runs on its own in-order queue: while chunk i is computed, chunk i+1 is uploaded and
+// chunk i-1 downloaded. Events order the stages of a chunk and keep a slot from being refilled before its previous
+// chunk has been downloaded. depth 1 serialises the stages, which is the baseline to compare against.
+//
+// The compute callback enqueues the kernels of one chunk; it has to wait for the upload event and return the event of
+// its last command. Each chunk's output_size bytes land at output + index * output_size, and the done callback runs on
+// a driver thread once they have arrived. Done callbacks never run concurrently. stream_run() returns when every
+// enqueued chunk has completed, with CL_SUCCESS or the first error.
+
+typedef struct {
+  size_t chunk_size;  // input bytes per chunk, the last chunk may be shorter
+  size_t output_size; // output bytes per chunk, 0 if the compute step writes nothing back
+  unsigned depth;     // chunks in flight
+} stream_config;
+
+typedef struct {
+  size_t index;
+  size_t offset; // position of the chunk in the input
+  size_t size;   // input bytes of the chunk
+  cl_mem input;  // chunk_size bytes, the compute step may modify it
+  cl_mem output; // output_size bytes, NULL if output_size is 0
+} stream_chunk;
+
+typedef cl_int (*stream_compute_fn)(void *state, cl_command_queue, const stream_chunk *, cl_event uploaded, cl_event *computed);
+typedef void (*stream_done_fn)(void *state, const stream_chunk *, const void *output);
+
+// clang-format off
+cl_int stream_run(cl_context, cl_device_id, const stream_config *, const void *input, size_t input_size, void *output,
+                  stream_compute_fn, stream_done_fn, void *state);
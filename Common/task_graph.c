@@ -0,0 +1,236 @@
+#include "task_graph.h"
+#include "error.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_TASK ((unsigned)-1)
+
+typedef struct {
+  cl_event event;
+  unsigned queue;
+} task;
+
+// who touched a buffer last: a writer, then any number of readers
+typedef struct {
+  cl_mem mem;
+  unsigned writer; // NO_TASK before the first write
+  unsigned *readers;
+  unsigned num_readers, max_readers;
+} buffer_state;
+
+struct task_graph {
+  cl_command_queue queues[TASK_MAX_QUEUES];
+  unsigned num_queues, next_queue;
+  int out_of_order;
+  task *tasks;
+  unsigned num_tasks, max_tasks;
+  buffer_state *buffers;
+  unsigned num_buffers, max_buffers;
+  unsigned *deps; // of the task being added
+  unsigned num_deps, max_deps;
+  cl_event *wait_list;
+};
+
+static cl_command_queue create_queue(cl_context context, cl_device_id device, cl_command_queue_properties flags) {
+  cl_queue_properties properties[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE | flags, 0};
+  cl_int err;
+  cl_command_queue queue = clCreateCommandQueueWithProperties(context, device, properties, &err);
+  check_error(err, "Couldn't create a command queue.");
+  return queue;
+}
+
+task_graph *task_graph_create(cl_context context, cl_device_id device, unsigned num_queues) {
+  task_graph *g = calloc(1, sizeof(task_graph));
+  const char *env = getenv("OCL_TASK_QUEUES");
+  if (num_queues == 0 && env && atoi(env) > 0) {
+    num_queues = atoi(env);
+  }
+  if (num_queues == 0) {
+    cl_command_queue_properties supported = 0;
+    clGetDeviceInfo(device, CL_DEVICE_QUEUE_ON_HOST_PROPERTIES, sizeof(supported), &supported, NULL);
+    g->out_of_order = (supported & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) != 0;
+    num_queues = g->out_of_order ? 1 : TASK_DEFAULT_QUEUES;
+  }
+  g->num_queues = num_queues < TASK_MAX_QUEUES ? num_queues : TASK_MAX_QUEUES;
+  for (unsigned i = 0; i < g->num_queues; i++) {
+    g->queues[i] = create_queue(context, device, g->out_of_order ? CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE : 0);
+  }
+  return g;
+}
+
+static buffer_state *find_buffer(task_graph *g, cl_mem mem) {
+  for (unsigned i = 0; i < g->num_buffers; i++) {
+    if (g->buffers[i].mem == mem) {
+      return &g->buffers[i];
+    }
+  }
+  if (g->num_buffers == g->max_buffers) {
+    g->max_buffers = g->max_buffers ? 2 * g->max_buffers : 16;
+    g->buffers = realloc(g->buffers, g->max_buffers * sizeof(buffer_state));
+  }
+  buffer_state *b = &g->buffers[g->num_buffers++];
+  memset(b, 0, sizeof(*b));
+  b->mem = mem;
+  b->writer = NO_TASK;
+  return b;
+}
+
+static void add_dep(task_graph *g, unsigned id) {
+  if (id == NO_TASK) {
+    return;
+  }
+  for (unsigned i = 0; i < g->num_deps; i++) {
+    if (g->deps[i] == id) {
+      return;
+    }
+  }
+  if (g->num_deps == g->max_deps) {
+    g->max_deps = g->max_deps ? 2 * g->max_deps : 16;
+    g->deps = realloc(g->deps, g->max_deps * sizeof(unsigned));
+    g->wait_list = realloc(g->wait_list, g->max_deps * sizeof(cl_event));
+  }
+  g->deps[g->num_deps++] = id;
+}
+
+// collects the dependencies, picks a queue and leaves the events to wait for in wait_list
+static unsigned schedule(task_graph *g, const cl_mem *reads, unsigned num_reads, const cl_mem *writes, unsigned num_writes, cl_uint *num_wait) {
+  g->num_deps = 0;
+  for (unsigned i = 0; i < num_reads; i++) {
+    add_dep(g, find_buffer(g, reads[i])->writer);
+  }
+  for (unsigned i = 0; i < num_writes; i++) {
+    buffer_state *b = find_buffer(g, writes[i]);
+    add_dep(g, b->writer);
+    for (unsigned j = 0; j < b->num_readers; j++) {
+      add_dep(g, b->readers[j]);
+    }
+  }
+
+  unsigned queue = 0;
+  if (!g->out_of_order && g->num_queues > 1) {
+    unsigned latest = NO_TASK;
+    for (unsigned i = 0; i < g->num_deps; i++) {
+      latest = latest == NO_TASK || g->deps[i] > latest ? g->deps[i] : latest;
+    }
+    if (latest != NO_TASK) {
+      queue = g->tasks[latest].queue;
+    } else {
+      queue = g->next_queue;
+      g->next_queue = (g->next_queue + 1) % g->num_queues;
+    }
+  }
+
+  // an in-order queue already orders the tasks it holds
+  *num_wait = 0;
+  for (unsigned i = 0; i < g->num_deps; i++) {
+    const task *t = &g->tasks[g->deps[i]];
+    if (g->out_of_order || t->queue != queue) {
+      g->wait_list[(*num_wait)++] = t->event;
+    }
+  }
+  return queue;
+}
+
+static task_id commit(task_graph *g, unsigned queue, cl_event event, const cl_mem *reads, unsigned num_reads, const cl_mem *writes,
+                      unsigned num_writes) {
+  if (g->num_tasks == g->max_tasks) {
+    g->max_tasks = g->max_tasks ? 2 * g->max_tasks : 32;
+    g->tasks = realloc(g->tasks, g->max_tasks * sizeof(task));
+  }
+  task_id id = g->num_tasks++;
+  g->tasks[id] = (task){event, queue};
+
+  for (unsigned i = 0; i < num_reads; i++) {
+    buffer_state *b = find_buffer(g, reads[i]);
+    if (b->num_readers == b->max_readers) {
+      b->max_readers = b->max_readers ? 2 * b->max_readers : 4;
+      b->readers = realloc(b->readers, b->max_readers * sizeof(unsigned));
+    }
+    b->readers[b->num_readers++] = id;
+  }
+  for (unsigned i = 0; i < num_writes; i++) {
+    buffer_state *b = find_buffer(g, writes[i]);
+    b->writer = id;
+    b->num_readers = 0;
+  }
+  return id;
+}
+
+task_id task_kernel(task_graph *g, cl_kernel kernel, cl_uint work_dim, const size_t *global_size, const size_t *local_size,
+                    const cl_mem *reads, unsigned num_reads, const cl_mem *writes, unsigned num_writes) {
+  cl_uint num_wait;
+  unsigned queue = schedule(g, reads, num_reads, writes, num_writes, &num_wait);
+  cl_event event;
+  cl_int err = clEnqueueNDRangeKernel(g->queues[queue], kernel, work_dim, NULL, global_size, local_size, num_wait,
+                                      num_wait ? g->wait_list : NULL, &event);
+  check_error(err, "Couldn't enqueue a kernel task.");
+  return commit(g, queue, event, reads, num_reads, writes, num_writes);
+}
+
+task_id task_write(task_graph *g, cl_mem buffer, size_t offset, size_t size, const void *ptr) {
+  cl_uint num_wait;
+  unsigned queue = schedule(g, NULL, 0, &buffer, 1, &num_wait);
+  cl_event event;
+  cl_int err = clEnqueueWriteBuffer(g->queues[queue], buffer, CL_FALSE, offset, size, ptr, num_wait, num_wait ? g->wait_list : NULL, &event);
+  check_error(err, "Couldn't enqueue a write task.");
+  return commit(g, queue, event, NULL, 0, &buffer, 1);
+}
+
+task_id task_read(task_graph *g, cl_mem buffer, size_t offset, size_t size, void *ptr) {
+  cl_uint num_wait;
+  unsigned queue = schedule(g, &buffer, 1, NULL, 0, &num_wait);
+  cl_event event;
+  cl_int err = clEnqueueReadBuffer(g->queues[queue], buffer, CL_FALSE, offset, size, ptr, num_wait, num_wait ? g->wait_list : NULL, &event);
+  check_error(err, "Couldn't enqueue a read task.");
+  return commit(g, queue, event, &buffer, 1, NULL, 0);
+}
+
+task_id task_copy(task_graph *g, cl_mem src, cl_mem dst, size_t src_offset, size_t dst_offset, size_t size) {
+  cl_uint num_wait;
+  unsigned queue = schedule(g, &src, 1, &dst, 1, &num_wait);
+  cl_event event;
+  cl_int err = clEnqueueCopyBuffer(g->queues[queue], src, dst, src_offset, dst_offset, size, num_wait, num_wait ? g->wait_list : NULL, &event);
+  check_error(err, "Couldn't enqueue a copy task.");
+  return commit(g, queue, event, &src, 1, &dst, 1);
+}
+
+cl_event task_event(const task_graph *g, task_id id) { return g->tasks[id].event; }
+
+cl_command_queue task_queue(const task_graph *g, task_id id) { return g->queues[g->tasks[id].queue]; }
+
+cl_int task_graph_finish(task_graph *g) {
+  cl_int err = CL_SUCCESS;
+  for (unsigned i = 0; i < g->num_queues; i++) {
+    err |= clFinish(g->queues[i]);
+  }
+  for (unsigned i = 0; i < g->num_tasks; i++) {
+    clReleaseEvent(g->tasks[i].event);
+  }
+  for (unsigned i = 0; i < g->num_buffers; i++) {
+    free(g->buffers[i].readers);
+  }
+  g->num_tasks = g->num_buffers = 0;
+  g->next_queue = 0;
+  return err;
+}
+
+void task_graph_report(const task_graph *g, FILE *out) {
+  if (g->out_of_order) {
+    fprintf(out, "Task graph: one out-of-order queue\n");
+  } else {
+    fprintf(out, "Task graph: %u in-order queue(s)\n", g->num_queues);
+  }
+}
+
+void task_graph_destroy(task_graph *g) {
+  task_graph_finish(g);
+  for (unsigned i = 0; i < g->num_queues; i++) {
+    clReleaseCommandQueue(g->queues[i]);
+  }
+  free(g->tasks);
+  free(g->buffers);
+  free(g->deps);
+  free(g->wait_list);
+  free(g);
+}
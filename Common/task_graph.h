@@ -0,0 +1,39 @@
+#pragma once
+
+#include <CL/cl.h>
+#include <stdio.h>
+
+// Schedules kernels and transfers by the buffers they touch instead of by the order they were enqueued in.
+//
+// Every task declares the buffers it reads and the ones it writes; a buffer that is both read and written belongs to
+// the writes. A task waits for the last writer of everything it touches and, for what it writes, for the readers since
+// then, so independent tasks such as the uploads of different matrices are free to overlap. The wait lists are derived
+// as the tasks are added and the tasks are submitted right away, so kernel arguments set beforehand are captured as
+// usual and a kernel can be reused by the next task.
+//
+// num_queues 0 picks an out-of-order queue when the device supports one and TASK_DEFAULT_QUEUES in-order queues
+// otherwise; OCL_TASK_QUEUES=<n> asks for n in-order queues instead. On in-order queues a task goes to the queue of its
+// latest dependency, whose ordering then replaces the event, and independent tasks rotate through the queues. One
+// queue serialises everything, which is the baseline to compare against. All queues have profiling enabled.
+//
+// Transfers don't block, so host memory has to stay untouched until task_graph_finish(). Sub-buffers are tracked
+// separately from their parent; declare the parent when they overlap.
+
+#define TASK_MAX_QUEUES 8
+#define TASK_DEFAULT_QUEUES 3
+
+typedef struct task_graph task_graph;
+typedef unsigned task_id;
+
+// clang-format off
+task_graph      *task_graph_create (cl_context, cl_device_id, unsigned num_queues);
+void             task_graph_destroy(task_graph *);
+task_id          task_kernel       (task_graph *, cl_kernel, cl_uint work_dim, const size_t *global_size, const size_t *local_size,
+                                    const cl_mem *reads, unsigned num_reads, const cl_mem *writes, unsigned num_writes);
+task_id          task_write        (task_graph *, cl_mem, size_t offset, size_t size, const void *ptr);
+task_id          task_read         (task_graph *, cl_mem, size_t offset, size_t size, void *ptr);
+task_id          task_copy         (task_graph *, cl_mem src, cl_mem dst, size_t src_offset, size_t dst_offset, size_t size);
+cl_event         task_event        (const task_graph *, task_id); // owned by the graph until task_graph_finish()
+cl_command_queue task_queue        (const task_graph *, task_id);
+cl_int           task_graph_finish (task_graph *); // waits for every task and starts an empty graph on the same queues
+void             task_graph_report (const task_graph *, FILE *);
@@ -0,0 +1,4 @@
+#pragma once
+
+// monotonic wall clock in milliseconds, only differences are meaningful
+double timer_ms(void);
@@ -0,0 +1,430 @@
+#define OCL_TRACE_IMPLEMENTATION // the wrappers call the real functions
+#include "trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_QUEUES 64
+#define MAX_PROPERTIES 16
+#define NAME_SIZE 64
+#define QUEUE_NAME_SIZE 160
+// how long trace_write() waits for commands that are still in flight
+#define DRAIN_TIMEOUT_MS 1000
+
+typedef struct {
+  char name[NAME_SIZE];
+  char detail[NAME_SIZE];
+  const char *category;
+  size_t bytes;
+  unsigned queue;
+  int complete;
+  cl_ulong queued, submit, start, end;
+} trace_record;
+
+// the completion callbacks run on driver threads, everything below is guarded by lock
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static trace_record **records;
+static size_t num_records, capacity;
+static unsigned pending;
+static cl_command_queue queues[MAX_QUEUES];
+static char queue_names[MAX_QUEUES][QUEUE_NAME_SIZE];
+static unsigned num_queues;
+
+static const char *trace_path;
+
+static void write_at_exit(void) { trace_write(trace_path); }
+
+int trace_enabled(void) {
+  static int enabled = -1;
+  if (enabled < 0) {
+    trace_path = getenv("OCL_TRACE");
+    enabled = trace_path && *trace_path;
+    if (enabled) {
+      atexit(write_at_exit);
+    }
+  }
+  return enabled;
+}
+
+// one row per queue in the order they're first used, called with lock held
+static unsigned queue_index(cl_command_queue queue) {
+  for (unsigned i = 0; i < num_queues; i++) {
+    if (queues[i] == queue) {
+      return i;
+    }
+  }
+  if (num_queues == MAX_QUEUES) {
+    return MAX_QUEUES - 1;
+  }
+
+  cl_device_id device;
+  char device_name[128] = "unknown device";
+  if (!clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(device), &device, NULL)) {
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(device_name), device_name, NULL);
+  }
+  queues[num_queues] = queue;
+  snprintf(queue_names[num_queues], QUEUE_NAME_SIZE, "queue %u (%s)", num_queues, device_name);
+  return num_queues++;
+}
+
+static void CL_CALLBACK on_complete(cl_event event, cl_int status, void *data) {
+  trace_record *r = data;
+  cl_int err = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &r->queued, NULL);
+  err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &r->submit, NULL);
+  err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &r->start, NULL);
+  err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &r->end, NULL);
+
+  pthread_mutex_lock(&lock);
+  r->complete = !err && status == CL_COMPLETE;
+  pending--;
+  pthread_mutex_unlock(&lock);
+  clReleaseEvent(event);
+}
+
+// takes over the reference returned by the enqueue, the caller gets an extra one if it asked for the event
+static void record(cl_command_queue queue, cl_event event, const char *name, const char *category, size_t bytes, const char *detail,
+                   cl_event *user_event) {
+  trace_record *r = calloc(1, sizeof(trace_record));
+  snprintf(r->name, NAME_SIZE, "%s", name);
+  snprintf(r->detail, NAME_SIZE, "%s", detail ? detail : "");
+  r->category = category;
+  r->bytes = bytes;
+
+  pthread_mutex_lock(&lock);
+  r->queue = queue_index(queue);
+  if (num_records == capacity) {
+    capacity = capacity ? 2 * capacity : 256;
+    records = realloc(records, capacity * sizeof(trace_record *));
+  }
+  records[num_records++] = r;
+  pending++;
+  pthread_mutex_unlock(&lock);
+
+  if (user_event) {
+    clRetainEvent(event);
+    *user_event = event;
+  }
+  if (clSetEventCallback(event, CL_COMPLETE, on_complete, r)) {
+    pthread_mutex_lock(&lock);
+    pending--;
+    pthread_mutex_unlock(&lock);
+    clReleaseEvent(event);
+  }
+}
+
+static void write_string(FILE *out, const char *s) {
+  fputc('"', out);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      fputc('\\', out);
+    }
+    fputc((unsigned char)*s < ' ' ? ' ' : *s, out);
+  }
+  fputc('"', out);
+}
+
+// Chrome trace timestamps are in microseconds
+static void write_slice(FILE *out, const char *name, const char *suffix, const char *category, unsigned tid, cl_ulong from, cl_ulong to,
+                        cl_ulong base) {
+  char label[NAME_SIZE + 16];
+  snprintf(label, sizeof(label), "%s%s", name, suffix);
+  fprintf(out, ",\n{\"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"name\": ", tid);
+  write_string(out, label);
+  fprintf(out, ", \"cat\": \"%s\", \"ts\": %.3f, \"dur\": %.3f", category, (from - base) / 1e3, (to - from) / 1e3);
+}
+
+void trace_write(const char *path) {
+  if (!path || !*path) {
+    return;
+  }
+
+  // commands still in flight would be missing from the trace, give them a moment to finish
+  struct timespec ms = {0, 1000000};
+  for (int i = 0; i < DRAIN_TIMEOUT_MS; i++) {
+    pthread_mutex_lock(&lock);
+    unsigned in_flight = pending;
+    pthread_mutex_unlock(&lock);
+    if (!in_flight) {
+      break;
+    }
+    nanosleep(&ms, NULL);
+  }
+
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    fprintf(stderr, "Couldn't write trace file %s.\n", path);
+    return;
+  }
+
+  pthread_mutex_lock(&lock);
+  // device clocks start at an arbitrary value, the trace starts at the first queued command
+  cl_ulong base = ~(cl_ulong)0;
+  size_t num_complete = 0;
+  for (size_t i = 0; i < num_records; i++) {
+    const trace_record *r = records[i];
+    if (r->complete) {
+      cl_ulong first = r->queued && r->queued < r->start ? r->queued : r->start;
+      base = first < base ? first : base;
+      num_complete++;
+    }
+  }
+
+  // each queue gets an execution row (tid 2q) and a row for the time its commands wait (tid 2q + 1)
+  fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+  fprintf(out, "{\"ph\": \"M\", \"pid\": 1, \"name\": \"process_name\", \"args\": {\"name\": \"OpenCL\"}}");
+  for (unsigned q = 0; q < num_queues; q++) {
+    char wait_name[QUEUE_NAME_SIZE + 16];
+    snprintf(wait_name, sizeof(wait_name), "%s waiting", queue_names[q]);
+    fprintf(out, ",\n{\"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"name\": \"thread_name\", \"args\": {\"name\": ", 2 * q);
+    write_string(out, queue_names[q]);
+    fprintf(out, "}},\n{\"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"name\": \"thread_name\", \"args\": {\"name\": ", 2 * q + 1);
+    write_string(out, wait_name);
+    fprintf(out, "}}");
+  }
+
+  for (size_t i = 0; i < num_records; i++) {
+    const trace_record *r = records[i];
+    if (!r->complete) {
+      continue;
+    }
+    // some drivers leave QUEUED/SUBMIT at zero, those commands only get the execution slice
+    if (r->queued && r->queued <= r->submit && r->submit <= r->start) {
+      write_slice(out, r->name, " (queued)", "wait", 2 * r->queue + 1, r->queued, r->submit, base);
+      fprintf(out, "}");
+      write_slice(out, r->name, " (submitted)", "wait", 2 * r->queue + 1, r->submit, r->start, base);
+      fprintf(out, "}");
+    }
+    write_slice(out, r->name, "", r->category, 2 * r->queue, r->start, r->end, base);
+    fprintf(out, ", \"args\": {\"queued_ns\": %llu, \"submit_ns\": %llu, \"start_ns\": %llu, \"end_ns\": %llu",
+            (unsigned long long)(r->queued ? r->queued - base : 0), (unsigned long long)(r->submit ? r->submit - base : 0),
+            (unsigned long long)(r->start - base), (unsigned long long)(r->end - base));
+    if (r->bytes) {
+      fprintf(out, ", \"bytes\": %zu", r->bytes);
+    }
+    if (*r->detail) {
+      fprintf(out, ", \"detail\": ");
+      write_string(out, r->detail);
+    }
+    fprintf(out, "}}");
+  }
+  fprintf(out, "\n]}\n");
+  pthread_mutex_unlock(&lock);
+
+  fclose(out);
+  fprintf(stderr, "Trace of %zu command(s) on %u queue(s) written to %s\n", num_complete, num_queues, path);
+}
+
+cl_command_queue trace_create_command_queue(cl_context ctx, cl_device_id device, const cl_queue_properties *properties, cl_int *err) {
+  if (!trace_enabled()) {
+    return clCreateCommandQueueWithProperties(ctx, device, properties, err);
+  }
+
+  // copy the property list and switch profiling on, either in the existing CL_QUEUE_PROPERTIES or in an extra entry
+  cl_queue_properties traced[MAX_PROPERTIES + 3];
+  size_t n = 0;
+  int found = 0;
+  for (; properties && properties[n] && n < MAX_PROPERTIES; n += 2) {
+    traced[n] = properties[n];
+    traced[n + 1] = properties[n + 1];
+    if (properties[n] == CL_QUEUE_PROPERTIES) {
+      traced[n + 1] |= CL_QUEUE_PROFILING_ENABLE;
+      found = 1;
+    }
+  }
+  if (!found) {
+    traced[n++] = CL_QUEUE_PROPERTIES;
+    traced[n++] = CL_QUEUE_PROFILING_ENABLE;
+  }
+  traced[n] = 0;
+  return clCreateCommandQueueWithProperties(ctx, device, traced, err);
+}
+
+cl_int trace_enqueue_ndrange_kernel(cl_command_queue queue, cl_kernel kernel, cl_uint work_dim, const size_t *offset, const size_t *global_size,
+                                    const size_t *local_size, cl_uint num_events, const cl_event *wait_list, cl_event *event) {
+  if (!trace_enabled()) {
+    return clEnqueueNDRangeKernel(queue, kernel, work_dim, offset, global_size, local_size, num_events, wait_list, event);
+  }
+  cl_event traced;
+  cl_int err = clEnqueueNDRangeKernel(queue, kernel, work_dim, offset, global_size, local_size, num_events, wait_list, &traced);
+  if (err) {
+    return err;
+  }
+
+  char name[NAME_SIZE] = "kernel";
+  clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, sizeof(name), name, NULL);
+  char detail[NAME_SIZE] = "global";
+  for (cl_uint i = 0; i < work_dim; i++) {
+    size_t used = strlen(detail);
+    snprintf(detail + used, sizeof(detail) - used, "%c%zu", i ? 'x' : ' ', global_size[i]);
+  }
+  for (cl_uint i = 0; local_size && i < work_dim; i++) {
+    size_t used = strlen(detail);
+    snprintf(detail + used, sizeof(detail) - used, "%s%zu", i ? "x" : " local ", local_size[i]);
+  }
+  record(queue, traced, name, "kernel", 0, detail, event);
+  return CL_SUCCESS;
+}
+
+cl_int trace_enqueue_read_buffer(cl_command_queue queue, cl_mem buffer, cl_bool blocking, size_t offset, size_t size, void *ptr, cl_uint num_events,
+                                 const cl_event *wait_list, cl_event *event) {
+  if (!trace_enabled()) {
+    return clEnqueueReadBuffer(queue, buffer, blocking, offset, size, ptr, num_events, wait_list, event);
+  }
+  cl_event traced;
+  cl_int err = clEnqueueReadBuffer(queue, buffer, blocking, offset, size, ptr, num_events, wait_list, &traced);
+  if (!err) {
+    record(queue, traced, "read_buffer", "transfer", size, NULL, event);
+  }
+  return err;
+}
+
+cl_int trace_enqueue_write_buffer(cl_command_queue queue, cl_mem buffer, cl_bool blocking, size_t offset, size_t size, const void *ptr,
+                                  cl_uint num_events, const cl_event *wait_list, cl_event *event) {
+  if (!trace_enabled()) {
+    return clEnqueueWriteBuffer(queue, buffer, blocking, offset, size, ptr, num_events, wait_list, event);
+  }
+  cl_event traced;
+  cl_int err = clEnqueueWriteBuffer(queue, buffer, blocking, offset, size, ptr, num_events, wait_list, &traced);
+  if (!err) {
+    record(queue, traced, "write_buffer", "transfer", size, NULL, event);
+  }
+  return err;
+}
+
+cl_int trace_enqueue_copy_buffer(cl_command_queue queue, cl_mem src, cl_mem dst, size_t src_offset, size_t dst_offset, size_t size, cl_uint num_events,
+                                 const cl_event *wait_list, cl_event *event) {
+  if (!trace_enabled()) {
+    return clEnqueueCopyBuffer(queue, src, dst, src_offset, dst_offset, size, num_events, wait_list, event);
+  }
+  cl_event traced;
+  cl_int err = clEnqueueCopyBuffer(queue, src, dst, src_offset, dst_offset, size, num_events, wait_list, &traced);
+  if (!err) {
+    record(queue, traced, "copy_buffer", "transfer", size, NULL, event);
+  }
+  return err;
+}
+
+cl_int trace_enqueue_fill_buffer(cl_command_queue queue, cl_mem buffer, const void *pattern, size_t pattern_size, size_t offset, size_t size,
+                                 cl_uint num_events, const cl_event *wait_list, cl_event *event) {
+  if (!trace_enabled()) {
+    return clEnqueueFillBuffer(queue, buffer, pattern, pattern_size, offset, size, num_events, wait_list, event);
+  }
+  cl_event traced;
+  cl_int err = clEnqueueFillBuffer(queue, buffer, pattern, pattern_size, offset, size, num_events, wait_list, &traced);
+  if (!err) {
+    record(queue, traced, "fill_buffer", "transfer", size, NULL, event);
+  }
+  return err;
+}
+
+cl_int trace_enqueue_read_buffer_rect(cl_command_queue queue, cl_mem buffer, cl_bool blocking, const size_t *buffer_origin, const size_t *host_origin,
+                                      const size_t *region, size_t buffer_row_pitch, size_t buffer_slice_pitch, size_t host_row_pitch,
+                                      size_t host_slice_pitch, void *ptr, cl_uint num_events, const cl_event *wait_list, cl_event *event) {
+  if (!trace_enabled()) {
+    return clEnqueueReadBufferRect(queue, buffer, blocking, buffer_origin, host_origin, region, buffer_row_pitch, buffer_slice_pitch, host_row_pitch,
+                                   host_slice_pitch, ptr, num_events, wait_list, event);
+  }
+  cl_event traced;
+  cl_int err = clEnqueueReadBufferRect(queue, buffer, blocking, buffer_origin, host_origin, region, buffer_row_pitch, buffer_slice_pitch,
+                                       host_row_pitch, host_slice_pitch, ptr, num_events, wait_list, &traced);
+  if (!err) {
+    record(queue, traced, "read_buffer_rect", "transfer", region[0] * region[1] * region[2], NULL, event);
+  }
+  return err;
+}
+
+cl_int trace_enqueue_write_buffer_rect(cl_command_queue queue, cl_mem buffer, cl_bool blocking, const size_t *buffer_origin, const size_t *host_origin,
+                                       const size_t *region, size_t buffer_row_pitch, size_t buffer_slice_pitch, size_t host_row_pitch,
+                                       size_t host_slice_pitch, const void *ptr, cl_uint num_events, const cl_event *wait_list, cl_event *event) {
+  if (!trace_enabled()) {
+    return clEnqueueWriteBufferRect(queue, buffer, blocking, buffer_origin, host_origin, region, buffer_row_pitch, buffer_slice_pitch, host_row_pitch,
+                                    host_slice_pitch, ptr, num_events, wait_list, event);
+  }
+  cl_event traced;
+  cl_int err = clEnqueueWriteBufferRect(queue, buffer, blocking, buffer_origin, host_origin, region, buffer_row_pitch, buffer_slice_pitch,
+                                        host_row_pitch, host_slice_pitch, ptr, num_events, wait_list, &traced);
+  if (!err) {
+    record(queue, traced, "write_buffer_rect", "transfer", region[0] * region[1] * region[2], NULL, event);
+  }
+  return err;
+}
+
+cl_int trace_enqueue_copy_buffer_rect(cl_command_queue queue, cl_mem src, cl_mem dst, const size_t *src_origin, const size_t *dst_origin,
+                                      const size_t *region, size_t src_row_pitch, size_t src_slice_pitch, size_t dst_row_pitch,
+                                      size_t dst_slice_pitch, cl_uint num_events, const cl_event *wait_list, cl_event *event) {
+  if (!trace_enabled()) {
+    return clEnqueueCopyBufferRect(queue, src, dst, src_origin, dst_origin, region, src_row_pitch, src_slice_pitch, dst_row_pitch, dst_slice_pitch,
+                                   num_events, wait_list, event);
+  }
+  cl_event traced;
+  cl_int err = clEnqueueCopyBufferRect(queue, src, dst, src_origin, dst_origin, region, src_row_pitch, src_slice_pitch, dst_row_pitch,
+                                       dst_slice_pitch, num_events, wait_list, &traced);
+  if (!err) {
+    record(queue, traced, "copy_buffer_rect", "transfer", region[0] * region[1] * region[2], NULL, event);
+  }
+  return err;
+}
+
+void *trace_enqueue_map_buffer(cl_command_queue queue, cl_mem buffer, cl_bool blocking, cl_map_flags flags, size_t offset, size_t size,
+                               cl_uint num_events, const cl_event *wait_list, cl_event *event, cl_int *err) {
+  if (!trace_enabled()) {
+    return clEnqueueMapBuffer(queue, buffer, blocking, flags, offset, size, num_events, wait_list, event, err);
+  }
+  cl_event traced;
+  cl_int status;
+  void *ptr = clEnqueueMapBuffer(queue, buffer, blocking, flags, offset, size, num_events, wait_list, &traced, &status);
+  if (!status) {
+    record(queue, traced, "map_buffer", "map", size, NULL, event);
+  }
+  if (err) {
+    *err = status;
+  }
+  return ptr;
+}
+
+cl_int trace_enqueue_unmap_mem_object(cl_command_queue queue, cl_mem memobj, void *ptr, cl_uint num_events, const cl_event *wait_list,
+                                      cl_event *event) {
+  if (!trace_enabled()) {
+    return clEnqueueUnmapMemObject(queue, memobj, ptr, num_events, wait_list, event);
+  }
+  cl_event traced;
+  cl_int err = clEnqueueUnmapMemObject(queue, memobj, ptr, num_events, wait_list, &traced);
+  if (!err) {
+    record(queue, traced, "unmap_mem_object", "map", 0, NULL, event);
+  }
+  return err;
+}
+
+static size_t image_bytes(cl_mem image, const size_t *region) {
+  size_t element_size = 0;
+  clGetImageInfo(image, CL_IMAGE_ELEMENT_SIZE, sizeof(element_size), &element_size, NULL);
+  return element_size * region[0] * region[1] * region[2];
+}
+
+cl_int trace_enqueue_read_image(cl_command_queue queue, cl_mem image, cl_bool blocking, const size_t *origin, const size_t *region, size_t row_pitch,
+                                size_t slice_pitch, void *ptr, cl_uint num_events, const cl_event *wait_list, cl_event *event) {
+  if (!trace_enabled()) {
+    return clEnqueueReadImage(queue, image, blocking, origin, region, row_pitch, slice_pitch, ptr, num_events, wait_list, event);
+  }
+  cl_event traced;
+  cl_int err = clEnqueueReadImage(queue, image, blocking, origin, region, row_pitch, slice_pitch, ptr, num_events, wait_list, &traced);
+  if (!err) {
+    record(queue, traced, "read_image", "transfer", image_bytes(image, region), NULL, event);
+  }
+  return err;
+}
+
+cl_int trace_enqueue_write_image(cl_command_queue queue, cl_mem image, cl_bool blocking, const size_t *origin, const size_t *region, size_t row_pitch,
+                                 size_t slice_pitch, const void *ptr, cl_uint num_events, const cl_event *wait_list, cl_event *event) {
+  if (!trace_enabled()) {
+    return clEnqueueWriteImage(queue, image, blocking, origin, region, row_pitch, slice_pitch, ptr, num_events, wait_list, event);
+  }
+  cl_event traced;
+  cl_int err = clEnqueueWriteImage(queue, image, blocking, origin, region, row_pitch, slice_pitch, ptr, num_events, wait_list, &traced);
+  if (!err) {
+    record(queue, traced, "write_image", "transfer", image_bytes(image, region), NULL, event);
+  }
+  return err;
+}
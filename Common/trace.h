@@ -0,0 +1,51 @@
+#pragma once
+
+#include <CL/cl.h>
+
+// Records every enqueued command and writes a Chrome trace (chrome://tracing, ui.perfetto.dev).
+//
+// Tracing is switched on by setting OCL_TRACE to the output file, e.g. OCL_TRACE=bsort.json ./bsort. Queues created
+// through the tracer get CL_QUEUE_PROFILING_ENABLE added, every traced command gets a profiling event (the caller's
+// event if it asked for one), and its QUEUED/SUBMIT/START/END timestamps are collected in a completion callback. Each
+// queue becomes one row showing the execution slices, with a second row showing the time commands spent queued and
+// submitted. The file is written at exit, or earlier with trace_write(). Without OCL_TRACE the wrappers just forward
+// to OpenCL.
+//
+// Compiling a sample with OCL_TRACE_ENQUEUE defined routes its clCreateCommandQueueWithProperties and clEnqueue*
+// calls through the wrappers below without touching the call sites. oclAction itself is built with it, so the commands
+// of the reducer, streams, graphs and pools appear in the trace of every sample.
+
+// clang-format off
+int              trace_enabled                   (void);
+void             trace_write                     (const char *path);
+
+cl_command_queue trace_create_command_queue      (cl_context, cl_device_id, const cl_queue_properties *, cl_int *);
+cl_int           trace_enqueue_ndrange_kernel    (cl_command_queue, cl_kernel, cl_uint, const size_t *, const size_t *, const size_t *, cl_uint, const cl_event *, cl_event *);
+cl_int           trace_enqueue_read_buffer       (cl_command_queue, cl_mem, cl_bool, size_t, size_t, void *, cl_uint, const cl_event *, cl_event *);
+cl_int           trace_enqueue_write_buffer      (cl_command_queue, cl_mem, cl_bool, size_t, size_t, const void *, cl_uint, const cl_event *, cl_event *);
+cl_int           trace_enqueue_copy_buffer       (cl_command_queue, cl_mem, cl_mem, size_t, size_t, size_t, cl_uint, const cl_event *, cl_event *);
+cl_int           trace_enqueue_fill_buffer       (cl_command_queue, cl_mem, const void *, size_t, size_t, size_t, cl_uint, const cl_event *, cl_event *);
+cl_int           trace_enqueue_read_buffer_rect  (cl_command_queue, cl_mem, cl_bool, const size_t *, const size_t *, const size_t *, size_t, size_t, size_t, size_t, void *, cl_uint, const cl_event *, cl_event *);
+cl_int           trace_enqueue_write_buffer_rect (cl_command_queue, cl_mem, cl_bool, const size_t *, const size_t *, const size_t *, size_t, size_t, size_t, size_t, const void *, cl_uint, const cl_event *, cl_event *);
+cl_int           trace_enqueue_copy_buffer_rect  (cl_command_queue, cl_mem, cl_mem, const size_t *, const size_t *, const size_t *, size_t, size_t, size_t, size_t, cl_uint, const cl_event *, cl_event *);
+void            *trace_enqueue_map_buffer        (cl_command_queue, cl_mem, cl_bool, cl_map_flags, size_t, size_t, cl_uint, const cl_event *, cl_event *, cl_int *);
+cl_int           trace_enqueue_unmap_mem_object  (cl_command_queue, cl_mem, void *, cl_uint, const cl_event *, cl_event *);
+cl_int           trace_enqueue_read_image        (cl_command_queue, cl_mem, cl_bool, const size_t *, const size_t *, size_t, size_t, void *, cl_uint, const cl_event *, cl_event *);
+cl_int           trace_enqueue_write_image       (cl_command_queue, cl_mem, cl_bool, const size_t *, const size_t *, size_t, size_t, const void *, cl_uint, const cl_event *, cl_event *);
+// clang-format on
+
+#if defined(OCL_TRACE_ENQUEUE) && !defined(OCL_TRACE_IMPLEMENTATION)
+#define clCreateCommandQueueWithProperties trace_create_command_queue
+#define clEnqueueNDRangeKernel trace_enqueue_ndrange_kernel
+#define clEnqueueReadBuffer trace_enqueue_read_buffer
+#define clEnqueueWriteBuffer trace_enqueue_write_buffer
+#define clEnqueueCopyBuffer trace_enqueue_copy_buffer
+#define clEnqueueFillBuffer trace_enqueue_fill_buffer
+#define clEnqueueReadBufferRect trace_enqueue_read_buffer_rect
+#define clEnqueueWriteBufferRect trace_enqueue_write_buffer_rect
+#define clEnqueueCopyBufferRect trace_enqueue_copy_buffer_rect
+#define clEnqueueMapBuffer trace_enqueue_map_buffer
+#define clEnqueueUnmapMemObject trace_enqueue_unmap_mem_object
+#define clEnqueueReadImage trace_enqueue_read_image
+#define clEnqueueWriteImage trace_enqueue_write_image
+#endif
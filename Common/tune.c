@@ -0,0 +1,155 @@
+#include "tune.h"
+#include "bench.h"
+#include "error.h"
+#include "program_cache.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DB_FILE "tuning.txt"
+#define TUNE_WARMUP 1
+#define TUNE_ITERATIONS 5
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+typedef struct {
+  tune_fn run;
+  void *state;
+  tune_config config;
+} trial;
+
+static const char *db_path(void) {
+  static char path[4200];
+  const char *env = getenv("OCL_TUNE_DB");
+  if (env && *env) {
+    return env;
+  }
+  const char *dir = program_cache_dir();
+  if (!dir) {
+    return NULL;
+  }
+  snprintf(path, sizeof(path), "%s/%s", dir, DB_FILE);
+  return path;
+}
+
+// tuning results only carry over to the same device with the same driver
+static unsigned long long device_key(cl_device_id device) {
+  cl_device_info params[] = {CL_DEVICE_NAME, CL_DEVICE_VENDOR, CL_DRIVER_VERSION};
+  uint64_t hash = FNV_OFFSET;
+  for (int i = 0; i < 3; i++) {
+    char value[256] = "";
+    clGetDeviceInfo(device, params[i], sizeof(value), value, NULL);
+    for (const char *c = value; *c; c++) {
+      hash ^= (unsigned char)*c;
+      hash *= FNV_PRIME;
+    }
+    hash ^= 0xff;
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+unsigned tune_local_sizes(cl_kernel kernel, cl_device_id device, size_t max_local_size, tune_config *candidates, unsigned max_candidates) {
+  size_t wg_size, wg_multiple;
+  cl_int err = clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(wg_size), &wg_size, NULL);
+  err |= clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(wg_multiple), &wg_multiple, NULL);
+  check_error(err, "Couldn't find the work-group size of the kernel.");
+  if (max_local_size && max_local_size < wg_size) {
+    wg_size = max_local_size;
+  }
+
+  // powers of two from the preferred multiple up, smaller groups only waste SIMD lanes
+  size_t local_size = 1;
+  while (local_size * 2 <= wg_multiple && local_size * 2 <= wg_size) {
+    local_size *= 2;
+  }
+  unsigned n = 0;
+  for (; local_size <= wg_size && n < max_candidates; local_size *= 2) {
+    candidates[n++] = (tune_config){local_size, 0};
+  }
+  return n;
+}
+
+int tune_lookup(cl_device_id device, const char *kernel, size_t problem_size, tune_config *config) {
+  const char *path = db_path();
+  FILE *db = path ? fopen(path, "r") : NULL;
+  if (!db) {
+    return 0;
+  }
+
+  unsigned long long key = device_key(device), line_key;
+  char line[512], name[256];
+  size_t line_size, local_size, param;
+  int found = 0;
+  while (fgets(line, sizeof(line), db)) {
+    if (sscanf(line, "%llx %255s %zu %zu %zu", &line_key, name, &line_size, &local_size, &param) == 5 && line_key == key &&
+        line_size == problem_size && !strcmp(name, kernel)) {
+      *config = (tune_config){local_size, param};
+      found = 1;
+    }
+  }
+  fclose(db);
+  return found;
+}
+
+void tune_store(cl_device_id device, const char *kernel, size_t problem_size, tune_config config, double ms) {
+  const char *path = db_path();
+  FILE *db = path ? fopen(path, "a") : NULL;
+  if (!db) {
+    fprintf(stderr, "Couldn't open the tuning database, the result for %s isn't saved.\n", kernel);
+    return;
+  }
+  fprintf(db, "%016llx %s %zu %zu %zu %.6f\n", device_key(device), kernel, problem_size, config.local_size, config.param, ms);
+  fclose(db);
+}
+
+static double run_trial(void *arg) {
+  trial *t = arg;
+  return t->run(t->state, t->config);
+}
+
+int tune_search(cl_device_id device, const char *kernel, size_t problem_size, const tune_config *candidates, unsigned num_candidates, tune_fn run,
+                void *state, tune_config *best) {
+  double best_ms = -1.0;
+  for (unsigned i = 0; i < num_candidates; i++) {
+    trial t = {run, state, candidates[i]};
+    // one untimed run rejects configurations the kernel can't handle before they are measured
+    if (run_trial(&t) < 0.0) {
+      continue;
+    }
+    bench_stats stats = bench_measure(run_trial, &t, TUNE_WARMUP, TUNE_ITERATIONS);
+    fprintf(stderr, "Tuning %s (%zu): local size %zu, param %zu: %.4f ms\n", kernel, problem_size, t.config.local_size, t.config.param,
+            stats.median_ms);
+    if (best_ms < 0.0 || stats.median_ms < best_ms) {
+      *best = t.config;
+      best_ms = stats.median_ms;
+    }
+  }
+
+  if (best_ms < 0.0) {
+    return 0;
+  }
+  tune_store(device, kernel, problem_size, *best, best_ms);
+  return 1;
+}
+
+tune_config tune_select(cl_device_id device, const char *kernel, size_t problem_size, tune_config fallback, const tune_config *candidates,
+                        unsigned num_candidates, tune_fn run, void *state) {
+  const char *mode = getenv("OCL_TUNE");
+  int tuning = mode && *mode && strcmp(mode, "0");
+  int force = tuning && !strcmp(mode, "force");
+
+  tune_config config;
+  if (!force && tune_lookup(device, kernel, problem_size, &config)) {
+    return config;
+  }
+  if (!tuning) {
+    return fallback;
+  }
+  if (!tune_search(device, kernel, problem_size, candidates, num_candidates, run, state, &config)) {
+    fprintf(stderr, "No configuration of %s could run, using the default.\n", kernel);
+    return fallback;
+  }
+  return config;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <CL/cl.h>
+
+// Picks launch configurations by timing them instead of taking the largest work-group the device allows.
+//
+// A configuration is a local size plus an optional kernel-specific parameter, e.g. the points per work-group that
+// decide how fft_init partitions local memory. tune_select() looks the winner up in a tuning database keyed by device,
+// kernel and problem size. OCL_TUNE controls what happens when there's no entry:
+//   unset          use the caller's fallback, nothing is timed
+//   OCL_TUNE=1     time every candidate, use the fastest and store it in the database
+//   OCL_TUNE=force retime even if the database has an entry
+// The database is a text file, $OCL_TUNE_DB or tuning.txt in the program cache directory, later lines win.
+// tune_search() always times the candidates and stores the winner, it returns 0 if none of them could run.
+
+typedef struct {
+  size_t local_size;
+  size_t param; // kernel-specific, 0 if unused
+} tune_config;
+
+// runs the kernels once with the configuration and returns their device time in ms, or a negative value if the
+// configuration can't run
+typedef double (*tune_fn)(void *state, tune_config);
+
+// clang-format off
+unsigned    tune_local_sizes(cl_kernel, cl_device_id, size_t max_local_size, tune_config *candidates, unsigned max_candidates);
+tune_config tune_select     (cl_device_id, const char *kernel, size_t problem_size, tune_config fallback,
+                             const tune_config *candidates, unsigned num_candidates, tune_fn, void *state);
+int         tune_search     (cl_device_id, const char *kernel, size_t problem_size, const tune_config *candidates, unsigned num_candidates,
+                             tune_fn, void *state, tune_config *best);
+int         tune_lookup     (cl_device_id, const char *kernel, size_t problem_size, tune_config *);
+void        tune_store      (cl_device_id, const char *kernel, size_t problem_size, tune_config, double ms);